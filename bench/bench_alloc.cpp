@@ -0,0 +1,84 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures how fast we can build and then tear down a large module through the IRBuilder.
+//
+// Usage: bench_alloc [functions] [instructions per function]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Each iteration of the body does a load/add/store round trip on a stack variable,
+// which is the pattern our frontends generate the most of.
+//
+static int buildModule(Module *mod, int funcCount, int instrCount) {
+    IRBuilder *builder = new IRBuilder(mod);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    int total = 0;
+    
+    for (int i = 0; i<funcCount; i++) {
+        Function *func = Function::Create(mod, "func" + std::to_string(i), Linkage::Global, i32Type);
+        mod->addFunction(func);
+        builder->setCurrentFunction(func);
+        builder->createBlock("entry");
+        
+        Reg *var = builder->createAlloca(i32Type);
+        builder->createStore(i32Type, builder->createI32(0), var);
+        total += 2;
+        
+        for (int j = 0; j<instrCount; j += 3) {
+            Operand *val = builder->createLoad(i32Type, var);
+            Operand *sum = builder->createAdd(i32Type, val, builder->createI32(j));
+            builder->createStore(i32Type, sum, var);
+            total += 3;
+        }
+        
+        builder->createRet(i32Type, builder->createLoad(i32Type, var));
+        total += 2;
+    }
+    
+    delete builder;
+    return total;
+}
+
+int main(int argc, char **argv) {
+    int funcCount = 100;
+    int instrCount = 10000;
+    if (argc > 1) funcCount = atoi(argv[1]);
+    if (argc > 2) instrCount = atoi(argv[2]);
+    
+    Module *mod = new Module("bench");
+    
+    Clock::time_point start = Clock::now();
+    int total = buildModule(mod, funcCount, instrCount);
+    Clock::time_point built = Clock::now();
+    size_t bytes = mod->getArena()->getBytesAllocated();
+    delete mod;
+    Clock::time_point end = Clock::now();
+    
+    double buildTime = elapsed(start, built);
+    double destroyTime = elapsed(built, end);
+    double totalTime = elapsed(start, end);
+    
+    std::cout << "Instructions: " << total << std::endl;
+    std::cout << "Arena bytes:  " << bytes << std::endl;
+    std::cout << "Build:        " << buildTime << " ms" << std::endl;
+    std::cout << "Destroy:      " << destroyTime << " ms" << std::endl;
+    std::cout << "Throughput:   " << (total / totalTime / 1000.0) << " M instr/s" << std::endl;
+    
+    return 0;
+}
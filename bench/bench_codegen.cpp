@@ -0,0 +1,110 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures how code generation scales with the number of threads. The module is transformed
+// once, and then compiled again for each thread count from 1 to 64. Every run must produce
+// exactly the same assembly as the single-threaded one.
+//
+// Usage: bench_codegen [functions] [instructions per function]
+//
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <parallel.hpp>
+#include <amd64/amd64.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static void buildModule(Module *mod, int funcCount, int instrCount) {
+    IRBuilder *builder = new IRBuilder(mod);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    
+    for (int i = 0; i<funcCount; i++) {
+        Function *func = Function::Create(mod, "func" + std::to_string(i), Linkage::Global, i32Type);
+        mod->addFunction(func);
+        builder->setCurrentFunction(func);
+        builder->createBlock("entry");
+        
+        Reg *var = builder->createAlloca(i32Type);
+        builder->createStore(i32Type, builder->createI32(0), var);
+        for (int j = 0; j<instrCount; j += 3) {
+            Operand *val = builder->createLoad(i32Type, var);
+            val = builder->createAdd(i32Type, val, builder->createI32(j));
+            builder->createStore(i32Type, val, var);
+        }
+        
+        builder->createRet(i32Type, builder->createLoad(i32Type, var));
+    }
+    
+    delete builder;
+}
+
+// The writer can only print the whole file, so the output is read back from a temporary file.
+// The X86 IR shares operands between instructions, so the writer can't safely be freed.
+static std::string compile(Module *mod, double *time) {
+    Amd64Writer *writer = new Amd64Writer(mod);
+    Clock::time_point start = Clock::now();
+    writer->compile();
+    *time = elapsed(start, Clock::now());
+    
+    std::string path = "/tmp/bench_codegen.s";
+    writer->writeToFile(path);
+    
+    std::ifstream reader(path);
+    std::stringstream output;
+    output << reader.rdbuf();
+    return output.str();
+}
+
+int main(int argc, char **argv) {
+    int funcCount = 2000;
+    int instrCount = 300;
+    if (argc > 1) funcCount = atoi(argv[1]);
+    if (argc > 2) instrCount = atoi(argv[2]);
+    
+    Module *mod = new Module("bench");
+    buildModule(mod, funcCount, instrCount);
+    mod->transform();
+    
+    std::cout << funcCount << " functions, " << instrCount << " instructions each" << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(14) << "codegen ms" << std::setw(14) << "speedup" << std::endl;
+    
+    double serialTime = 0;
+    std::string expected = "";
+    bool ok = true;
+    
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        setThreadCount(threads);
+        double time = 0;
+        std::string output = compile(mod, &time);
+        
+        if (threads == 1) {
+            serialTime = time;
+            expected = output;
+        } else if (output != expected) {
+            std::cerr << "Output with " << threads << " threads differs from the serial output" << std::endl;
+            ok = false;
+        }
+        
+        std::cout << std::setw(10) << threads << std::setw(14) << time;
+        std::cout << std::setw(14) << (serialTime / time) << std::endl;
+    }
+    
+    remove("/tmp/bench_codegen.s");
+    delete mod;
+    return ok ? 0 : 1;
+}
+
@@ -0,0 +1,163 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Compares a linear scan over the pointer-based form of a function with the same scan over
+// its compact encoding. The scan does what a simple analysis would: it looks at the opcode,
+// the type, and every operand of every instruction.
+//
+// Usage: bench_compact [max instructions]
+//
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+#include <llir.hpp>
+#include <compact.hpp>
+#include <irbuilder.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Builds one function with roughly the given number of instructions, spread over
+// blocks of about 64 instructions each.
+//
+static Function *buildFunction(Module *mod, int instrCount) {
+    IRBuilder *builder = new IRBuilder(mod);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+
+    Function *func = Function::Create(mod, "main", Linkage::Global, i32Type);
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+    Block *current = builder->createBlock("entry");
+
+    Reg *var = builder->createAlloca(i32Type);
+    builder->createStore(i32Type, builder->createI32(1), var);
+
+    for (int i = 0; i<instrCount; i += 8) {
+        if (i % 64 == 0) {
+            Block *next = builder->createBlock("B" + std::to_string(i));
+            builder->setInsertPoint(current);
+            builder->createBr(next);
+            builder->setInsertPoint(next);
+            current = next;
+        }
+
+        Operand *val1 = builder->createLoad(i32Type, var);
+        Operand *val2 = builder->createAdd(i32Type, val1, builder->createI32(i));
+        Operand *val3 = builder->createSMul(i32Type, val2, builder->createI32(3));
+        Operand *val4 = builder->createXor(i32Type, val3, val1);
+        Operand *val5 = builder->createSub(i32Type, val4, builder->createI32(7));
+        Operand *val6 = builder->createAnd(i32Type, val5, val2);
+        builder->createStore(i32Type, val6, var);
+    }
+
+    builder->createRet(i32Type, builder->createLoad(i32Type, var));
+    delete builder;
+    return func;
+}
+
+//
+// The two scans compute the same summary, so the results can be checked against each other
+//
+struct Summary {
+    int64_t regs = 0;
+    int64_t imms = 0;
+    int64_t types = 0;
+    int64_t branches = 0;
+};
+
+static Summary scanPointers(Function *func) {
+    Summary s;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (instr->getType() == InstrType::Br) ++s.branches;
+            s.types += (int)instr->getDataType()->getType();
+
+            Operand *dest = instr->getDest();
+            if (dest && dest->getType() == OpType::Reg) ++s.regs;
+
+            for (int i = 0; i<instr->getOperandCount(); i++) {
+                Operand *op = instr->getOperand(i);
+                if (op == nullptr) continue;
+                if (op->getType() == OpType::Reg) ++s.regs;
+                else if (op->getType() == OpType::Imm) s.imms += static_cast<Imm *>(op)->getValue();
+            }
+        }
+    }
+    return s;
+}
+
+static Summary scanCompact(const CompactFunction &code) {
+    Summary s;
+    for (CompactCursor instr = code.begin(); !instr.atEnd(); instr.next()) {
+        if (instr.getType() == InstrType::Br) ++s.branches;
+        s.types += (int)instr.getDataType()->getType();
+
+        for (int i = 0; i<instr.getOperandCount(); i++) {
+            CompactOperand op = instr.getOperand(i);
+            if (op.kind == CompactKind::Reg) ++s.regs;
+            else if (op.kind == CompactKind::Imm) s.imms += op.value;
+        }
+    }
+    return s;
+}
+
+int main(int argc, char **argv) {
+    int maxCount = 1000000;
+    if (argc > 1) maxCount = atoi(argv[1]);
+
+    std::cout << std::setw(10) << "instrs" << std::setw(14) << "ptr scan ms" << std::setw(14) << "encode ms";
+    std::cout << std::setw(14) << "soa scan ms" << std::setw(12) << "speedup";
+    std::cout << std::setw(14) << "ptr B/instr" << std::setw(14) << "soa B/instr" << std::endl;
+
+    for (int count = 1000; count <= maxCount; count *= 10) {
+        Module *mod = new Module("bench");
+        Function *func = buildFunction(mod, count);
+        int instrs = 0;
+        for (Block *block : *func) instrs += block->getInstrCount();
+
+        // Repeat the scans so the small sizes are measurable
+        int reps = 10000000 / count;
+        if (reps < 5) reps = 5;
+
+        Clock::time_point start = Clock::now();
+        Summary ptr;
+        for (int r = 0; r<reps; r++) ptr = scanPointers(func);
+        Clock::time_point ptrDone = Clock::now();
+        CompactFunction code(func);
+        Clock::time_point encoded = Clock::now();
+        Summary soa;
+        for (int r = 0; r<reps; r++) soa = scanCompact(code);
+        Clock::time_point soaDone = Clock::now();
+
+        if (ptr.regs != soa.regs || ptr.imms != soa.imms || ptr.types != soa.types || ptr.branches != soa.branches) {
+            std::cerr << "Error: The scans disagree." << std::endl;
+            return 1;
+        }
+
+        double ptrTime = elapsed(start, ptrDone) / reps;
+        double soaTime = elapsed(encoded, soaDone) / reps;
+
+        std::cout << std::setw(10) << instrs;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << std::setw(14) << ptrTime;
+        std::cout << std::setw(14) << elapsed(ptrDone, encoded);
+        std::cout << std::setw(14) << soaTime;
+        std::cout << std::setprecision(2) << std::setw(11) << ptrTime / soaTime << "x";
+        std::cout << std::setprecision(1);
+        std::cout << std::setw(14) << (double)mod->getArena()->getBytesAllocated() / instrs;
+        std::cout << std::setw(14) << (double)code.getMemoryUsage() / instrs << std::endl;
+
+        delete mod;
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures the dataflow solver on two forward problems over a large generated function:
+// dominators, as an intersection of sets, and the stores to local variables that reach each
+// block, as a union. Liveness covers the backward direction.
+//
+// The dominators are checked against the dominator tree, and the reaching stores against a
+// search from each store. Exits with 1 on any difference, so it doubles as a test.
+//
+// Usage: bench_dataflow [blocks]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <dataflow.hpp>
+#include <dominators.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Every block stores to one of a few variables and branches: mostly forwards, sometimes
+// back to form loops, and sometimes unconditionally, which leaves a few blocks unreachable.
+//
+static Function *buildFunction(Module *mod, int blockCount, unsigned seed) {
+    std::mt19937 rng(seed);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    IRBuilder *builder = new IRBuilder(mod);
+
+    Function *func = Function::Create(mod, "func" + std::to_string(seed), Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+
+    std::vector<Block *> blocks;
+    for (int i = 0; i<blockCount; i++) {
+        Block *block = Block::Create(func, "b" + std::to_string(i));
+        builder->addBlock(block);
+        blocks.push_back(block);
+    }
+
+    builder->setInsertPoint(blocks[0]);
+    std::vector<Operand *> vars;
+    for (int i = 0; i<8; i++) vars.push_back(builder->createAlloca(i32Type));
+
+    for (int i = 0; i<blockCount; i++) {
+        builder->setInsertPoint(blocks[i]);
+        Operand *arg = func->getArg(0);
+        builder->createStore(i32Type, builder->createI32(i), vars[rng() % vars.size()]);
+
+        int ahead = blockCount - i - 1;
+        int kind = rng() % 100;
+        if (i == blockCount - 1) {
+            builder->createRet(i32Type, arg);
+        } else if (kind < 10 && i > 0) {
+            builder->createBlt(i32Type, arg, builder->createI32(i), blocks[i - 1 - rng() % std::min(i, 32)]);
+        } else if (kind < 60) {
+            builder->createBgt(i32Type, arg, builder->createI32(i), blocks[i + 1 + rng() % std::min(ahead, 16)]);
+        } else if (kind < 64) {
+            builder->createBr(blocks[i + 1 + rng() % std::min(ahead, 4)]);
+        }
+    }
+
+    delete builder;
+    return func;
+}
+
+//
+// Dominators: each block adds itself to what dominates all of its predecessors
+//
+typedef GenKillProblem<Direction::Forward, Meet::Intersect> DominatorProblem;
+
+static bool checkDominators(Function *func, std::vector<BitVector> &exits, AnalysisManager &am) {
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    for (Block *a : *func) {
+        if (!domTree->isReachable(a)) continue;
+        for (Block *b : *func) {
+            if (!domTree->isReachable(b)) continue;
+            if (exits[b->getID()].test(a->getID()) != domTree->dominates(a, b)) {
+                std::cerr << "Wrong dominators for " << b->getName() << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//
+// Reaching stores: a block passes on every store that reaches it, except those to a variable it
+// stores to itself, and adds its own last store to each variable
+//
+typedef GenKillProblem<Direction::Forward, Meet::Union> ReachingProblem;
+
+struct StoreInfo {
+    Block *block;
+    int var;
+};
+
+static std::vector<StoreInfo> findStores(Function *func) {
+    std::vector<StoreInfo> stores;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (instr->getType() != InstrType::Store) continue;
+            Reg *ptr = static_cast<Reg *>(instr->getOperand2());
+            stores.push_back({ block, ptr->getID() });
+        }
+    }
+    return stores;
+}
+
+static void setupReaching(ReachingProblem &problem, const std::vector<StoreInfo> &stores) {
+    for (size_t i = 0; i<stores.size(); i++) {
+        BitVector &gen = problem.gen[stores[i].block->getID()];
+        for (size_t j = 0; j<stores.size(); j++) {
+            if (stores[j].var != stores[i].var || j == i) continue;
+            if (stores[j].block == stores[i].block) gen.reset(j);
+            problem.kill[stores[i].block->getID()].set(j);
+        }
+        gen.set(i);
+    }
+}
+
+static bool checkReaching(Function *func, const std::vector<StoreInfo> &stores, std::vector<BitVector> &entries) {
+    int blockCount = func->getMaxBlockID() + 1;
+    std::vector<std::vector<bool>> reaches(blockCount, std::vector<bool>(stores.size(), false));
+
+    for (size_t i = 0; i<stores.size(); i++) {
+        // Only the last store to a variable leaves its block
+        bool last = true;
+        for (size_t j = i + 1; j<stores.size(); j++) {
+            if (stores[j].block == stores[i].block && stores[j].var == stores[i].var) last = false;
+        }
+        if (!last) continue;
+
+        std::vector<Block *> worklist(stores[i].block->getSuccessors());
+        while (!worklist.empty()) {
+            Block *block = worklist.back();
+            worklist.pop_back();
+            if (reaches[block->getID()][i]) continue;
+            reaches[block->getID()][i] = true;
+
+            bool overwritten = false;
+            for (const StoreInfo &store : stores) {
+                if (store.block == block && store.var == stores[i].var) overwritten = true;
+            }
+            if (!overwritten) {
+                for (Block *succ : block->getSuccessors()) worklist.push_back(succ);
+            }
+        }
+    }
+
+    for (Block *block : *func) {
+        for (size_t i = 0; i<stores.size(); i++) {
+            if (entries[block->getID()].test(i) != reaches[block->getID()][i]) {
+                std::cerr << "Wrong reaching stores for " << block->getName() << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int blockCount = 5000;
+    if (argc > 1) blockCount = atoi(argv[1]);
+
+    Module *mod = new Module("dataflow");
+    AnalysisManager am;
+    std::vector<BitVector> entries, exits;
+
+    for (unsigned seed = 1; seed<=8; seed++) {
+        Function *small = buildFunction(mod, 20 + seed * 10, seed);
+
+        DominatorProblem dominators(small, small->getMaxBlockID() + 1);
+        for (Block *block : *small) dominators.gen[block->getID()].set(block->getID());
+        solveDataflow(small, dominators, entries, exits);
+        if (!checkDominators(small, exits, am)) return 1;
+
+        std::vector<StoreInfo> stores = findStores(small);
+        ReachingProblem reaching(small, stores.size());
+        setupReaching(reaching, stores);
+        solveDataflow(small, reaching, entries, exits);
+        if (!checkReaching(small, stores, entries)) return 1;
+    }
+
+    Function *func = buildFunction(mod, blockCount, 100);
+    func->updateCFG();
+    func->getReversePostOrder();
+
+    Clock::time_point start = Clock::now();
+    DominatorProblem dominators(func, func->getMaxBlockID() + 1);
+    for (Block *block : *func) dominators.gen[block->getID()].set(block->getID());
+    solveDataflow(func, dominators, entries, exits);
+    Clock::time_point domDone = Clock::now();
+
+    std::vector<StoreInfo> stores = findStores(func);
+    ReachingProblem reaching(func, stores.size());
+    for (size_t i = 0; i<stores.size(); i++) reaching.gen[stores[i].block->getID()].set(i);
+
+    // Stores to the same variable, so each block's kill set takes one pass over them
+    std::vector<BitVector> byVar(func->getRegCount(), BitVector(stores.size()));
+    for (size_t i = 0; i<stores.size(); i++) byVar[stores[i].var].set(i);
+    for (size_t i = 0; i<stores.size(); i++) reaching.kill[stores[i].block->getID()].unionWith(byVar[stores[i].var]);
+    solveDataflow(func, reaching, entries, exits);
+    Clock::time_point reachDone = Clock::now();
+
+    std::cout << blockCount << " blocks, " << stores.size() << " stores" << std::endl;
+    std::cout << "dominators:      " << elapsed(start, domDone) << " ms" << std::endl;
+    std::cout << "reaching stores: " << elapsed(domDone, reachDone) << " ms" << std::endl;
+    std::cout << "ok" << std::endl;
+
+    am.clear();
+    delete mod;
+    return 0;
+}
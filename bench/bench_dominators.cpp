@@ -0,0 +1,275 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures the control flow analyses on a synthetic function with a large number of blocks.
+// The blocks mix forward branches, loops, returns, and fall-through, so the trees come out
+// both deep and wide.
+//
+// Before timing, the dominator and post-dominator trees of a few small functions built the same
+// way are checked against the textbook iterative solution, along with the dominance frontiers.
+// Exits with 1 on any difference, so it doubles as a test.
+//
+// Usage: bench_dominators [blocks]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <dominators.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Every block compares the argument and branches somewhere. Most targets are a little way
+// ahead, some go back to form loops, and a few blocks return if the branch isn't taken.
+//
+static Function *buildFunction(Module *mod, int blockCount, unsigned seed) {
+    std::mt19937 rng(seed);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    IRBuilder *builder = new IRBuilder(mod);
+
+    Function *func = Function::Create(mod, "func" + std::to_string(seed), Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+
+    std::vector<Block *> blocks;
+    for (int i = 0; i<blockCount; i++) {
+        Block *block = Block::Create(func, "b" + std::to_string(i));
+        builder->addBlock(block);
+        blocks.push_back(block);
+    }
+
+    for (int i = 0; i<blockCount; i++) {
+        builder->setInsertPoint(blocks[i]);
+        Operand *arg = func->getArg(0);
+        int ahead = blockCount - i - 1;
+        int kind = rng() % 100;
+
+        if (i == blockCount - 1) {
+            builder->createRet(i32Type, builder->createI32(i));
+        } else if (kind < 4) {
+            Block *target = blocks[i + 1 + rng() % std::min(ahead, 16)];
+            builder->createBgt(i32Type, arg, builder->createI32(i), target);
+            builder->createRet(i32Type, builder->createI32(i));
+        } else if (kind < 14 && i > 0) {
+            Block *loop = blocks[i - 1 - rng() % std::min(i, 32)];
+            builder->createBlt(i32Type, arg, builder->createI32(i), loop);
+        } else if (kind < 66) {
+            Block *target = blocks[i + 1 + rng() % std::min(ahead, 16)];
+            builder->createBgt(i32Type, arg, builder->createI32(i), target);
+            if (rng() % 2) builder->createBr(blocks[i + 1 + rng() % std::min(ahead, 4)]);
+        } else if (kind < 74) {
+            builder->createBr(blocks[i + 1 + rng() % std::min(ahead, 64)]);
+        }
+    }
+
+    delete builder;
+    return func;
+}
+
+//
+// The textbook solution: Dom(b) is b plus everything that dominates all of its predecessors.
+// Node 0 is the root; for post-dominators it is a virtual exit, and the graph is reversed.
+//
+typedef std::vector<std::vector<int>> Graph;
+
+static std::vector<std::vector<bool>> solveNaive(const Graph &preds, const std::vector<bool> &reachable) {
+    int count = preds.size();
+    std::vector<std::vector<bool>> dom(count, std::vector<bool>(count, true));
+    dom[0].assign(count, false);
+    dom[0][0] = true;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int node = 1; node<count; node++) {
+            if (!reachable[node]) continue;
+
+            std::vector<bool> next(count, true);
+            for (int pred : preds[node]) {
+                if (!reachable[pred]) continue;
+                for (int i = 0; i<count; i++) next[i] = next[i] && dom[pred][i];
+            }
+            next[node] = true;
+
+            if (next != dom[node]) {
+                dom[node] = next;
+                changed = true;
+            }
+        }
+    }
+    return dom;
+}
+
+// Nodes are reachable from the root following the reverse of the predecessor edges
+static std::vector<bool> findReachable(const Graph &preds) {
+    int count = preds.size();
+    Graph succs(count);
+    for (int node = 0; node<count; node++) {
+        for (int pred : preds[node]) succs[pred].push_back(node);
+    }
+
+    std::vector<bool> reachable(count, false);
+    std::vector<int> worklist = { 0 };
+    reachable[0] = true;
+    while (!worklist.empty()) {
+        int node = worklist.back();
+        worklist.pop_back();
+        for (int succ : succs[node]) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+    return reachable;
+}
+
+static bool checkTree(DominatorTreeBase *tree, const std::vector<Block *> &nodes, const Graph &preds, const char *what) {
+    int count = nodes.size();
+    std::vector<bool> reachable = findReachable(preds);
+    std::vector<std::vector<bool>> dom = solveNaive(preds, reachable);
+
+    for (int b = 1; b<count; b++) {
+        if (tree->isReachable(nodes[b]) != reachable[b]) {
+            std::cerr << what << ": reachability of " << nodes[b]->getName() << " is wrong" << std::endl;
+            return false;
+        }
+        if (!reachable[b]) continue;
+
+        for (int a = 0; a<count; a++) {
+            bool expected = reachable[a] && dom[b][a];
+            if (a == b) expected = true;
+            if (tree->dominates(nodes[a], nodes[b]) != expected) {
+                std::cerr << what << ": dominates(" << (nodes[a] ? nodes[a]->getName() : Symbol()) << ", ";
+                std::cerr << nodes[b]->getName() << ") should be " << expected << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // DF(a) holds b when a dominates a predecessor of b, but doesn't strictly dominate b
+    for (int a = 1; a<count; a++) {
+        if (!reachable[a]) continue;
+
+        std::vector<Block *> expected;
+        for (int b = 1; b<count; b++) {
+            if (!reachable[b] || (dom[b][a] && a != b)) continue;
+            for (int pred : preds[b]) {
+                if (reachable[pred] && dom[pred][a]) {
+                    expected.push_back(nodes[b]);
+                    break;
+                }
+            }
+        }
+
+        std::vector<Block *> frontier = tree->getFrontier(nodes[a]);
+        std::sort(expected.begin(), expected.end());
+        std::sort(frontier.begin(), frontier.end());
+        if (frontier != expected) {
+            std::cerr << what << ": the frontier of " << nodes[a]->getName() << " is wrong" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Node i + 1 is the ith block in layout order. For dominators, node 0 is an extra root that
+// leads only to the entry block, which gives the same relation as rooting at the entry.
+static bool check(Function *func, AnalysisManager &am) {
+    std::vector<Block *> nodes = { nullptr };
+    for (Block *block : *func) nodes.push_back(block);
+
+    int count = nodes.size();
+    Graph domPreds(count), postPreds(count);
+    for (int i = 1; i<count; i++) {
+        for (Block *succ : nodes[i]->getSuccessors()) {
+            int node = std::find(nodes.begin(), nodes.end(), succ) - nodes.begin();
+            domPreds[node].push_back(i);
+            postPreds[i].push_back(node);
+        }
+        if (nodes[i]->getSuccessors().empty()) postPreds[i].push_back(0);
+    }
+    domPreds[1].push_back(0);
+
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    PostDominatorTree *postTree = am.getResult<PostDominatorTree>(func);
+
+    // The extra root of the dominator check is not a block, so its row is left out
+    std::vector<Block *> domNodes = nodes;
+    domNodes[0] = nodes[1];
+    if (!checkTree(domTree, domNodes, domPreds, "dominators")) return false;
+    return checkTree(postTree, nodes, postPreds, "post-dominators");
+}
+
+int main(int argc, char **argv) {
+    int blockCount = 100000;
+    if (argc > 1) blockCount = atoi(argv[1]);
+
+    Module *mod = new Module("dominators");
+    AnalysisManager am;
+
+    for (unsigned seed = 1; seed<=8; seed++) {
+        Function *small = buildFunction(mod, 40 + seed * 20, seed);
+        if (!check(small, am)) return 1;
+    }
+
+    Function *func = buildFunction(mod, blockCount, 100);
+
+    Clock::time_point start = Clock::now();
+    func->updateCFG();
+    Clock::time_point edgesDone = Clock::now();
+    func->getReversePostOrder();
+    Clock::time_point orderDone = Clock::now();
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    Clock::time_point domDone = Clock::now();
+    PostDominatorTree *postTree = am.getResult<PostDominatorTree>(func);
+    Clock::time_point postDone = Clock::now();
+
+    for (Block *block : *func) domTree->getFrontier(block);
+    Clock::time_point frontierDone = Clock::now();
+
+    // Random queries, so the cost is the lookup rather than the walk
+    std::mt19937 rng(7);
+    std::vector<Block *> blocks;
+    for (Block *block : *func) blocks.push_back(block);
+    int dominated = 0;
+    int queries = 1000000;
+    for (int i = 0; i<queries; i++) {
+        Block *a = blocks[rng() % blocks.size()];
+        Block *b = blocks[rng() % blocks.size()];
+        if (domTree->dominates(a, b)) ++dominated;
+        if (postTree->dominates(a, b)) ++dominated;
+    }
+    Clock::time_point queryDone = Clock::now();
+
+    std::cout << blockCount << " blocks, " << domTree->getBlocks().size() << " reachable, ";
+    std::cout << postTree->getBlocks().size() - 1 << " reaching an exit" << std::endl;
+    std::cout << "edges:               " << elapsed(start, edgesDone) << " ms" << std::endl;
+    std::cout << "reverse post-order:  " << elapsed(edgesDone, orderDone) << " ms" << std::endl;
+    std::cout << "dominator tree:      " << elapsed(orderDone, domDone) << " ms" << std::endl;
+    std::cout << "post-dominator tree: " << elapsed(domDone, postDone) << " ms" << std::endl;
+    std::cout << "frontiers:           " << elapsed(postDone, frontierDone) << " ms" << std::endl;
+    std::cout << "2 x " << queries << " queries:  " << elapsed(frontierDone, queryDone) << " ms";
+    std::cout << " (" << dominated << " dominated)" << std::endl;
+    std::cout << "ok" << std::endl;
+
+    am.clear();
+    delete mod;
+    return 0;
+}
+
@@ -0,0 +1,255 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures the liveness analysis on large generated functions, next to the hardware transform
+// (which runs it) and the code generator. Values flow between blocks, and the blocks branch
+// forwards and backwards, so registers stay live across many blocks and around loops.
+//
+// Before timing, the results for a few small functions are checked against a naive solution
+// that works one instruction at a time. Exits with 1 on any difference, so it doubles as a test.
+//
+// Usage: bench_liveness [functions] [blocks per function]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <liveness.hpp>
+#include <amd64/amd64.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Each block loads a variable, combines it with values computed in earlier blocks,
+// stores the result, and branches. Some of the values are picked from far back,
+// so their ranges are long.
+//
+// As in real code, the values used are set on every path to the use, the loops nest
+// or follow each other, and nothing jumps into the middle of a loop. Otherwise most
+// values would be live everywhere.
+//
+static Function *buildFunction(Module *mod, std::string name, int blockCount, unsigned seed) {
+    std::mt19937 rng(seed);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    IRBuilder *builder = new IRBuilder(mod);
+
+    Function *func = Function::Create(mod, name, Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+
+    std::vector<Block *> blocks;
+    for (int i = 0; i<blockCount; i++) {
+        Block *block = Block::Create(func, "b" + std::to_string(i));
+        builder->addBlock(block);
+        blocks.push_back(block);
+    }
+
+    builder->setInsertPoint(blocks[0]);
+    std::vector<Operand *> vars;
+    for (int i = 0; i<4; i++) vars.push_back(builder->createAlloca(i32Type));
+
+    // The values usable so far, with the block that set them, and the edges (from, to)
+    std::vector<std::pair<Operand *, int>> values = { { func->getArg(0), -1 } };
+    std::vector<std::pair<int, int>> jumps;
+    std::vector<std::pair<int, int>> loops;
+
+    for (int i = 0; i<blockCount; i++) {
+        // A jump here skipped the blocks in between, so their values may be unset
+        for (auto &jump : jumps) {
+            if (jump.second != i) continue;
+            values.erase(std::remove_if(values.begin(), values.end(), [&](std::pair<Operand *, int> &value) {
+                return value.second > jump.first && value.second < i;
+            }), values.end());
+        }
+
+        builder->setInsertPoint(blocks[i]);
+        Operand *var = vars[rng() % vars.size()];
+        Operand *val = builder->createLoad(i32Type, var);
+        for (int j = 0; j<3; j++) {
+            size_t back = rng() % std::min((size_t)(rng() % 4 ? 4 : 64), values.size());
+            val = builder->createAdd(i32Type, val, values[values.size() - 1 - back].first);
+        }
+        values.push_back({ val, i });
+        builder->createStore(i32Type, val, var);
+
+        int ahead = blockCount - i - 1;
+        int kind = rng() % 100;
+        if (i == blockCount - 1) {
+            builder->createRet(i32Type, val);
+        } else if (kind < 10 && i > 0) {
+            int header = i - 1 - rng() % std::min(i, 16);
+            bool nests = true;
+            for (auto &loop : loops) {
+                if (header <= loop.second && header > loop.first) nests = false;
+            }
+            for (auto &jump : jumps) {
+                if (jump.first < header && jump.second > header) nests = false;
+            }
+            if (nests) {
+                loops.push_back({ header, i });
+                builder->createBlt(i32Type, val, builder->createI32(i), blocks[header]);
+            }
+        } else if (kind < 60) {
+            int target = i + 1 + rng() % std::min(ahead, 8);
+            jumps.push_back({ i, target });
+            builder->createBgt(i32Type, val, builder->createI32(i), blocks[target]);
+        }
+    }
+
+    delete builder;
+    return func;
+}
+
+//
+// The naive solution: the registers live before each instruction, iterated until nothing changes
+//
+static bool check(Function *func, AnalysisManager &am) {
+    Liveness *liveness = am.getResult<Liveness>(func);
+    int regCount = func->getRegCount();
+
+    std::vector<Instruction *> instrs;
+    std::vector<Block *> owner;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            instrs.push_back(instr);
+            owner.push_back(block);
+        }
+    }
+
+    // Only the global registers are in the live sets. The others must never be live across blocks.
+    std::vector<int> index(regCount, -1);
+    for (int i = 0; i<liveness->getGlobalCount(); i++) index[liveness->getGlobalReg(i)] = i;
+    auto inSet = [&](const BitVector &set, int r) { return index[r] >= 0 && set.test(index[r]); };
+
+    int count = instrs.size();
+    std::vector<std::vector<bool>> before(count, std::vector<bool>(regCount, false));
+    auto liveOut = [&](int pos) {
+        if (pos + 1 < count && owner[pos + 1] == owner[pos]) return before[pos + 1];
+
+        std::vector<bool> out(regCount, false);
+        for (Block *succ : owner[pos]->getSuccessors()) {
+            int first = liveness->getBlockStart(succ);
+            for (int r = 0; r<regCount; r++) out[r] = out[r] || before[first][r];
+        }
+        return out;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int pos = count - 1; pos >= 0; pos--) {
+            std::vector<bool> live = liveOut(pos);
+            Reg *def = Liveness::getDef(instrs[pos]);
+            if (def) live[def->getID()] = false;
+            Liveness::forEachUse(instrs[pos], [&](Reg *reg) { live[reg->getID()] = true; });
+            if (live != before[pos]) {
+                before[pos] = live;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<LiveRange> ranges(regCount);
+    auto extend = [&](int reg, int pos) {
+        if (ranges[reg].empty()) ranges[reg] = { pos, pos };
+        ranges[reg].start = std::min(ranges[reg].start, pos);
+        ranges[reg].end = std::max(ranges[reg].end, pos);
+    };
+
+    for (int pos = 0; pos<count; pos++) {
+        std::vector<bool> out = liveOut(pos);
+        Reg *def = Liveness::getDef(instrs[pos]);
+        if (def) extend(def->getID(), pos);
+        for (int r = 0; r<regCount; r++) {
+            if (before[pos][r]) extend(r, pos);
+            if (out[r]) extend(r, pos);
+        }
+
+        bool first = pos == 0 || owner[pos - 1] != owner[pos];
+        bool last = pos + 1 == count || owner[pos + 1] != owner[pos];
+        for (int r = 0; r<regCount; r++) {
+            if (first && inSet(liveness->getLiveIn(owner[pos]), r) != before[pos][r]) {
+                std::cerr << "Wrong live-in set for " << owner[pos]->getName() << std::endl;
+                return false;
+            }
+            if (last && inSet(liveness->getLiveOut(owner[pos]), r) != out[r]) {
+                std::cerr << "Wrong live-out set for " << owner[pos]->getName() << std::endl;
+                return false;
+            }
+        }
+    }
+
+    for (int r = 0; r<regCount; r++) {
+        const LiveRange &range = liveness->getRange(r);
+        if (range.start != ranges[r].start || range.end != ranges[r].end) {
+            std::cerr << "Wrong live range for register " << r << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int funcCount = 20;
+    int blockCount = 2000;
+    if (argc > 1) funcCount = atoi(argv[1]);
+    if (argc > 2) blockCount = atoi(argv[2]);
+
+    Module *small = new Module("small");
+    AnalysisManager am;
+    for (unsigned seed = 1; seed<=8; seed++) {
+        Function *func = buildFunction(small, "func" + std::to_string(seed), 10 + seed * 5, seed);
+        if (!check(func, am)) return 1;
+    }
+    am.clear();
+    delete small;
+
+    Module *mod = new Module("liveness");
+    for (int i = 0; i<funcCount; i++) buildFunction(mod, "func" + std::to_string(i), blockCount, i + 1);
+
+    int instrs = 0;
+    int regs = 0;
+    int globals = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i<funcCount; i++) {
+        Function *func = mod->getFunction(i);
+        Liveness *liveness = am.getResult<Liveness>(func);
+        instrs += liveness->getInstrCount();
+        regs += liveness->getRegCount();
+        globals += liveness->getGlobalCount();
+    }
+    Clock::time_point liveDone = Clock::now();
+    am.clear();
+
+    // The transform computes the liveness again, on its own
+    for (int i = 0; i<funcCount; i++) mod->getFunction(i)->transform();
+    Clock::time_point transformDone = Clock::now();
+
+    Amd64Writer *writer = new Amd64Writer(mod);
+    writer->compile();
+    Clock::time_point compileDone = Clock::now();
+
+    std::cout << funcCount << " functions, " << blockCount << " blocks, " << instrs << " instructions, ";
+    std::cout << regs << " registers (" << globals << " global)" << std::endl;
+    std::cout << "liveness:  " << elapsed(start, liveDone) << " ms" << std::endl;
+    std::cout << "transform: " << elapsed(liveDone, transformDone) << " ms (liveness included)" << std::endl;
+    std::cout << "codegen:   " << elapsed(transformDone, compileDone) << " ms" << std::endl;
+    std::cout << "ok" << std::endl;
+
+    delete mod;
+    return 0;
+}
+
@@ -0,0 +1,496 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures the loop analysis on a synthetic function with a large number of blocks, many of
+// them in loops nested inside each other.
+//
+// Before timing, the loops of a few small functions built the same way are checked against a
+// plain solution: each back edge into a header, and every block that reaches it without going
+// through the header. The nesting, depth, latches, exits and preheader of every loop are checked
+// too, along with two written out by hand: a loop nest three deep, and a loop entered from two
+// blocks, which has no preheader. Exits with 1 on any difference, so it doubles as a test.
+//
+// Usage: bench_loops [blocks]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Every block compares the argument and branches somewhere. Most targets are a little way
+// ahead, and many go back, so loops end up inside each other. A few blocks jump over the next
+// one, which gives headers more than one way in.
+//
+static Function *buildFunction(Module *mod, int blockCount, unsigned seed) {
+    std::mt19937 rng(seed);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    IRBuilder *builder = new IRBuilder(mod);
+
+    Function *func = Function::Create(mod, "func" + std::to_string(seed), Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+
+    std::vector<Block *> blocks;
+    for (int i = 0; i<blockCount; i++) {
+        Block *block = Block::Create(func, "b" + std::to_string(i));
+        builder->addBlock(block);
+        blocks.push_back(block);
+    }
+
+    for (int i = 0; i<blockCount; i++) {
+        builder->setInsertPoint(blocks[i]);
+        Operand *arg = func->getArg(0);
+        int ahead = blockCount - i - 1;
+        int kind = rng() % 100;
+
+        if (i == blockCount - 1) {
+            builder->createRet(i32Type, builder->createI32(i));
+        } else if (kind < 25 && i > 0) {
+            Block *loop = blocks[i - 1 - rng() % std::min(i, 12)];
+            builder->createBlt(i32Type, arg, builder->createI32(i), loop);
+        } else if (kind < 30 && i > 0) {
+            Block *loop = blocks[i - 1 - rng() % std::min(i, 6)];
+            builder->createBlt(i32Type, arg, builder->createI32(i), loop);
+            builder->createBr(blocks[i + 1 + rng() % std::min(ahead, 8)]);
+        } else if (kind < 70) {
+            Block *target = blocks[i + 1 + rng() % std::min(ahead, 16)];
+            builder->createBgt(i32Type, arg, builder->createI32(i), target);
+        } else if (kind < 78) {
+            builder->createBr(blocks[i + 1 + rng() % std::min(ahead, 4)]);
+        }
+    }
+
+    delete builder;
+    return func;
+}
+
+//
+// The plain solution. Node i is the ith block in layout order, and node 0 is the entry.
+//
+typedef std::vector<std::vector<int>> Graph;
+
+struct NaiveLoop {
+    int header;
+    std::vector<bool> blocks;
+    int size = 0;
+};
+
+static std::vector<bool> findReachable(const Graph &succs) {
+    std::vector<bool> reachable(succs.size(), false);
+    std::vector<int> worklist = { 0 };
+    reachable[0] = true;
+
+    while (!worklist.empty()) {
+        int node = worklist.back();
+        worklist.pop_back();
+        for (int succ : succs[node]) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+    return reachable;
+}
+
+// Dom(b) is b plus everything that dominates all of its predecessors
+static std::vector<std::vector<bool>> solveDominators(const Graph &preds, const std::vector<bool> &reachable) {
+    int count = preds.size();
+    std::vector<std::vector<bool>> dom(count, std::vector<bool>(count, true));
+    dom[0].assign(count, false);
+    dom[0][0] = true;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int node = 1; node<count; node++) {
+            if (!reachable[node]) continue;
+
+            std::vector<bool> next(count, true);
+            for (int pred : preds[node]) {
+                if (!reachable[pred]) continue;
+                for (int i = 0; i<count; i++) next[i] = next[i] && dom[pred][i];
+            }
+            next[node] = true;
+
+            if (next != dom[node]) {
+                dom[node] = next;
+                changed = true;
+            }
+        }
+    }
+    return dom;
+}
+
+// The loop of a header is the header, and every reachable block that gets to one of its back
+// edges without going through the header
+static std::vector<NaiveLoop> solveLoops(const Graph &succs, const Graph &preds) {
+    int count = succs.size();
+    std::vector<bool> reachable = findReachable(succs);
+    std::vector<std::vector<bool>> dom = solveDominators(preds, reachable);
+
+    std::vector<NaiveLoop> loops;
+    for (int header = 0; header<count; header++) {
+        if (!reachable[header]) continue;
+
+        NaiveLoop loop;
+        loop.header = header;
+        loop.blocks.assign(count, false);
+        loop.blocks[header] = true;
+
+        // A block that loops to itself is its own back edge
+        bool backEdge = false;
+        std::vector<int> worklist;
+        for (int pred : preds[header]) {
+            if (!reachable[pred] || !dom[pred][header]) continue;
+            backEdge = true;
+            if (loop.blocks[pred]) continue;
+            loop.blocks[pred] = true;
+            worklist.push_back(pred);
+        }
+        if (!backEdge) continue;
+
+        while (!worklist.empty()) {
+            int node = worklist.back();
+            worklist.pop_back();
+            for (int pred : preds[node]) {
+                if (!reachable[pred] || loop.blocks[pred]) continue;
+                loop.blocks[pred] = true;
+                worklist.push_back(pred);
+            }
+        }
+
+        for (bool in : loop.blocks) loop.size += in;
+        loops.push_back(loop);
+    }
+    return loops;
+}
+
+static std::vector<Block *> sorted(std::vector<Block *> blocks) {
+    std::sort(blocks.begin(), blocks.end());
+    return blocks;
+}
+
+// Every loop found must be one of the plain solution, and the other way around. Natural loops
+// with different headers are either nested or apart, so the parent of a loop is the smallest
+// one around it.
+static bool check(Function *func, AnalysisManager &am) {
+    std::vector<Block *> nodes;
+    for (Block *block : *func) nodes.push_back(block);
+    int count = nodes.size();
+
+    auto indexOf = [&](Block *block) {
+        return (int)(std::find(nodes.begin(), nodes.end(), block) - nodes.begin());
+    };
+
+    Graph succs(count), preds(count);
+    for (int i = 0; i<count; i++) {
+        for (Block *succ : nodes[i]->getSuccessors()) {
+            succs[i].push_back(indexOf(succ));
+            preds[indexOf(succ)].push_back(i);
+        }
+    }
+
+    std::vector<NaiveLoop> expected = solveLoops(succs, preds);
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(func);
+
+    std::vector<Loop *> found = loopInfo->getLoopsInnermostFirst();
+    if (found.size() != expected.size()) {
+        std::cerr << func->getName() << ": " << found.size() << " loops instead of " << expected.size() << std::endl;
+        return false;
+    }
+
+    // The loop of each header, and the naive loop of each found one
+    std::vector<int> naiveOf(count, -1);
+    for (size_t l = 0; l<expected.size(); l++) naiveOf[expected[l].header] = l;
+
+    auto parentOf = [&](const NaiveLoop &loop) {
+        int parent = -1;
+        for (size_t l = 0; l<expected.size(); l++) {
+            const NaiveLoop &other = expected[l];
+            if (other.header == loop.header || !other.blocks[loop.header]) continue;
+            if (parent < 0 || other.size < expected[parent].size) parent = l;
+        }
+        return parent;
+    };
+
+    for (int b = 0; b<count; b++) {
+        int innermost = -1;
+        int depth = 0;
+        for (size_t l = 0; l<expected.size(); l++) {
+            if (!expected[l].blocks[b]) continue;
+            ++depth;
+            if (innermost < 0 || expected[l].size < expected[innermost].size) innermost = l;
+        }
+
+        Loop *loop = loopInfo->getLoopFor(nodes[b]);
+        Block *header = loop ? loop->getHeader() : nullptr;
+        Block *expectedHeader = innermost >= 0 ? nodes[expected[innermost].header] : nullptr;
+        if (header != expectedHeader || loopInfo->getLoopDepth(nodes[b]) != depth) {
+            std::cerr << func->getName() << ": " << nodes[b]->getName() << " is in the wrong loop" << std::endl;
+            return false;
+        }
+        if (loopInfo->isLoopHeader(nodes[b]) != (naiveOf[b] >= 0)) {
+            std::cerr << func->getName() << ": " << nodes[b]->getName() << " is wrongly a header or not" << std::endl;
+            return false;
+        }
+    }
+
+    for (size_t pos = 0; pos<found.size(); pos++) {
+        Loop *loop = found[pos];
+        Symbol name = loop->getHeader()->getName();
+        int l = naiveOf[indexOf(loop->getHeader())];
+        if (l < 0) {
+            std::cerr << func->getName() << ": " << name << " is not a header" << std::endl;
+            return false;
+        }
+        const NaiveLoop &naive = expected[l];
+
+        std::vector<Block *> blocks, latches, exiting, exits, outside;
+        for (int b = 0; b<count; b++) {
+            if (!naive.blocks[b]) {
+                if (std::find(succs[b].begin(), succs[b].end(), naive.header) != succs[b].end()) outside.push_back(nodes[b]);
+                continue;
+            }
+            blocks.push_back(nodes[b]);
+            if (std::find(succs[b].begin(), succs[b].end(), naive.header) != succs[b].end()) latches.push_back(nodes[b]);
+
+            bool isExiting = false;
+            for (int succ : succs[b]) {
+                if (naive.blocks[succ]) continue;
+                isExiting = true;
+                if (std::find(exits.begin(), exits.end(), nodes[succ]) == exits.end()) exits.push_back(nodes[succ]);
+            }
+            if (isExiting) exiting.push_back(nodes[b]);
+        }
+
+        Block *preheader = nullptr;
+        if (outside.size() == 1 && outside[0]->getSuccessors().size() == 1) preheader = outside[0];
+
+        int parent = parentOf(naive);
+        Block *parentHeader = parent >= 0 ? nodes[expected[parent].header] : nullptr;
+        Block *foundParent = loop->getParent() ? loop->getParent()->getHeader() : nullptr;
+        int depth = 1;
+        for (int p = parent; p >= 0; p = parentOf(expected[p])) ++depth;
+
+        const char *wrong = nullptr;
+        if (loop->getBlocks().empty() || loop->getBlocks()[0] != loop->getHeader()) wrong = "block order";
+        else if (sorted(loop->getBlocks()) != sorted(blocks)) wrong = "blocks";
+        else if (foundParent != parentHeader) wrong = "parent";
+        else if (loop->getDepth() != depth) wrong = "depth";
+        else if (sorted(loop->getLatches()) != sorted(latches)) wrong = "latches";
+        else if (sorted(loop->getExitingBlocks()) != sorted(exiting)) wrong = "exiting blocks";
+        else if (sorted(loop->getExitBlocks()) != sorted(exits)) wrong = "exit blocks";
+        else if (loop->getPreheader() != preheader) wrong = "preheader";
+
+        // Every loop comes after the loops nested in it, and is a sub-loop of its parent
+        for (Loop *sub : loop->getSubLoops()) {
+            if (sub->getParent() != loop) wrong = "sub-loops";
+            if (std::find(found.begin(), found.begin() + pos, sub) == found.begin() + pos) wrong = "order";
+        }
+        if (loop->getParent()) {
+            const std::vector<Loop *> &siblings = loop->getParent()->getSubLoops();
+            if (std::find(siblings.begin(), siblings.end(), loop) == siblings.end()) wrong = "sub-loops";
+        } else {
+            const std::vector<Loop *> &top = loopInfo->getTopLevelLoops();
+            if (std::find(top.begin(), top.end(), loop) == top.end()) wrong = "top-level loops";
+        }
+
+        if (wrong) {
+            std::cerr << func->getName() << ": wrong " << wrong << " for the loop at " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// The loops written out by hand
+//
+struct Builder {
+    Module *mod;
+    Function *func;
+    IRBuilder *builder;
+    Type *i32Type;
+
+    Builder(Module *mod, std::string name) {
+        this->mod = mod;
+        i32Type = mod->getTypeContext()->getI32Type();
+        builder = new IRBuilder(mod);
+        func = Function::Create(mod, name, Linkage::Global, i32Type);
+        func->setArgs({ i32Type });
+        mod->addFunction(func);
+        builder->setCurrentFunction(func);
+    }
+
+    ~Builder() { delete builder; }
+
+    Block *block(std::string name) {
+        Block *block = Block::Create(func, name);
+        builder->addBlock(block);
+        return block;
+    }
+
+    // Branches to the target if the argument is greater than the value, or else falls through
+    void branch(Block *from, int value, Block *target) {
+        builder->setInsertPoint(from);
+        builder->createBgt(i32Type, func->getArg(0), builder->createI32(value), target);
+    }
+
+    void jump(Block *from, Block *target) {
+        builder->setInsertPoint(from);
+        builder->createBr(target);
+    }
+
+    void ret(Block *from) {
+        builder->setInsertPoint(from);
+        builder->createRet(i32Type, builder->createI32(0));
+    }
+};
+
+static bool expectLoop(Function *func, LoopInfo *loopInfo, Block *header, int depth, Block *parent, Block *preheader,
+                       std::vector<Block *> latches, std::vector<Block *> exits) {
+    Loop *loop = loopInfo->getLoopFor(header);
+    const char *wrong = nullptr;
+    if (loop == nullptr || loop->getHeader() != header) wrong = "header";
+    else if (loop->getDepth() != depth) wrong = "depth";
+    else if ((loop->getParent() ? loop->getParent()->getHeader() : nullptr) != parent) wrong = "parent";
+    else if (loop->getPreheader() != preheader) wrong = "preheader";
+    else if (sorted(loop->getLatches()) != sorted(latches)) wrong = "latches";
+    else if (sorted(loop->getExitBlocks()) != sorted(exits)) wrong = "exit blocks";
+
+    if (wrong == nullptr) return true;
+    std::cerr << func->getName() << ": wrong " << wrong << " for the loop at " << header->getName() << std::endl;
+    return false;
+}
+
+// Three loops, one in the other. The outer two have a preheader. The inner one is entered from
+// a block that may also skip it, so it has none.
+static bool checkNest(Module *mod, AnalysisManager &am) {
+    Builder b(mod, "nest");
+    Block *entry = b.block("entry");
+    Block *outer = b.block("outer");
+    Block *middlePre = b.block("middle_pre");
+    Block *middle = b.block("middle");
+    Block *inner = b.block("inner");
+    Block *innerBody = b.block("inner_body");
+    Block *middleLatch = b.block("middle_latch");
+    Block *outerLatch = b.block("outer_latch");
+    Block *exit = b.block("exit");
+
+    b.jump(entry, outer);
+    b.branch(outer, 1, exit);
+    b.branch(middle, 2, outerLatch);
+    b.branch(inner, 3, middleLatch);
+    b.jump(innerBody, inner);
+    b.jump(middleLatch, middle);
+    b.jump(outerLatch, outer);
+    b.ret(exit);
+
+    if (!check(b.func, am)) return false;
+
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(b.func);
+    if (loopInfo->getTopLevelLoops().size() != 1 || loopInfo->getLoopDepth(innerBody) != 3) {
+        std::cerr << "nest: the loops are not nested three deep" << std::endl;
+        return false;
+    }
+    if (loopInfo->getLoopFor(middlePre) != loopInfo->getLoopFor(outer) || loopInfo->getLoopFor(exit)) {
+        std::cerr << "nest: the blocks between the loops are in the wrong one" << std::endl;
+        return false;
+    }
+
+    if (!expectLoop(b.func, loopInfo, outer, 1, nullptr, entry, { outerLatch }, { exit })) return false;
+    if (!expectLoop(b.func, loopInfo, middle, 2, outer, middlePre, { middleLatch }, { outerLatch })) return false;
+    return expectLoop(b.func, loopInfo, inner, 3, middle, nullptr, { innerBody }, { middleLatch });
+}
+
+// The header can be reached from the entry or from the block after it
+static bool checkTwoEntries(Module *mod, AnalysisManager &am) {
+    Builder b(mod, "two_entries");
+    Block *entry = b.block("entry");
+    Block *side = b.block("side");
+    Block *header = b.block("header");
+    Block *body = b.block("body");
+    Block *exit = b.block("exit");
+
+    b.branch(entry, 5, header);
+    b.branch(header, 10, exit);
+    b.jump(body, header);
+    b.ret(exit);
+
+    if (!check(b.func, am)) return false;
+
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(b.func);
+    if (loopInfo->getLoopFor(side) || loopInfo->getLoopFor(entry)) {
+        std::cerr << "two_entries: a block before the loop is in it" << std::endl;
+        return false;
+    }
+    return expectLoop(b.func, loopInfo, header, 1, nullptr, nullptr, { body }, { exit });
+}
+
+int main(int argc, char **argv) {
+    int blockCount = 100000;
+    if (argc > 1) blockCount = atoi(argv[1]);
+
+    Module *mod = new Module("loops");
+    AnalysisManager am;
+
+    if (!checkNest(mod, am)) return 1;
+    if (!checkTwoEntries(mod, am)) return 1;
+    for (unsigned seed = 1; seed<=16; seed++) {
+        Function *small = buildFunction(mod, 20 + seed * 10, seed);
+        if (!check(small, am)) return 1;
+    }
+
+    Function *func = buildFunction(mod, blockCount, 100);
+
+    Clock::time_point start = Clock::now();
+    am.getResult<DominatorTree>(func);
+    Clock::time_point domDone = Clock::now();
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(func);
+    Clock::time_point loopsDone = Clock::now();
+
+    size_t latches = 0;
+    size_t exits = 0;
+    int preheaders = 0;
+    for (Loop *loop : loopInfo->getLoopsInnermostFirst()) {
+        latches += loop->getLatches().size();
+        exits += loop->getExitBlocks().size();
+        if (loop->getPreheader()) ++preheaders;
+    }
+    Clock::time_point queryDone = Clock::now();
+
+    int maxDepth = 0;
+    for (Block *block : *func) maxDepth = std::max(maxDepth, loopInfo->getLoopDepth(block));
+
+    std::cout << blockCount << " blocks, " << loopInfo->getLoopsInnermostFirst().size() << " loops, ";
+    std::cout << "nested up to " << maxDepth << " deep" << std::endl;
+    std::cout << "dominator tree:      " << elapsed(start, domDone) << " ms" << std::endl;
+    std::cout << "loops:               " << elapsed(domDone, loopsDone) << " ms" << std::endl;
+    std::cout << "latches and exits:   " << elapsed(loopsDone, queryDone) << " ms";
+    std::cout << " (" << latches << " latches, " << exits << " exits, " << preheaders << " preheaders)" << std::endl;
+    std::cout << "ok" << std::endl;
+
+    am.clear();
+    delete mod;
+    return 0;
+}
+
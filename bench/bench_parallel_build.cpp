@@ -0,0 +1,234 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Stress test for building one module from many threads. Every thread gets its own builder and
+// builds its share of the functions. Afterwards the module is checked against one built on a
+// single thread, and then run through the transform layer and the code generator.
+//
+// The parallel transform is checked as well. Two modules are built the same way, one is transformed
+// on a single thread and the other in parallel, and the results must print the same.
+//
+// Exits with 1 if anything is missing or inconsistent, so it doubles as a test.
+//
+// Usage: bench_parallel_build [functions] [threads]
+//
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <unordered_set>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <parallel.hpp>
+#include <amd64/amd64.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Each function prints a string constant, does a bit of math on a stack variable,
+// and branches to one of two exits.
+//
+static void buildFunction(Module *mod, IRBuilder *builder, int index) {
+    TypeContext *types = mod->getTypeContext();
+    Type *i32Type = types->getI32Type();
+    
+    Function *func = Function::Create(mod, "func" + std::to_string(index), Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    builder->setCurrentFunction(func);
+    
+    Block *entry = builder->createBlock("entry");
+    Block *big = Block::Create(func, "big");
+    Block *small = Block::Create(func, "small");
+    builder->addBlockAfter(entry, big);
+    builder->addBlockAfter(big, small);
+    builder->setInsertPoint(entry);
+    
+    Operand *str = builder->createString("function " + std::to_string(index));
+    builder->createVoidCall("puts", { str });
+    
+    Reg *var = builder->createAlloca(i32Type);
+    builder->createStore(i32Type, func->getArg(0), var);
+    for (int i = 0; i<8; i++) {
+        Operand *val = builder->createLoad(i32Type, var);
+        val = builder->createAdd(i32Type, val, builder->createI32(index + i));
+        builder->createStore(i32Type, val, var);
+    }
+    
+    Operand *result = builder->createLoad(i32Type, var);
+    builder->createBgt(i32Type, result, builder->createI32(100), big);
+    builder->createBr(small);
+    
+    builder->setInsertPoint(big);
+    builder->createRet(i32Type, builder->createI32(1));
+    
+    builder->setInsertPoint(small);
+    builder->createRet(i32Type, builder->createI32(0));
+    
+    mod->addFunction(func);
+}
+
+static void buildRange(Module *mod, int start, int end) {
+    IRBuilder *builder = new IRBuilder(mod);
+    for (int i = start; i<end; i++) buildFunction(mod, builder, i);
+    delete builder;
+}
+
+static void addExterns(Module *mod) {
+    TypeContext *types = mod->getTypeContext();
+    Function *puts = Function::Create(mod, "puts", Linkage::Extern, types->getVoidType());
+    puts->setArgs({ types->getPointerType(types->getI8Type()) });
+    mod->addFunction(puts);
+}
+
+static int countInstrs(Function *func) {
+    int count = 0;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            (void)instr;
+            ++count;
+        }
+    }
+    return count;
+}
+
+//
+// Every function must be present once and look exactly like its serial twin, and
+// every string constant must have a name of its own
+//
+static bool check(Module *mod, Module *expected, int funcCount) {
+    if (mod->getFunctionCount() != expected->getFunctionCount()) {
+        std::cerr << "Expected " << expected->getFunctionCount() << " functions, got ";
+        std::cerr << mod->getFunctionCount() << std::endl;
+        return false;
+    }
+    
+    for (int i = 0; i<funcCount; i++) {
+        std::string name = "func" + std::to_string(i);
+        Function *func = mod->getFunctionByName(name);
+        Function *twin = expected->getFunctionByName(name);
+        if (func == nullptr) {
+            std::cerr << "Missing function " << name << std::endl;
+            return false;
+        }
+        
+        if (func->getBlockCount() != twin->getBlockCount() || func->getRegCount() != twin->getRegCount()
+                || countInstrs(func) != countInstrs(twin)) {
+            std::cerr << "Function " << name << " does not match the serial build" << std::endl;
+            return false;
+        }
+    }
+    
+    if (mod->getStringCount() != funcCount) {
+        std::cerr << "Expected " << funcCount << " strings, got " << mod->getStringCount() << std::endl;
+        return false;
+    }
+    
+    std::unordered_set<Symbol> names;
+    for (int i = 0; i<mod->getStringCount(); i++) {
+        StringPtr *str = mod->getString(i);
+        if (!names.insert(str->getName()).second || mod->getStringByName(str->getName()) != str) {
+            std::cerr << "String constant " << str->getName() << " is not unique" << std::endl;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static std::string printFunction(Function *func) {
+    std::stringstream out;
+    std::streambuf *old = std::cout.rdbuf(out.rdbuf());
+    func->print();
+    std::cout.rdbuf(old);
+    return out.str();
+}
+
+static bool checkTransform(Module *mod, Module *expected, int funcCount) {
+    for (int i = 0; i<funcCount; i++) {
+        std::string name = "func" + std::to_string(i);
+        if (printFunction(mod->getFunctionByName(name)) != printFunction(expected->getFunctionByName(name))) {
+            std::cerr << "Function " << name << " was transformed differently in parallel" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int funcCount = 10000;
+    int threadCount = std::thread::hardware_concurrency();
+    if (argc > 1) funcCount = atoi(argv[1]);
+    if (argc > 2) threadCount = atoi(argv[2]);
+    if (threadCount < 2) threadCount = 2;
+    
+    Module *expected = new Module("serial");
+    addExterns(expected);
+    Clock::time_point serialStart = Clock::now();
+    buildRange(expected, 0, funcCount);
+    Clock::time_point serialEnd = Clock::now();
+    
+    // Interleave the ranges in small chunks, so the threads keep running into each other
+    Module *mod = new Module("parallel");
+    addExterns(mod);
+    Clock::time_point parallelStart = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t<threadCount; t++) {
+        threads.emplace_back([mod, t, threadCount, funcCount]() {
+            for (int i = t * 16; i<funcCount; i += threadCount * 16) {
+                buildRange(mod, i, std::min(i + 16, funcCount));
+            }
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+    Clock::time_point parallelEnd = Clock::now();
+    
+    std::cout << funcCount << " functions" << std::endl;
+    std::cout << "serial build:   " << elapsed(serialStart, serialEnd) << " ms" << std::endl;
+    std::cout << "parallel build: " << elapsed(parallelStart, parallelEnd) << " ms (" << threadCount << " threads)" << std::endl;
+    
+    bool ok = check(mod, expected, funcCount);
+    
+    // String names depend on the order of the build, so the twin is built serially too
+    Module *twin = new Module("twin");
+    addExterns(twin);
+    buildRange(twin, 0, funcCount);
+    
+    setThreadCount(1);
+    Clock::time_point transformStart = Clock::now();
+    expected->transform();
+    Clock::time_point serialTransformed = Clock::now();
+    
+    setThreadCount(threadCount);
+    twin->transform();
+    Clock::time_point parallelTransformed = Clock::now();
+    
+    std::cout << "serial transform:   " << elapsed(transformStart, serialTransformed) << " ms" << std::endl;
+    std::cout << "parallel transform: " << elapsed(serialTransformed, parallelTransformed) << " ms" << std::endl;
+    if (ok) ok = checkTransform(twin, expected, funcCount);
+    
+    // The X86 IR shares operands between instructions, so the writer can't safely be freed
+    if (ok) {
+        mod->transform();
+        Amd64Writer *writer = new Amd64Writer(mod);
+        writer->compile();
+        std::cout << "ok" << std::endl;
+    }
+    
+    delete expected;
+    delete twin;
+    delete mod;
+    
+    if (!ok) return 1;
+    return 0;
+}
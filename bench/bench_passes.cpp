@@ -0,0 +1,355 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures the analysis cache of the pass manager: lookups of a cached analysis, and rounds of
+// invalidating the dominator tree and computing the loops again, over many small functions.
+//
+// Before timing, the caching and invalidation rules are checked with a chain of dummy analyses,
+// each computed from the one before: a cached result is never computed twice, an analysis goes
+// when it isn't preserved, and so does everything computed from it, directly or not. The same is
+// then checked through a pass manager, with function and module passes. Exits with 1 on any
+// difference, so it doubles as a test.
+//
+// Usage: bench_passes [functions]
+//
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <pass.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// The dummy analyses. Top is computed from Middle, which is computed from Base. Other stands
+// alone. Each counts how many times it was computed.
+//
+struct Base : public FunctionAnalysis {
+    static char ID;
+    static std::atomic<int> built;
+    Base(Function *func, AnalysisManager &am) { ++built; }
+};
+
+struct Middle : public FunctionAnalysis {
+    static char ID;
+    static std::atomic<int> built;
+    Middle(Function *func, AnalysisManager &am) {
+        am.getResult<Base>(func);
+        ++built;
+    }
+};
+
+struct Top : public FunctionAnalysis {
+    static char ID;
+    static std::atomic<int> built;
+    Top(Function *func, AnalysisManager &am) {
+        am.getResult<Middle>(func);
+        ++built;
+    }
+};
+
+struct Other : public FunctionAnalysis {
+    static char ID;
+    static std::atomic<int> built;
+    Other(Function *func, AnalysisManager &am) { ++built; }
+};
+
+char Base::ID = 0;
+char Middle::ID = 0;
+char Top::ID = 0;
+char Other::ID = 0;
+std::atomic<int> Base::built{0};
+std::atomic<int> Middle::built{0};
+std::atomic<int> Top::built{0};
+std::atomic<int> Other::built{0};
+
+// One bit per analysis, for what should be cached
+enum {
+    HasBase = 1,
+    HasMiddle = 2,
+    HasTop = 4,
+    HasOther = 8,
+    HasAll = 15
+};
+
+static int getCached(Function *func, AnalysisManager &am) {
+    int cached = 0;
+    if (am.getCachedResult<Base>(func)) cached |= HasBase;
+    if (am.getCachedResult<Middle>(func)) cached |= HasMiddle;
+    if (am.getCachedResult<Top>(func)) cached |= HasTop;
+    if (am.getCachedResult<Other>(func)) cached |= HasOther;
+    return cached;
+}
+
+static bool expect(Function *func, AnalysisManager &am, int cached, const char *what) {
+    if (getCached(func, am) == cached) return true;
+    std::cerr << what << ": " << func->getName() << " has " << getCached(func, am);
+    std::cerr << " cached instead of " << cached << std::endl;
+    return false;
+}
+
+static bool expectBuilt(int base, int middle, int top, const char *what) {
+    if (Base::built == base && Middle::built == middle && Top::built == top) return true;
+    std::cerr << what << ": computed " << Base::built << ", " << Middle::built << ", " << Top::built;
+    std::cerr << " times instead of " << base << ", " << middle << ", " << top << std::endl;
+    return false;
+}
+
+//
+// A loop counting up to the argument, with a branch inside, so the dominator tree and the loops
+// both have something to find
+//
+static Function *buildFunction(Module *mod, int index) {
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    IRBuilder *builder = new IRBuilder(mod);
+
+    Function *func = Function::Create(mod, "func" + std::to_string(index), Linkage::Global, i32Type);
+    func->setArgs({ i32Type });
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+
+    Block *entry = Block::Create(func, "entry");
+    Block *header = Block::Create(func, "header");
+    Block *body = Block::Create(func, "body");
+    Block *odd = Block::Create(func, "odd");
+    Block *latch = Block::Create(func, "latch");
+    Block *exit = Block::Create(func, "exit");
+    for (Block *block : { entry, header, body, odd, latch, exit }) builder->addBlock(block);
+
+    Operand *arg = func->getArg(0);
+    builder->setInsertPoint(entry);
+    builder->createBr(header);
+
+    builder->setInsertPoint(header);
+    builder->createBge(i32Type, arg, builder->createI32(index), exit);
+
+    builder->setInsertPoint(body);
+    builder->createBgt(i32Type, arg, builder->createI32(1), latch);
+
+    builder->setInsertPoint(odd);
+    builder->createBr(latch);
+
+    builder->setInsertPoint(latch);
+    builder->createBr(header);
+
+    builder->setInsertPoint(exit);
+    builder->createRet(i32Type, builder->createI32(0));
+
+    delete builder;
+    return func;
+}
+
+static bool checkAnalysisManager(Function *func, Function *second) {
+    Base::built = Middle::built = Top::built = Other::built = 0;
+    AnalysisManager am;
+
+    am.getResult<Top>(func);
+    am.getResult<Top>(func);
+    am.getResult<Other>(func);
+    am.getResult<Other>(second);
+    if (!expectBuilt(1, 1, 1, "first lookup")) return false;
+    if (!expect(func, am, HasAll, "first lookup")) return false;
+
+    am.invalidate(func, PreservedAnalyses::all());
+    if (!expect(func, am, HasAll, "all preserved")) return false;
+
+    // Everything above Base goes with it
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<Middle>().preserve<Top>().preserve<Other>();
+    am.invalidate(func, preserved);
+    if (!expect(func, am, HasOther, "base invalidated")) return false;
+    if (!expect(second, am, HasOther, "other function")) return false;
+
+    am.getResult<Top>(func);
+    if (!expectBuilt(2, 2, 2, "after base invalidated")) return false;
+
+    // Only what is above Middle goes with it
+    preserved = PreservedAnalyses::none();
+    preserved.preserve<Base>().preserve<Top>().preserve<Other>();
+    am.invalidate(func, preserved);
+    if (!expect(func, am, HasBase | HasOther, "middle invalidated")) return false;
+
+    // Middle is computed from a cached Base this time, but it still depends on it
+    am.getResult<Top>(func);
+    if (!expectBuilt(2, 3, 3, "after middle invalidated")) return false;
+
+    preserved = PreservedAnalyses::none();
+    preserved.preserve<Middle>().preserve<Top>();
+    am.invalidate(func, preserved);
+    if (!expect(func, am, 0, "base invalidated again")) return false;
+
+    // An analysis used directly by a pass has no dependents
+    am.getResult<Base>(func);
+    am.getResult<Other>(func);
+    preserved = PreservedAnalyses::none();
+    preserved.preserve<Base>();
+    am.invalidate(func, preserved);
+    if (!expect(func, am, HasBase, "other invalidated")) return false;
+
+    am.clear(func);
+    if (!expect(func, am, 0, "cleared")) return false;
+    return expect(second, am, HasOther, "other function cleared");
+}
+
+//
+// Through a pass manager. Each pass asks for some analyses and returns a fixed set, and a pass
+// between them records what is still cached.
+//
+class UsePass : public FunctionPass {
+public:
+    explicit UsePass(PreservedAnalyses preserved) : preserved(preserved) {}
+
+    std::string getName() { return "use"; }
+
+    PreservedAnalyses run(Function *func, AnalysisManager &am) {
+        am.getResult<Top>(func);
+        am.getResult<Other>(func);
+        return preserved;
+    }
+private:
+    PreservedAnalyses preserved;
+};
+
+class ExpectPass : public FunctionPass {
+public:
+    explicit ExpectPass(int cached, std::atomic<bool> &ok) : cached(cached), ok(ok) {}
+
+    std::string getName() { return "expect"; }
+
+    PreservedAnalyses run(Function *func, AnalysisManager &am) {
+        if (!expect(func, am, cached, "pass manager")) ok = false;
+        return PreservedAnalyses::all();
+    }
+private:
+    int cached;
+    std::atomic<bool> &ok;
+};
+
+class ModuleChangePass : public ModulePass {
+public:
+    explicit ModuleChangePass(bool changed) : changed(changed) {}
+
+    std::string getName() { return "module"; }
+
+    PreservedAnalyses run(Module *mod, AnalysisManager &am) {
+        return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    }
+private:
+    bool changed;
+};
+
+static bool checkPassManager(Module *mod) {
+    std::atomic<bool> ok(true);
+    PassManager pm;
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<Base>().preserve<Other>();
+    pm.addPass(new UsePass(preserved));
+    pm.addPass(new ExpectPass(HasBase | HasOther, ok));
+
+    pm.addPass(new UsePass(PreservedAnalyses::all()));
+    pm.addPass(new ExpectPass(HasAll, ok));
+
+    // A module pass that changes nothing keeps every function's analyses
+    pm.addPass(new ModuleChangePass(false));
+    pm.addPass(new ExpectPass(HasAll, ok));
+
+    pm.addPass(new ModuleChangePass(true));
+    pm.addPass(new ExpectPass(0, ok));
+
+    pm.addPass(new UsePass(PreservedAnalyses::none()));
+    pm.addPass(new ExpectPass(0, ok));
+
+    pm.run(mod);
+    return ok;
+}
+
+// The loops are computed from the dominator tree, so they go when it does
+static bool checkRealAnalyses(Function *func) {
+    AnalysisManager am;
+    am.getResult<LoopInfo>(func);
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<LoopInfo>().preserve<PostDominatorTree>();
+    am.invalidate(func, preserved);
+    if (am.getCachedResult<DominatorTree>(func) || am.getCachedResult<LoopInfo>(func)) {
+        std::cerr << "loops: still cached after the dominator tree was invalidated" << std::endl;
+        return false;
+    }
+
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(func);
+    if (loopInfo->getLoopsInnermostFirst().size() != 1) {
+        std::cerr << "loops: " << loopInfo->getLoopsInnermostFirst().size() << " found instead of 1" << std::endl;
+        return false;
+    }
+
+    preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    am.invalidate(func, preserved);
+    if (am.getCachedResult<DominatorTree>(func) == nullptr || am.getCachedResult<LoopInfo>(func)) {
+        std::cerr << "loops: the dominator tree went with the loops" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int functionCount = 10000;
+    if (argc > 1) functionCount = atoi(argv[1]);
+
+    Module *mod = new Module("passes");
+    std::vector<Function *> funcs;
+    for (int i = 0; i<std::max(functionCount, 2); i++) funcs.push_back(buildFunction(mod, i));
+
+    if (!checkAnalysisManager(funcs[0], funcs[1])) return 1;
+    if (!checkPassManager(mod)) return 1;
+    if (!checkRealAnalyses(funcs[0])) return 1;
+
+    AnalysisManager am;
+    Clock::time_point start = Clock::now();
+    for (Function *func : funcs) am.getResult<LoopInfo>(func);
+    Clock::time_point firstDone = Clock::now();
+
+    int lookups = 0;
+    for (int round = 0; round<100; round++) {
+        for (Function *func : funcs) {
+            if (am.getResult<LoopInfo>(func)) ++lookups;
+        }
+    }
+    Clock::time_point lookupDone = Clock::now();
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<LoopInfo>();
+    for (int round = 0; round<10; round++) {
+        for (Function *func : funcs) {
+            am.invalidate(func, preserved);
+            am.getResult<LoopInfo>(func);
+        }
+    }
+    Clock::time_point invalidateDone = Clock::now();
+
+    std::cout << funcs.size() << " functions" << std::endl;
+    std::cout << "first computation:      " << elapsed(start, firstDone) << " ms" << std::endl;
+    std::cout << lookups << " cached lookups: " << elapsed(firstDone, lookupDone) << " ms" << std::endl;
+    std::cout << "10 x invalidate:        " << elapsed(lookupDone, invalidateDone) << " ms" << std::endl;
+    std::cout << "ok" << std::endl;
+
+    am.clear();
+    delete mod;
+    return 0;
+}
+
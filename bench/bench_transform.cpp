@@ -0,0 +1,92 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Measures how the transform layer and the code generator scale with the size of a function.
+// The per-instruction cost should stay flat as the function grows.
+//
+// Usage: bench_transform [max instructions]
+//
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+#include <llir.hpp>
+#include <irbuilder.hpp>
+#include <amd64/amd64.hpp>
+using namespace LLIR;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//
+// Builds one function with roughly the given number of instructions. Every group of
+// instructions declares a new local, so the number of stack slots grows with the function.
+//
+static void buildFunction(Module *mod, int instrCount) {
+    IRBuilder *builder = new IRBuilder(mod);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    
+    Function *func = Function::Create(mod, "main", Linkage::Global, i32Type);
+    mod->addFunction(func);
+    builder->setCurrentFunction(func);
+    builder->createBlock("entry");
+    
+    Reg *last = builder->createAlloca(i32Type);
+    builder->createStore(i32Type, builder->createI32(1), last);
+    
+    for (int i = 0; i<instrCount; i += 8) {
+        Reg *var = builder->createAlloca(i32Type);
+        Operand *val1 = builder->createLoad(i32Type, last);
+        Operand *val2 = builder->createAdd(i32Type, val1, builder->createI32(i));
+        builder->createStore(i32Type, val2, var);
+        Operand *val3 = builder->createLoad(i32Type, var);
+        Operand *val4 = builder->createLoad(i32Type, last);
+        Operand *val5 = builder->createSub(i32Type, val3, val4);
+        builder->createStore(i32Type, val5, var);
+        last = var;
+    }
+    
+    builder->createRet(i32Type, builder->createLoad(i32Type, last));
+    delete builder;
+}
+
+int main(int argc, char **argv) {
+    int maxCount = 1000000;
+    if (argc > 1) maxCount = atoi(argv[1]);
+    
+    std::cout << std::setw(10) << "instrs" << std::setw(14) << "build ms" << std::setw(14) << "transform ms";
+    std::cout << std::setw(14) << "codegen ms" << std::setw(14) << "ns/instr" << std::endl;
+    
+    for (int count = 1000; count <= maxCount; count *= 10) {
+        Module *mod = new Module("bench");
+        
+        Clock::time_point start = Clock::now();
+        buildFunction(mod, count);
+        Clock::time_point built = Clock::now();
+        mod->transform();
+        Clock::time_point transformed = Clock::now();
+        
+        Amd64Writer *writer = new Amd64Writer(mod);
+        writer->compile();
+        Clock::time_point compiled = Clock::now();
+        
+        double transformTime = elapsed(built, transformed);
+        
+        std::cout << std::setw(10) << count;
+        std::cout << std::setw(14) << elapsed(start, built);
+        std::cout << std::setw(14) << transformTime;
+        std::cout << std::setw(14) << elapsed(transformed, compiled);
+        std::cout << std::setw(14) << (transformTime * 1000000.0 / count) << std::endl;
+        
+        // The X86 IR shares operands between instructions, so the writer can't safely be freed
+        delete mod;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_alloc.dir/bench_alloc.cpp.o"
+  "CMakeFiles/bench_alloc.dir/bench_alloc.cpp.o.d"
+  "bench_alloc"
+  "bench_alloc.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_alloc.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_compact.dir/bench_compact.cpp.o"
+  "CMakeFiles/bench_compact.dir/bench_compact.cpp.o.d"
+  "bench_compact"
+  "bench_compact.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_compact.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
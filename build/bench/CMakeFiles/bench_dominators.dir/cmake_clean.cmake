@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_dominators.dir/bench_dominators.cpp.o"
+  "CMakeFiles/bench_dominators.dir/bench_dominators.cpp.o.d"
+  "bench_dominators"
+  "bench_dominators.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_dominators.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
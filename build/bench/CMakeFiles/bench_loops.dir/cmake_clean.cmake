@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_loops.dir/bench_loops.cpp.o"
+  "CMakeFiles/bench_loops.dir/bench_loops.cpp.o.d"
+  "bench_loops"
+  "bench_loops.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_loops.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_transform.dir/bench_transform.cpp.o"
+  "CMakeFiles/bench_transform.dir/bench_transform.cpp.o.d"
+  "bench_transform"
+  "bench_transform.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bench_transform.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,22 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/compiler/Lex.cpp" "compiler/CMakeFiles/llircc.dir/Lex.cpp.o" "gcc" "compiler/CMakeFiles/llircc.dir/Lex.cpp.o.d"
+  "/root/repo/compiler/main.cpp" "compiler/CMakeFiles/llircc.dir/main.cpp.o" "gcc" "compiler/CMakeFiles/llircc.dir/main.cpp.o.d"
+  "/root/repo/compiler/parser.cpp" "compiler/CMakeFiles/llircc.dir/parser.cpp.o" "gcc" "compiler/CMakeFiles/llircc.dir/parser.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/build/src/CMakeFiles/llir.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
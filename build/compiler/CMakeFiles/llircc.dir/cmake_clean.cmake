@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/llircc.dir/Lex.cpp.o"
+  "CMakeFiles/llircc.dir/Lex.cpp.o.d"
+  "CMakeFiles/llircc.dir/main.cpp.o"
+  "CMakeFiles/llircc.dir/main.cpp.o.d"
+  "CMakeFiles/llircc.dir/parser.cpp.o"
+  "CMakeFiles/llircc.dir/parser.cpp.o.d"
+  "llircc"
+  "llircc.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/llircc.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test1.dir/test1.cpp.o"
+  "CMakeFiles/test1.dir/test1.cpp.o.d"
+  "test1"
+  "test1.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test1.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
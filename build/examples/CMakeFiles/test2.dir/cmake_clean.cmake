@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test2.dir/test2.cpp.o"
+  "CMakeFiles/test2.dir/test2.cpp.o.d"
+  "test2"
+  "test2.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test2.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
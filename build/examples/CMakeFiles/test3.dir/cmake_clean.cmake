@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test3.dir/test3.cpp.o"
+  "CMakeFiles/test3.dir/test3.cpp.o.d"
+  "test3"
+  "test3.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test3.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
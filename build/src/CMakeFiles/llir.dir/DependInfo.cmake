@@ -0,0 +1,40 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/amd64/amd64.cpp" "src/CMakeFiles/llir.dir/amd64/amd64.cpp.o" "gcc" "src/CMakeFiles/llir.dir/amd64/amd64.cpp.o.d"
+  "/root/repo/src/amd64/x86ir.cpp" "src/CMakeFiles/llir.dir/amd64/x86ir.cpp.o" "gcc" "src/CMakeFiles/llir.dir/amd64/x86ir.cpp.o.d"
+  "/root/repo/src/arena.cpp" "src/CMakeFiles/llir.dir/arena.cpp.o" "gcc" "src/CMakeFiles/llir.dir/arena.cpp.o.d"
+  "/root/repo/src/bitcode/reader.cpp" "src/CMakeFiles/llir.dir/bitcode/reader.cpp.o" "gcc" "src/CMakeFiles/llir.dir/bitcode/reader.cpp.o.d"
+  "/root/repo/src/bitcode/writer.cpp" "src/CMakeFiles/llir.dir/bitcode/writer.cpp.o" "gcc" "src/CMakeFiles/llir.dir/bitcode/writer.cpp.o.d"
+  "/root/repo/src/cfg.cpp" "src/CMakeFiles/llir.dir/cfg.cpp.o" "gcc" "src/CMakeFiles/llir.dir/cfg.cpp.o.d"
+  "/root/repo/src/compact.cpp" "src/CMakeFiles/llir.dir/compact.cpp.o" "gcc" "src/CMakeFiles/llir.dir/compact.cpp.o.d"
+  "/root/repo/src/dce.cpp" "src/CMakeFiles/llir.dir/dce.cpp.o" "gcc" "src/CMakeFiles/llir.dir/dce.cpp.o.d"
+  "/root/repo/src/dominators.cpp" "src/CMakeFiles/llir.dir/dominators.cpp.o" "gcc" "src/CMakeFiles/llir.dir/dominators.cpp.o.d"
+  "/root/repo/src/gvn.cpp" "src/CMakeFiles/llir.dir/gvn.cpp.o" "gcc" "src/CMakeFiles/llir.dir/gvn.cpp.o.d"
+  "/root/repo/src/irbuilder.cpp" "src/CMakeFiles/llir.dir/irbuilder.cpp.o" "gcc" "src/CMakeFiles/llir.dir/irbuilder.cpp.o.d"
+  "/root/repo/src/licm.cpp" "src/CMakeFiles/llir.dir/licm.cpp.o" "gcc" "src/CMakeFiles/llir.dir/licm.cpp.o.d"
+  "/root/repo/src/liveness.cpp" "src/CMakeFiles/llir.dir/liveness.cpp.o" "gcc" "src/CMakeFiles/llir.dir/liveness.cpp.o.d"
+  "/root/repo/src/llir.cpp" "src/CMakeFiles/llir.dir/llir.cpp.o" "gcc" "src/CMakeFiles/llir.dir/llir.cpp.o.d"
+  "/root/repo/src/loops.cpp" "src/CMakeFiles/llir.dir/loops.cpp.o" "gcc" "src/CMakeFiles/llir.dir/loops.cpp.o.d"
+  "/root/repo/src/mem2reg.cpp" "src/CMakeFiles/llir.dir/mem2reg.cpp.o" "gcc" "src/CMakeFiles/llir.dir/mem2reg.cpp.o.d"
+  "/root/repo/src/parallel.cpp" "src/CMakeFiles/llir.dir/parallel.cpp.o" "gcc" "src/CMakeFiles/llir.dir/parallel.cpp.o.d"
+  "/root/repo/src/pass.cpp" "src/CMakeFiles/llir.dir/pass.cpp.o" "gcc" "src/CMakeFiles/llir.dir/pass.cpp.o.d"
+  "/root/repo/src/print.cpp" "src/CMakeFiles/llir.dir/print.cpp.o" "gcc" "src/CMakeFiles/llir.dir/print.cpp.o.d"
+  "/root/repo/src/sccp.cpp" "src/CMakeFiles/llir.dir/sccp.cpp.o" "gcc" "src/CMakeFiles/llir.dir/sccp.cpp.o.d"
+  "/root/repo/src/symbol.cpp" "src/CMakeFiles/llir.dir/symbol.cpp.o" "gcc" "src/CMakeFiles/llir.dir/symbol.cpp.o.d"
+  "/root/repo/src/transform.cpp" "src/CMakeFiles/llir.dir/transform.cpp.o" "gcc" "src/CMakeFiles/llir.dir/transform.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,53 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/llir.dir/amd64/amd64.cpp.o"
+  "CMakeFiles/llir.dir/amd64/amd64.cpp.o.d"
+  "CMakeFiles/llir.dir/amd64/x86ir.cpp.o"
+  "CMakeFiles/llir.dir/amd64/x86ir.cpp.o.d"
+  "CMakeFiles/llir.dir/arena.cpp.o"
+  "CMakeFiles/llir.dir/arena.cpp.o.d"
+  "CMakeFiles/llir.dir/bitcode/reader.cpp.o"
+  "CMakeFiles/llir.dir/bitcode/reader.cpp.o.d"
+  "CMakeFiles/llir.dir/bitcode/writer.cpp.o"
+  "CMakeFiles/llir.dir/bitcode/writer.cpp.o.d"
+  "CMakeFiles/llir.dir/cfg.cpp.o"
+  "CMakeFiles/llir.dir/cfg.cpp.o.d"
+  "CMakeFiles/llir.dir/compact.cpp.o"
+  "CMakeFiles/llir.dir/compact.cpp.o.d"
+  "CMakeFiles/llir.dir/dce.cpp.o"
+  "CMakeFiles/llir.dir/dce.cpp.o.d"
+  "CMakeFiles/llir.dir/dominators.cpp.o"
+  "CMakeFiles/llir.dir/dominators.cpp.o.d"
+  "CMakeFiles/llir.dir/gvn.cpp.o"
+  "CMakeFiles/llir.dir/gvn.cpp.o.d"
+  "CMakeFiles/llir.dir/irbuilder.cpp.o"
+  "CMakeFiles/llir.dir/irbuilder.cpp.o.d"
+  "CMakeFiles/llir.dir/licm.cpp.o"
+  "CMakeFiles/llir.dir/licm.cpp.o.d"
+  "CMakeFiles/llir.dir/liveness.cpp.o"
+  "CMakeFiles/llir.dir/liveness.cpp.o.d"
+  "CMakeFiles/llir.dir/llir.cpp.o"
+  "CMakeFiles/llir.dir/llir.cpp.o.d"
+  "CMakeFiles/llir.dir/loops.cpp.o"
+  "CMakeFiles/llir.dir/loops.cpp.o.d"
+  "CMakeFiles/llir.dir/mem2reg.cpp.o"
+  "CMakeFiles/llir.dir/mem2reg.cpp.o.d"
+  "CMakeFiles/llir.dir/parallel.cpp.o"
+  "CMakeFiles/llir.dir/parallel.cpp.o.d"
+  "CMakeFiles/llir.dir/pass.cpp.o"
+  "CMakeFiles/llir.dir/pass.cpp.o.d"
+  "CMakeFiles/llir.dir/print.cpp.o"
+  "CMakeFiles/llir.dir/print.cpp.o.d"
+  "CMakeFiles/llir.dir/sccp.cpp.o"
+  "CMakeFiles/llir.dir/sccp.cpp.o.d"
+  "CMakeFiles/llir.dir/symbol.cpp.o"
+  "CMakeFiles/llir.dir/symbol.cpp.o.d"
+  "CMakeFiles/llir.dir/transform.cpp.o"
+  "CMakeFiles/llir.dir/transform.cpp.o.d"
+  "libllir.pdb"
+  "libllir.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/llir.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -4,9 +4,13 @@
 // LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
 //
 #include <iostream>
+#include <cstdlib>
 
 #include <parser.hpp>
 #include <amd64/amd64.hpp>
+#include <bitcode/bitcode.hpp>
+#include <parallel.hpp>
+#include <pass.hpp>
 
 int main(int argc, char **argv) {
     if (argc == 1) {
@@ -18,6 +22,11 @@ int main(int argc, char **argv) {
     std::string output = "a.out";
     bool print = false;
     bool print2 = false;
+    bool emitBitcode = false;
+    bool timePasses = false;
+    bool stats = false;
+    int optLevel = 0;
+    std::string passes = "";
     
     for (int i = 1; i<argc; i++) {
         std::string arg = argv[i];
@@ -25,9 +34,34 @@ int main(int argc, char **argv) {
             print = true;
         } else if (arg == "--llir2") {
             print2 = true;
+        } else if (arg == "--emit-bc") {
+            emitBitcode = true;
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            optLevel = arg[2] - '0';
+        } else if (arg == "--time-passes") {
+            timePasses = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--passes") {
+            // A comma-separated list of passes to run instead of the -O pipeline
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --passes expects a list of passes." << std::endl;
+                return 1;
+            }
+            passes = std::string(argv[i+1]);
+            ++i;
         } else if (arg == "-o") {
             output = std::string(argv[i+1]);
             ++i;
+        } else if (arg == "-j") {
+            // The number of threads for the transform and code generation
+            // By default, every hardware thread is used
+            if (i + 1 >= argc || atoi(argv[i+1]) < 1) {
+                std::cerr << "Error: -j expects a number of threads." << std::endl;
+                return 1;
+            }
+            LLIR::setThreadCount(atoi(argv[i+1]));
+            ++i;
         } else if (arg[0] == '-') {
             std::cerr << "Error: Invalid argument." << std::endl;
             return 1;
@@ -36,9 +70,60 @@ int main(int argc, char **argv) {
         }
     }
     
-    Parser *parser = new Parser(input, output);
-    parser->parse();
-    if (print) parser->print();
+    // Bitcode files are loaded directly; anything else goes through the parser
+    // Function bodies in bitcode are only decoded once something uses them
+    Parser *parser = nullptr;
+    Module *mod = nullptr;
+    
+    if (LLIR::BitcodeReader::isBitcodeFile(input)) {
+        LLIR::BitcodeReader *reader = new LLIR::BitcodeReader(input);
+        mod = reader->readLazy();
+        delete reader;
+        if (mod == nullptr) return 1;
+    } else {
+        parser = new Parser(input, output);
+        parser->parse();
+        mod = parser->getModule();
+    }
+    
+    // Run the optimization pipeline
+    LLIR::PassManager *pm = new LLIR::PassManager;
+    if (passes.empty()) {
+        LLIR::buildPipeline(*pm, optLevel);
+    } else {
+        size_t start = 0;
+        while (start <= passes.size()) {
+            size_t end = passes.find(',', start);
+            if (end == std::string::npos) end = passes.size();
+            std::string name = passes.substr(start, end - start);
+            if (!pm->addPass(name)) {
+                std::cerr << "Error: Unknown pass " << name << "." << std::endl;
+                return 1;
+            }
+            start = end + 1;
+        }
+    }
+    pm->setTiming(timePasses);
+    pm->run(mod);
+    if (timePasses) pm->printTimings(std::cerr);
+    if (stats) pm->printStatistics(std::cerr);
+    delete pm;
+    
+    if (print) mod->print();
+    
+    // With --emit-bc, the output is the bitcode of the module after the optimization pipeline,
+    // before the hardware transformation
+    if (emitBitcode) {
+        LLIR::BitcodeWriter *writer = new LLIR::BitcodeWriter(mod);
+        writer->write();
+        bool ok = writer->writeToFile(output);
+        if (!ok) std::cerr << "Error: Unable to write bitcode file." << std::endl;
+        
+        delete writer;
+        if (parser) delete parser;
+        else delete mod;
+        return ok ? 0 : 1;
+    }
     
     // Generate assembly and compile
     std::string asmFile = "/tmp/" + output + ".s";
@@ -49,8 +134,17 @@ int main(int argc, char **argv) {
         command2 += objFile + " -o " + output;
         command2 += " -dynamic-linker /lib64/ld-linux-x86-64.so.2 -lc";
     
-    Module *mod = parser->getModule();
-    mod->transform();
+    // Assign the hardware registers
+    LLIR::PassManager *backend = new LLIR::PassManager;
+    LLIR::TransformPass *transform = new LLIR::TransformPass;
+    backend->addPass(transform);
+    backend->setTiming(timePasses);
+    backend->run(mod);
+    if (timePasses) backend->printTimings(std::cerr);
+    bool failed = transform->hasFailed();
+    delete backend;
+    if (failed) return 1;
+    
     if (print2) mod->print();
     
     LLIR::Amd64Writer *writer = new LLIR::Amd64Writer(mod);
@@ -61,7 +155,8 @@ int main(int argc, char **argv) {
     system(command2.c_str());
     
     // Clean up
-    delete parser;
+    if (parser) delete parser;
+    else delete mod;
     delete writer;
     
     return 0;
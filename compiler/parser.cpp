@@ -11,6 +11,8 @@
 Parser::Parser(std::string input, std::string name) {
     scanner = new Scanner(input);
     mod = new Module(name);
+    arena = mod->getArena();
+    types = mod->getTypeContext();
     builder = new IRBuilder(mod);
 }
 
@@ -44,11 +46,11 @@ void Parser::parse() {
 
 Type *Parser::getType(Token token) {
     switch (token.type) {
-        case Void: return Type::createVoidType();
-        case I8: return Type::createI8Type();
-        case I16: return Type::createI16Type();
-        case I32: return Type::createI32Type();
-        case I64: return Type::createI64Type();
+        case Void: return types->getVoidType();
+        case I8: return types->getI8Type();
+        case I16: return types->getI16Type();
+        case I32: return types->getI32Type();
+        case I64: return types->getI64Type();
         
         default: {}
     }
@@ -74,7 +76,7 @@ bool Parser::buildFunction(Token linkToken) {
     }
     
     for (int i = 0; i<ptrLevel; i++) {
-        type = new PointerType(type);
+        type = types->getPointerType(type);
     }
     
     // The next token should be an ID
@@ -93,8 +95,12 @@ bool Parser::buildFunction(Token linkToken) {
         return false;
     }
     
+    // Registers are scoped to the function
+    regs.clear();
+    definedRegs.clear();
+    
     // The syntax for arguments is: %<reg>:<type>
-    std::vector<Reg *> argRegs;
+    std::vector<std::string> argRegs;
     std::vector<Type *> argTypes;
     
     token = scanner->getNext();
@@ -106,10 +112,10 @@ bool Parser::buildFunction(Token linkToken) {
             return false;
         }
         
-        Reg *reg;
+        std::string reg;
         switch (regToken.type) {
-            case Id: reg = new Reg(regToken.id_val); break;
-            case Int32: reg = new Reg(std::to_string(regToken.i32_val)); break;
+            case Id: reg = regToken.id_val; break;
+            case Int32: reg = std::to_string(regToken.i32_val); break;
             
             default: {
                 std::cerr << "Error: Invalid register syntax in function argument." << std::endl;
@@ -132,7 +138,7 @@ bool Parser::buildFunction(Token linkToken) {
         }
         
         for (int i = 0; i<ptrLevel; i++) {
-            type = new PointerType(type);
+            type = types->getPointerType(type);
         }
         
         // Add to the function
@@ -163,16 +169,16 @@ bool Parser::buildFunction(Token linkToken) {
         default: {}
     }
     
-    Function *func = Function::Create(name, link, type);
+    Function *func = Function::Create(mod, name, link, type);
     mod->addFunction(func);
     builder->setCurrentFunction(func);
     
     for (int i = 0; i<argTypes.size(); i++) {
-        if (argTypes.at(i) == nullptr || argRegs.at(i) == nullptr) {
+        if (argTypes.at(i) == nullptr) {
             std::cerr << "Error: Invalid function arguments." << std::endl;
             return false;
         }
-        func->addArgPair(argTypes.at(i), argRegs.at(i));
+        func->addArgPair(argTypes.at(i), defineReg(argRegs.at(i)));
     }
     
     if (token.type == SemiColon) {
@@ -244,14 +250,9 @@ bool Parser::buildDestInstruction() {
     }
     
     // Now, we can build the rest of the instruction
-    Reg *reg = new Reg(name);
+    Reg *reg = defineReg(name);
     token = scanner->getNext();
-    if (!buildInstruction(token, reg)) {
-        delete reg;
-        return false;
-    }
-    
-    return true;
+    return buildInstruction(token, reg);
 }
 
 //
@@ -267,13 +268,12 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
     }
     Type *type = getType(token);
     if (type == nullptr) {
-        delete dest;
         std::cerr << "Error: Invalid type for function." << std::endl;
         return false;
     }
     
     for (int i = 0; i<ptrLevel; i++) {
-        type = new PointerType(type);
+        type = types->getPointerType(type);
     }
     
     // Operands
@@ -284,15 +284,15 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
     token = scanner->getNext();
     while (token.type != Eof && token.type != SemiColon) {
         switch (token.type) {
-            case Int32: operands.push_back(new Imm(token.i32_val)); break;
+            case Int32: operands.push_back(arena->create<Imm>(token.i32_val)); break;
             
             case Mod: {
                 token = scanner->getNext();
                 Reg *reg;
                 if (token.type == Id) {
-                    reg = new Reg(token.id_val);
+                    reg = getReg(token.id_val);
                 } else if (token.type == Int32) {
-                    reg = new Reg(std::to_string(token.i32_val));
+                    reg = getReg(std::to_string(token.i32_val));
                 } else {
                     std::cerr << "Error: Invalid register." << std::endl;
                     return false;
@@ -309,7 +309,7 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
                     inFunc = true;
                 } else {
                     scanner->rewind(token);
-                    operands.push_back(new Label(name));
+                    operands.push_back(arena->create<Label>(mod->intern(name)));
                 }
             } break;
             
@@ -334,7 +334,7 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
                 }
                 
                 // If all passes, we can build
-                StringPtr *ptr = new StringPtr(nameToken.id_val, valToken.id_val);
+                StringPtr *ptr = arena->create<StringPtr>(mod->intern(nameToken.id_val), mod->intern(valToken.id_val));
                 mod->addStringPtr(ptr);
                 operands.push_back(ptr);
             } break;
@@ -363,32 +363,32 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
     // Now, build the instruction
     Instruction *instr;
     switch (instrType.type) {
-        case Ret: instr = new Instruction(InstrType::Ret); break;
-        case Alloca: instr = new Instruction(InstrType::Alloca); break;
-        case Load: instr = new Instruction(InstrType::Load); break;
-        case Store: instr = new Instruction(InstrType::Store); break;
-        case LoadStruct: instr = new Instruction(InstrType::StructLoad); break;
-        case StoreStruct: instr = new Instruction(InstrType::StructStore); break;
-        case GetElementPtr: instr = new Instruction(InstrType::GEP); break;
+        case Ret: instr = arena->create<Instruction>(InstrType::Ret); break;
+        case Alloca: instr = arena->create<Instruction>(InstrType::Alloca); break;
+        case Load: instr = arena->create<Instruction>(InstrType::Load); break;
+        case Store: instr = arena->create<Instruction>(InstrType::Store); break;
+        case LoadStruct: instr = arena->create<Instruction>(InstrType::StructLoad); break;
+        case StoreStruct: instr = arena->create<Instruction>(InstrType::StructStore); break;
+        case GetElementPtr: instr = arena->create<Instruction>(InstrType::GEP); break;
         
-        case Add: instr = new Instruction(InstrType::Add); break;
-        case Sub: instr = new Instruction(InstrType::Sub); break;
-        case SMul: instr = new Instruction(InstrType::SMul); break;
-        case SDiv: instr = new Instruction(InstrType::SDiv); break;
-        case Call: instr = new FunctionCall(funcName, operands); break;
+        case Add: instr = arena->create<Instruction>(InstrType::Add); break;
+        case Sub: instr = arena->create<Instruction>(InstrType::Sub); break;
+        case SMul: instr = arena->create<Instruction>(InstrType::SMul); break;
+        case SDiv: instr = arena->create<Instruction>(InstrType::SDiv); break;
+        case Call: instr = arena->create<FunctionCall>(mod->intern(funcName), operands); break;
         
-        case Br: instr = new Instruction(InstrType::Br); break;
-        case Beq: instr = new Instruction(InstrType::Beq); break;
-        case Bne: instr = new Instruction(InstrType::Bne); break;
-        case Bgt: instr = new Instruction(InstrType::Bgt); break;
-        case Blt: instr = new Instruction(InstrType::Blt); break;
-        case Bge: instr = new Instruction(InstrType::Bge); break;
-        case Ble: instr = new Instruction(InstrType::Ble); break;
+        case Br: instr = arena->create<Instruction>(InstrType::Br); break;
+        case Beq: instr = arena->create<Instruction>(InstrType::Beq); break;
+        case Bne: instr = arena->create<Instruction>(InstrType::Bne); break;
+        case Bgt: instr = arena->create<Instruction>(InstrType::Bgt); break;
+        case Blt: instr = arena->create<Instruction>(InstrType::Blt); break;
+        case Bge: instr = arena->create<Instruction>(InstrType::Bge); break;
+        case Ble: instr = arena->create<Instruction>(InstrType::Ble); break;
         
-        case And: instr = new Instruction(InstrType::And); break;
-        case Or: instr = new Instruction(InstrType::Or); break;
-        case Xor: instr = new Instruction(InstrType::Xor); break;
-        case Not: instr = new Instruction(InstrType::Not); break;
+        case And: instr = arena->create<Instruction>(InstrType::And); break;
+        case Or: instr = arena->create<Instruction>(InstrType::Or); break;
+        case Xor: instr = arena->create<Instruction>(InstrType::Xor); break;
+        case Not: instr = arena->create<Instruction>(InstrType::Not); break;
         
         default: {
             std::cerr << "Error: Unknown instruction." << std::endl;
@@ -410,6 +410,37 @@ bool Parser::buildInstruction(Token instrType, Operand *dest) {
     return true;
 }
 
+//
+// Returns the register currently bound to a name
+// Registers can be used before they are defined (for instance, across a loop), so we
+// create them on first sight
+//
+Reg *Parser::getReg(std::string name) {
+    auto it = regs.find(name);
+    if (it != regs.end()) return it->second;
+    
+    Reg *reg = builder->getCurrentFunction()->createReg(name);
+    regs[name] = reg;
+    return reg;
+}
+
+//
+// Returns the register for a new definition
+// If the name was already defined, the new definition shadows the old one from here on
+//
+Reg *Parser::defineReg(std::string name) {
+    Reg *reg;
+    if (definedRegs.find(name) == definedRegs.end()) {
+        reg = getReg(name);
+    } else {
+        reg = builder->getCurrentFunction()->createReg(name);
+        regs[name] = reg;
+    }
+    
+    definedRegs.insert(name);
+    return reg;
+}
+
 void Parser::print() {
     if (mod) mod->print();
 }
@@ -5,6 +5,10 @@
 //
 #pragma once
 
+#include <map>
+#include <set>
+#include <string>
+
 #include <Lex.hpp>
 #include <llir.hpp>
 #include <irbuilder.hpp>
@@ -28,8 +32,16 @@ protected:
     bool buildBody();
     bool buildDestInstruction();
     bool buildInstruction(Token instrType, Operand *dest = nullptr);
+    Reg *getReg(std::string name);
+    Reg *defineReg(std::string name);
 private:
     Scanner *scanner;
     Module *mod;
+    Arena *arena;
+    TypeContext *types;
     IRBuilder *builder;
+    
+    // The registers of the current function
+    std::map<std::string, Reg *> regs;
+    std::set<std::string> definedRegs;
 };
@@ -26,8 +26,8 @@ int main(int argc, char **argv) {
     //     %7 = load %2
     //     %8 = sub %7, 50
     //     ret %8
-    Type *i32Type = Type::createI32Type();
-    Function *mainFunc = Function::Create("main", Linkage::Global, i32Type);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    Function *mainFunc = Function::Create(mod, "main", Linkage::Global, i32Type);
     mod->addFunction(mainFunc);
     builder->setCurrentFunction(mainFunc);
     builder->createBlock("entry");
@@ -15,8 +15,8 @@ int main(int argc, char **argv) {
     //
     // func main:
     //     ret 0
-    Type *i32Type = Type::createI32Type();
-    Function *mainFunc = Function::Create("main", Linkage::Global, i32Type);
+    Type *i32Type = mod->getTypeContext()->getI32Type();
+    Function *mainFunc = Function::Create(mod, "main", Linkage::Global, i32Type);
     mod->addFunction(mainFunc);
     builder->setCurrentFunction(mainFunc);
     builder->createBlock("entry");
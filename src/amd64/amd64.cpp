@@ -9,9 +9,19 @@
 
 #include <amd64/amd64.hpp>
 #include <llir.hpp>
+#include <parallel.hpp>
 
 namespace LLIR {
 
+// Operands that are in memory: stack slots, and the pointers from getelementptr
+static bool isMemory(CompactOperand op) {
+    return op.kind == CompactKind::Mem || op.kind == CompactKind::PReg;
+}
+
+static bool isMemory(X86Operand *op) {
+    return op->getType() == X86Type::Mem || op->getType() == X86Type::RegPtr;
+}
+
 Amd64Writer::Amd64Writer(Module *mod) {
     this->mod = mod;
     file = new X86File(mod->getName());
@@ -23,6 +33,8 @@ Amd64Writer::Amd64Writer(Module *mod) {
     regMap[1] = X86Reg::BX;
     regMap[2] = X86Reg::CX;
     regMap[3] = X86Reg::DX;
+    regMap[4] = X86Reg::R12;
+    regMap[5] = X86Reg::R13;
     
     // Init the arguments register map
     argRegMap[0] = X86Reg::DI;
@@ -37,85 +49,144 @@ Amd64Writer::~Amd64Writer() {
     delete file;
 }
 
+// The functions are independent, so each one is lowered into a fragment of its own, largest
+// first. Stubs are materialized first, since that can only happen on one thread.
 void Amd64Writer::compile() {
     // Data section
     for (int i = 0; i<mod->getStringCount(); i++) {
         StringPtr *str = mod->getString(i);
-        X86Data *d = new X86Data(str->getName(), str->getValue());
+        X86Data *d = new X86Data(str->getName().str(), str->getValue().str());
         file->addData(d);
     }
     
     // Text section
-    for (int i = 0; i<mod->getFunctionCount(); i++) {
+    mod->materializeAll();
+    std::vector<X86File *> fragments(mod->getFunctionCount(), nullptr);
+    parallelFor(fragments.size(), [this, &fragments](int i) {
         Function *func = mod->getFunction(i);
-        switch (func->getLinkage()) {
-            case Linkage::Global: {
-                X86GlobalFunc *x86Func = new X86GlobalFunc(func->getName());
-                file->addCode(x86Func);
-            } break;
-            
-            case Linkage::Local: {} break;
-            
-            case Linkage::Extern: {
-                //assembly += ".extern " + func->getName() + "\n";
-                continue;
-            } break;
-        }
-        
-        // Setup the stack
-        X86Imm *stackImm = new X86Imm(0);
-        
-        X86Push *p = new X86Push(new X86Reg64(X86Reg::BP));
-        file->addCode(p);
-        X86Mov *mov = new X86Mov(new X86Reg64(X86Reg::BP), new X86Reg64(X86Reg::SP));
-        file->addCode(mov);
-        X86Sub *sub = new X86Sub(new X86Reg64(X86Reg::SP), stackImm);
-        file->addCode(sub);
+        if (func->getLinkage() == Linkage::Extern) return;
         
-        // Blocks
-        std::string prefix = "F" + std::to_string(i) + "_";
-        
-        for (int j = 0; j<func->getBlockCount(); j++) {
-            Block *block = func->getBlock(j);
-            if (j != 0) {
-                file->addCode(new X86Label(prefix + block->getName()));
-            }
-            
-            // Instructions
-            for (int k = 0; k<block->getInstrCount(); k++) {
-                compileInstruction(block->getInstruction(k), prefix);
-            }
+        Amd64FunctionWriter writer(this, func, i);
+        fragments[i] = writer.compile();
+    }, [this](int i) {
+        return (size_t)mod->getFunction(i)->getInstrCount();
+    });
+    
+    for (X86File *fragment : fragments) {
+        if (fragment == nullptr) continue;
+        file->append(fragment);
+        delete fragment;
+    }
+}
+
+//
+// Function writer
+//
+Amd64FunctionWriter::Amd64FunctionWriter(Amd64Writer *writer, Function *func, int index) {
+    this->writer = writer;
+    this->mod = writer->mod;
+    this->func = func;
+    this->index = index;
+}
+
+X86File *Amd64FunctionWriter::compile() {
+    file = new X86File(func->getName().str());
+    
+    if (func->getLinkage() == Linkage::Global) {
+        X86GlobalFunc *x86Func = new X86GlobalFunc(func->getName().str());
+        file->addCode(x86Func);
+    }
+    
+    // Stack slots are indexed by the ID of the register they replaced
+    memMap.assign(func->getRegCount(), 0);
+    usedRegs.assign((int)X86Reg::R15 + 1, false);
+    
+    // Setup the stack
+    X86Imm *stackImm = new X86Imm(0);
+    
+    X86Push *p = new X86Push(new X86Reg64(X86Reg::BP));
+    file->addCode(p);
+    X86Mov *mov = new X86Mov(new X86Reg64(X86Reg::BP), new X86Reg64(X86Reg::SP));
+    file->addCode(mov);
+    X86Sub *sub = new X86Sub(new X86Reg64(X86Reg::SP), stackImm);
+    file->addCode(sub);
+    size_t bodyStart = file->getCodeSize();
+    
+    // Blocks
+    // The body is walked in its compact form. The assembly label of each block is built once,
+    // and label operands refer to it by block index.
+    CompactFunction body(func);
+    code = &body;
+    
+    std::string prefix = "F" + std::to_string(index) + "_";
+    for (int b = 0; b<body.getBlockCount(); b++) {
+        labels.push_back(prefix + body.getBlockName(b).str());
+    }
+    
+    for (int b = 0; b<body.getBlockCount(); b++) {
+        if (b != 0) {
+            file->addCode(new X86Label(labels[b]));
         }
         
-        if (stackPos < 16) {
-            stackImm->setValue(16);
-        } else {
-            int i = 16;
-            for (; i < (stackPos + 4); i += 16) {}
-            i += 16;
-            stackImm->setValue(i);
+        // Instructions
+        for (CompactCursor instr = body.begin(b); !instr.atEnd(); instr.next()) {
+            compileInstruction(instr, prefix);
         }
-        stackPos = 0;
-        
-        // Clean up the stack and leave
-        file->addCode(new X86Leave);
-        file->addCode(new X86Ret);
     }
+    code = nullptr;
+    
+    // Clean up the stack and leave, unless the body just did
+    if (returns.empty() || returns.back() + 2 != file->getCodeSize()) emitReturn();
+    saveRegisters(bodyStart);
+    
+    if (stackPos < 16) {
+        stackImm->setValue(16);
+    } else {
+        int i = 16;
+        for (; i < (stackPos + 4); i += 16) {}
+        i += 16;
+        stackImm->setValue(i);
+    }
+    
+    return file;
 }
 
-void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
-    switch (instr->getType()) {
+// The callee-saved registers the body writes get a stack slot each. They are saved once the
+// frame is set up, and restored before every return.
+void Amd64FunctionWriter::saveRegisters(size_t pos) {
+    static const X86Reg calleeSaved[] = { X86Reg::BX, X86Reg::R12, X86Reg::R13, X86Reg::R14, X86Reg::R15 };
+    std::vector<std::pair<X86Reg, int>> slots;
+    for (X86Reg reg : calleeSaved) {
+        if (!usedRegs[(int)reg]) continue;
+        stackPos += 8;
+        slots.push_back({ reg, stackPos });
+    }
+    
+    auto slot = [](int offset) {
+        X86Mem *mem = new X86Mem(new X86Imm(0 - offset));
+        mem->setSizeAttr("QWORD PTR");
+        return mem;
+    };
+    
+    // Later positions first, so the earlier ones stay valid
+    for (auto it = returns.rbegin(); it != returns.rend(); ++it) {
+        for (auto &entry : slots) file->insertCode(*it, new X86Mov(new X86Reg64(entry.first), slot(entry.second)));
+    }
+    for (auto &entry : slots) file->insertCode(pos, new X86Mov(slot(entry.second), new X86Reg64(entry.first)));
+}
+
+void Amd64FunctionWriter::compileInstruction(const CompactCursor &instr, std::string prefix) {
+    switch (instr.getType()) {
         case InstrType::None: break;
         
         case InstrType::Ret: {
-            if (instr->getDataType()->getType() == DataType::Void) {
-                file->addCode(new X86Leave);
-                file->addCode(new X86Ret);
+            if (instr.getDataType()->getType() == DataType::Void) {
+                emitReturn();
                 break;
             }
         
-            Type *type = instr->getDataType();
-            X86Operand *src = compileOperand(instr->getOperand1(), type, prefix);
+            Type *type = instr.getDataType();
+            X86Operand *src = compileOperand(instr.getOperand1(), type, prefix);
             X86Operand *dest;
             switch (type->getType()) {
                 case DataType::I8: dest = new X86Reg8(X86Reg::AX); break;
@@ -130,107 +201,111 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
             
             X86Mov *mov = new X86Mov(dest, src);
             file->addCode(mov);
+            emitReturn();
         } break;
         
         case InstrType::RetVoid: {
-            file->addCode(new X86Leave);
-            file->addCode(new X86Ret);
+            emitReturn();
         } break;
         
         // Math
+        // The result is built in the destination, unless that is in memory and so is one of the
+        // operands, since x86 can't take two memory operands. Then it is built in the scratch register.
         case InstrType::Add:
         case InstrType::Sub:
         case InstrType::And:
         case InstrType::Or:
         case InstrType::Xor: {
-            X86Operand *op1 = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *op2 = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
-            X86Operand *fop1, *fop2;
-            if (op1->getType() == X86Type::Imm) {
-                fop2 = op1;
-                fop1 = op2;
-            } else {
-                fop1 = op1;
-                fop2 = op2;
-            }
+            Type *type = instr.getDataType();
+            bool scratch = isMemory(instr.getDest()) && (isMemory(instr.getOperand1()) || isMemory(instr.getOperand2()));
+            auto target = [&]() {
+                return scratch ? getScratch(type) : compileOperand(instr.getDest(), type, prefix);
+            };
             
+            X86Operand *op1 = compileOperand(instr.getOperand1(), type, prefix);
+            file->addCode(new X86Mov(target(), op1));
+            
+            X86Operand *op2 = compileOperand(instr.getOperand2(), type, prefix);
             X86Instr *instr2;
-            switch (instr->getType()) {
-                case InstrType::Add: instr2 = new X86Add(fop1, fop2); break;
-                case InstrType::Sub: instr2 = new X86Sub(fop1, fop2); break;
-                case InstrType::And: instr2 = new X86And(fop1, fop2); break;
-                case InstrType::Or: instr2 = new X86Or(fop1, fop2); break;
-                case InstrType::Xor: instr2 = new X86Xor(fop1, fop2); break;
+            switch (instr.getType()) {
+                case InstrType::Add: instr2 = new X86Add(target(), op2); break;
+                case InstrType::Sub: instr2 = new X86Sub(target(), op2); break;
+                case InstrType::And: instr2 = new X86And(target(), op2); break;
+                case InstrType::Or: instr2 = new X86Or(target(), op2); break;
+                case InstrType::Xor: instr2 = new X86Xor(target(), op2); break;
                 
                 default: {}
             }
-            
             file->addCode(instr2);
             
-            // Now, we need a move so we're in the right register
-            // I love x86
-            X86Operand *dest = compileOperand(instr->getDest(), instr->getDataType(), prefix);
-            X86Mov *mov = new X86Mov(dest, fop1);
-            file->addCode(mov);
+            if (scratch) {
+                X86Operand *dest = compileOperand(instr.getDest(), type, prefix);
+                file->addCode(new X86Mov(dest, getScratch(type)));
+            }
         } break;
         
         // Multiplication
-        // This is like the only instruction that makes sense with the three operands
+        // The three operand form takes an immediate; otherwise the product is built in place.
+        // Either way, the result has to be in a register.
         case InstrType::UMul:
         case InstrType::SMul: {
-            X86Operand *op1 = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *op2 = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
-            X86Operand *dest = compileOperand(instr->getDest(), instr->getDataType(), prefix);
-            X86Operand *fop1, *fop2;
-            if (op1->getType() == X86Type::Imm) {
-                fop2 = op1;
-                fop1 = op2;
+            Type *type = instr.getDataType();
+            bool scratch = isMemory(instr.getDest());
+            auto target = [&]() {
+                return scratch ? getScratch(type) : compileOperand(instr.getDest(), type, prefix);
+            };
+            
+            CompactOperand op1 = instr.getOperand1();
+            CompactOperand op2 = instr.getOperand2();
+            if (op1.kind == CompactKind::Imm) std::swap(op1, op2);
+            
+            if (op2.kind == CompactKind::Imm) {
+                X86Operand *src = compileOperand(op1, type, prefix);
+                if (op1.kind == CompactKind::Imm) {
+                    file->addCode(new X86Mov(target(), src));
+                    src = target();
+                }
+                file->addCode(new X86IMul(target(), src, compileOperand(op2, type, prefix)));
             } else {
-                fop1 = op1;
-                fop2 = op2;
+                file->addCode(new X86Mov(target(), compileOperand(op1, type, prefix)));
+                file->addCode(new X86IMul(target(), compileOperand(op2, type, prefix)));
             }
             
-            X86IMul *imul = new X86IMul(dest, op1, op2);
-            file->addCode(imul);
+            if (scratch) {
+                X86Operand *dest = compileOperand(instr.getDest(), type, prefix);
+                file->addCode(new X86Mov(dest, getScratch(type)));
+            }
         } break;
         
         // Division
-        // This operand is even more interesting!
+        // The dividend goes in AX, and is sign extended into DX. The quotient comes back in AX and
+        // the remainder in DX. The divisor can't be an immediate.
         case InstrType::UDiv:
         case InstrType::SDiv:
         case InstrType::URem:
         case InstrType::SRem: {
-            X86Operand *op1 = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *op2 = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
-            X86Operand *dest = compileOperand(instr->getDest(), instr->getDataType(), prefix);
-            X86Operand *rax = compileOperand(new HReg(0), instr->getDataType(), prefix);
-            X86Operand *fop2;
-            bool pop = false;
-            if (op2->getType() == X86Type::Imm) {
-                X86Operand *fop2_long = compileOperand(new HReg(-1), Type::createI64Type(), prefix);
-                fop2 = compileOperand(new HReg(-1), instr->getDataType(), prefix);
-                X86Mov *mov1 = new X86Mov(fop2, op2);
-                file->addCode(mov1);
-                pop = true;
-            } else {
-                fop2 = op2;
-            }
+            Type *type = instr.getDataType();
+            CompactOperand ax(CompactKind::HReg, 0);
+            CompactOperand dx(CompactKind::HReg, 3);
             
-            X86Mov *mov = new X86Mov(op1, rax);
-            file->addCode(mov);
-            
-            X86Cdq *cdq = new X86Cdq;
-            file->addCode(cdq);
+            X86Operand *op1 = compileOperand(instr.getOperand1(), type, prefix);
+            file->addCode(new X86Mov(compileOperand(ax, type, prefix), op1));
+            file->addCode(new X86Cdq);
             
-            X86IDiv *idiv = new X86IDiv(fop2);
-            file->addCode(idiv);
+            X86Operand *op2 = compileOperand(instr.getOperand2(), type, prefix);
+            if (op2->getType() == X86Type::Imm) {
+                file->addCode(new X86Mov(getScratch(type), op2));
+                op2 = getScratch(type);
+            }
+            file->addCode(new X86IDiv(op2));
             
-            X86Mov *mov2 = new X86Mov(dest, rax);
-            file->addCode(mov2);
+            bool rem = instr.getType() == InstrType::URem || instr.getType() == InstrType::SRem;
+            X86Operand *dest = compileOperand(instr.getDest(), type, prefix);
+            file->addCode(new X86Mov(dest, compileOperand(rem ? dx : ax, type, prefix)));
         } break;
         
         case InstrType::Br: {
-            X86Operand *label = compileOperand(instr->getOperand1(), nullptr, prefix);
+            X86Operand *label = compileOperand(instr.getOperand1(), nullptr, prefix);
             X86Jmp *jmp = new X86Jmp(label, X86Type::Jmp);
             file->addCode(jmp);
         } break;
@@ -242,14 +317,20 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
         case InstrType::Blt:
         case InstrType::Bge:
         case InstrType::Ble: {
-            X86Operand *op1 = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *op2 = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
+            // An immediate can only be the second operand, and only one can be in memory
+            X86Operand *op1 = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            X86Operand *op2 = compileOperand(instr.getOperand2(), instr.getDataType(), prefix);
+            if (op1->getType() == X86Type::Imm || (isMemory(instr.getOperand1()) && isMemory(instr.getOperand2()))) {
+                file->addCode(new X86Mov(getScratch(instr.getDataType()), op1));
+                op1 = getScratch(instr.getDataType());
+            }
+            
             X86Cmp *cmp = new X86Cmp(op1, op2);
             file->addCode(cmp);
             
-            X86Operand *label = compileOperand(instr->getOperand3(), nullptr, prefix);
+            X86Operand *label = compileOperand(instr.getOperand3(), nullptr, prefix);
             X86Instr *jmp;
-            switch (instr->getType()) {
+            switch (instr.getType()) {
                 case InstrType::Beq: jmp = new X86Jmp(label, X86Type::Je); break;
                 case InstrType::Bne: jmp = new X86Jmp(label, X86Type::Jne); break;
                 case InstrType::Bgt: jmp = new X86Jmp(label, X86Type::Jg); break;
@@ -264,17 +345,19 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
         } break;
         
         case InstrType::Call: {
-            FunctionCall *fc = static_cast<FunctionCall *>(instr);
-            Function *callee = mod->getFunctionByName(fc->getName());
+            // Slot 1 holds the name of the callee, and the arguments follow it
+            Symbol name = instr.getSymbol(instr.getOperand1());
+            Function *callee = mod->getFunctionByName(name);
             
             int pos = 0;
-            for (Operand *arg : fc->getArgs()) {
+            for (int slot = 2; slot<instr.getOperandCount(); slot++) {
+                CompactOperand arg = instr.getOperand(slot);
                 // TODO: Some better argument detection for the registers would be ideal
-                Type *argType = Type::createI32Type();
+                Type *argType = TypeContext::getI32Type();
                 if (pos < callee->getArgCount()) argType = callee->getArgType(pos);
                 X86Operand *op = compileOperand(arg, argType, prefix);
                 
-                X86Reg regType = argRegMap[pos];
+                X86Reg regType = getReg(writer->argRegMap, pos);
                 ++pos;
                 
                 X86Operand *dest = new X86Reg32(regType);
@@ -312,29 +395,37 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
                 }
             }
             
-            X86Call *call = new X86Call(fc->getName());
+            X86Call *call = new X86Call(name.str());
             file->addCode(call);
+            
+            // The result comes back in AX
+            CompactOperand dest = instr.getDest();
+            bool inAX = dest.kind == CompactKind::HReg && dest.value == 0;
+            if (dest.kind != CompactKind::None && !inAX && instr.getDataType()->getType() != DataType::Void) {
+                CompactOperand ax(CompactKind::HReg, 0);
+                X86Operand *result = compileOperand(ax, instr.getDataType(), prefix);
+                file->addCode(new X86Mov(compileOperand(dest, instr.getDataType(), prefix), result));
+            }
         } break;
         
         case InstrType::Alloca: {
-            if (instr->getDataType()->getType() == DataType::Struct) {
-                StructType *type = static_cast<StructType *>(instr->getDataType());
+            if (instr.getDataType()->getType() == DataType::Struct) {
+                StructType *type = static_cast<StructType *>(instr.getDataType());
                 for (Type *t : type->getElementTypes()) stackPos += getIntSizeForType(t);
             } else {
-                stackPos += getIntSizeForType(instr->getDataType());
+                stackPos += getIntSizeForType(instr.getDataType());
             }
             
-            Mem *mem = static_cast<Mem *>(instr->getDest());
-            memMap[mem->getName()] = stackPos;
+            memMap[instr.getDest().value] = stackPos;
         } break;
         
         case InstrType::StructLoad: {
             // First, compile the operands
-            X86Operand *src = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            int position = static_cast<Imm *>(instr->getOperand2())->getValue();
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            int position = instr.getOperand2().value;
             
             // Now, calculate the element position
-            StructType *type = static_cast<StructType *>(instr->getDataType());
+            StructType *type = static_cast<StructType *>(instr.getDataType());
             Type *elementType = type->getElementTypes().at(position);
             position *= getIntSizeForType(elementType);
             
@@ -345,25 +436,23 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
             offset->setValue(offset->getValue() + position);
             
             // Now, do the moves
-            X86Operand *dest = compileOperand(instr->getDest(), elementType, prefix);
-            X86Mov *mov = new X86Mov(dest, mem);
-            file->addCode(mov);
+            X86Operand *dest = compileOperand(instr.getDest(), elementType, prefix);
+            emitMove(dest, mem, elementType);
         } break;
         
         case InstrType::Load: {
-            X86Operand *src = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *dest = compileOperand(instr->getDest(), instr->getDataType(), prefix);
-            X86Mov *mov = new X86Mov(dest, src);
-            file->addCode(mov);
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            X86Operand *dest = compileOperand(instr.getDest(), instr.getDataType(), prefix);
+            emitMove(dest, src, instr.getDataType());
         } break;
         
         case InstrType::GEP: {
-            X86Operand *src = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *index = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            CompactOperand index = instr.getOperand2();
             
             // Check the index, and calculate the proper offset
             int offset = 1;
-            Type *type = instr->getDataType();
+            Type *type = instr.getDataType();
             if (type->getType() == DataType::Ptr) {
                 type = static_cast<PointerType *>(type)->getBaseType();
             }
@@ -378,33 +467,33 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
                 case DataType::Ptr: offset = 8; break;
             }
                 
-            if (index->getType() == X86Type::Imm) {
-                X86Imm *indexImm = static_cast<X86Imm *>(index);
-                int val = indexImm->getValue();
-                indexImm->setValue(val * offset);
-                index = indexImm;
+            // The pointer is built in the destination, which has to be a plain register here. The
+            // index is scaled in the scratch register, so neither operand is changed.
+            X86RegPtr *destPtr = static_cast<X86RegPtr *>(compileOperand(instr.getDest(), instr.getDataType(), prefix));
+            X86Reg destReg = destPtr->getType();
+            delete destPtr;
+            
+            if (index.kind == CompactKind::Imm) {
+                int val = index.value * offset;
+                file->addCode(new X86Mov(new X86Reg64(destReg), src));
+                if (val != 0) file->addCode(new X86Add(new X86Reg64(destReg), new X86Imm(val)));
             } else {
-                X86IMul *mul = new X86IMul(index, index, new X86Imm(offset));
-                file->addCode(mul);
+                Type *i32Type = TypeContext::getI32Type();
+                Type *i64Type = TypeContext::getI64Type();
+                file->addCode(new X86Mov(getScratch(i32Type), compileOperand(index, i32Type, prefix)));
+                file->addCode(new X86IMul(getScratch(i64Type), getScratch(i64Type), new X86Imm(offset)));
+                file->addCode(new X86Mov(new X86Reg64(destReg), src));
+                file->addCode(new X86Add(new X86Reg64(destReg), getScratch(i64Type)));
             }
-            
-            X86Add *add = new X86Add(src, index);
-            file->addCode(add);
-            
-            // The destination needs to be converted to a regular register
-            X86RegPtr *dest = static_cast<X86RegPtr *>(compileOperand(instr->getDest(), instr->getDataType(), prefix));
-            X86Reg64 *dest2 = new X86Reg64(dest->getType());
-            X86Mov *mov = new X86Mov(dest2, src);
-            file->addCode(mov);
         } break;
         
         case InstrType::StructStore: {
             // First, compile the operands
-            X86Operand *src = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            int position = static_cast<Imm *>(instr->getOperand2())->getValue();
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            int position = instr.getOperand2().value;
             
             // Now, calculate the element position
-            StructType *type = static_cast<StructType *>(instr->getDataType());
+            StructType *type = static_cast<StructType *>(instr.getDataType());
             Type *elementType = type->getElementTypes().at(position);
             position *= getIntSizeForType(elementType);
             
@@ -415,41 +504,81 @@ void Amd64Writer::compileInstruction(Instruction *instr, std::string prefix) {
             offset->setValue(offset->getValue() + position);
             
             // Now, do the moves
-            X86Operand *dest = compileOperand(instr->getOperand3(), elementType, prefix);
-            X86Mov *mov = new X86Mov(mem, dest);
-            file->addCode(mov);
+            X86Operand *dest = compileOperand(instr.getOperand3(), elementType, prefix);
+            emitMove(mem, dest, elementType);
         } break;
         
         case InstrType::Store: {
-            X86Operand *src = compileOperand(instr->getOperand1(), instr->getDataType(), prefix);
-            X86Operand *dest = compileOperand(instr->getOperand2(), instr->getDataType(), prefix);
-            X86Mov *mov = new X86Mov(dest, src);
-            file->addCode(mov);
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            X86Operand *dest = compileOperand(instr.getOperand2(), instr.getDataType(), prefix);
+            emitMove(dest, src, instr.getDataType());
+        } break;
+        
+        // What is left of the phi nodes once the hardware transformation takes the function out of SSA
+        case InstrType::Copy: {
+            X86Operand *src = compileOperand(instr.getOperand1(), instr.getDataType(), prefix);
+            X86Operand *dest = compileOperand(instr.getDest(), instr.getDataType(), prefix);
+            emitMove(dest, src, instr.getDataType());
         } break;
+        
+        // The hardware transformation removes these
+        case InstrType::Phi: break;
+    }
+}
+
+// x86 has no move from memory to memory, so those go through the scratch register.
+//
+// A byte or a word moved to a register is sign extended to the whole of it, since it may be read
+// back at another size, such as when it is passed to a function.
+void Amd64FunctionWriter::emitMove(X86Operand *dest, X86Operand *src, Type *type) {
+    if (dest->getType() == X86Type::Reg8 || dest->getType() == X86Type::Reg16) {
+        X86Reg reg;
+        if (dest->getType() == X86Type::Reg8) reg = static_cast<X86Reg8 *>(dest)->getType();
+        else reg = static_cast<X86Reg16 *>(dest)->getType();
+        delete dest;
+        
+        if (src->getType() == X86Type::Imm) file->addCode(new X86Mov(new X86Reg32(reg), src));
+        else file->addCode(new X86Movsx(new X86Reg32(reg), src));
+        return;
+    }
+    
+    if (isMemory(dest) && isMemory(src)) {
+        file->addCode(new X86Mov(getScratch(type), src));
+        src = getScratch(type);
     }
+    file->addCode(new X86Mov(dest, src));
 }
 
-X86Operand *Amd64Writer::compileOperand(Operand *src, Type *type, std::string prefix) {
-    switch (src->getType()) {
+void Amd64FunctionWriter::emitReturn() {
+    returns.push_back(file->getCodeSize());
+    file->addCode(new X86Leave);
+    file->addCode(new X86Ret);
+}
+
+// R15 is never handed out, so it is free within a single instruction
+X86Operand *Amd64FunctionWriter::getScratch(Type *type) {
+    return compileOperand(CompactOperand(CompactKind::HReg, -1), type, "");
+}
+
+X86Operand *Amd64FunctionWriter::compileOperand(CompactOperand src, Type *type, std::string prefix) {
+    switch (src.kind) {
         // Return an immediate operand
-        case OpType::Imm: {
-            Imm *imm = static_cast<Imm *>(src);
-            return new X86Imm(imm->getValue());
+        case CompactKind::Imm: {
+            return new X86Imm(src.value);
         }
         
         // Return a memory operand
-        case OpType::Mem: {
-            Mem *mem = static_cast<Mem *>(src);
-            int pos = memMap[mem->getName()];
+        case CompactKind::Mem: {
+            int pos = memMap[src.value];
             X86Mem *mem2 = new X86Mem(new X86Imm(0 - pos));
             mem2->setSizeAttr(getSizeForType(type));
             return mem2;
         }
         
         // Return a hardware register
-        case OpType::HReg: {
-            HReg *reg = static_cast<HReg *>(src);
-            X86Reg rType = regMap[reg->getNum()];
+        case CompactKind::HReg: {
+            X86Reg rType = getReg(writer->regMap, src.value);
+            usedRegs[(int)rType] = true;
             
             switch (type->getType()) {
                 case DataType::Void: break;
@@ -465,9 +594,8 @@ X86Operand *Amd64Writer::compileOperand(Operand *src, Type *type, std::string pr
         } break;
         
         // Return an argument register
-        case OpType::AReg: {
-            AReg *reg = static_cast<AReg *>(src);
-            X86Reg rType = argRegMap[reg->getNum()];
+        case CompactKind::AReg: {
+            X86Reg rType = getReg(writer->argRegMap, src.value);
             
             switch (type->getType()) {
                 case DataType::Void: break;
@@ -483,24 +611,27 @@ X86Operand *Amd64Writer::compileOperand(Operand *src, Type *type, std::string pr
         } break;
         
         // Return a pointer register
-        case OpType::PReg: {
-            PReg *reg = static_cast<PReg *>(src);
-            X86Reg rType = regMap[reg->getNum()];
+        case CompactKind::PReg: {
+            X86Reg rType = getReg(writer->regMap, src.value);
+            usedRegs[(int)rType] = true;
             X86RegPtr *reg2 = new X86RegPtr(rType);
             reg2->setSizeAttr(getSizeForType(type));
             return reg2;
         } break;
         
         // A string operand
-        case OpType::String: {
-            StringPtr *ptr = static_cast<StringPtr *>(src);
-            return new X86String(ptr->getName());
+        case CompactKind::String: {
+            return new X86String(code->getSymbol(src.value).str());
         }
         
         // A label reference
-        case OpType::Label: {
-            Label *lbl = static_cast<Label *>(src);
-            return new X86LabelRef(prefix + lbl->getName());
+        case CompactKind::Label: {
+            return new X86LabelRef(labels[src.value]);
+        }
+        
+        // A label that does not name a block in this function
+        case CompactKind::Symbol: {
+            return new X86LabelRef(prefix + code->getSymbol(src.value).str());
         }
         
         default: return nullptr;
@@ -539,7 +670,7 @@ void Amd64Writer::build() {
     system(cmd2.c_str());
 }
 
-std::string Amd64Writer::getSizeForType(Type *type) {
+std::string Amd64FunctionWriter::getSizeForType(Type *type) {
     switch (type->getType()) {
         case DataType::Void: break;
         case DataType::I8: return "BYTE PTR";
@@ -553,7 +684,7 @@ std::string Amd64Writer::getSizeForType(Type *type) {
     return "";
 }
 
-int Amd64Writer::getIntSizeForType(Type *type) {
+int Amd64FunctionWriter::getIntSizeForType(Type *type) {
     switch (type->getType()) {
         case DataType::Void: break;
         case DataType::I8: return 1;
@@ -567,4 +698,12 @@ int Amd64Writer::getIntSizeForType(Type *type) {
     return 0;
 }
 
+// The maps are shared between threads, so they are never added to. A missing entry falls
+// back to the first register.
+X86Reg Amd64FunctionWriter::getReg(const std::map<int, X86Reg> &map, int index) {
+    auto it = map.find(index);
+    if (it == map.end()) return X86Reg::AX;
+    return it->second;
+}
+
 } // end namespace LLIR
@@ -7,32 +7,86 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include "../llir.hpp"
+#include "../compact.hpp"
 #include "x86ir.hpp"
 
 namespace LLIR {
 
+class Amd64Writer;
+
+/*! \brief Lowers a single function to x86-64
+ *
+ * The function is lowered into a file fragment of its own. All of the per-function state lives
+ * here, so the functions of a module can be lowered on several threads at once.
+ */
+class Amd64FunctionWriter {
+public:
+    /*! \brief Creates a writer for one function
+     *
+     * @param writer The module writer, which provides the register maps
+     * @param func The function to lower
+     * @param index The position of the function in its module, which keeps its labels unique
+     */
+    explicit Amd64FunctionWriter(Amd64Writer *writer, Function *func, int index);
+    
+    /*! \brief Lowers the function
+     *
+     * @return The fragment holding the code of the function. The caller owns it.
+     */
+    X86File *compile();
+    
+    void compileInstruction(const CompactCursor &instr, std::string prefix);
+    X86Operand *compileOperand(CompactOperand src, Type *type, std::string prefix);
+protected:
+    std::string getSizeForType(Type *type);
+    int getIntSizeForType(Type *type);
+    X86Reg getReg(const std::map<int, X86Reg> &map, int index);
+    X86Operand *getScratch(Type *type);
+    void emitMove(X86Operand *dest, X86Operand *src, Type *type);
+    void emitReturn();
+    void saveRegisters(size_t pos);
+private:
+    Amd64Writer *writer;
+    Module *mod;
+    Function *func;
+    int index;
+    X86File *file;
+    
+    int stackPos = 0;
+    std::vector<int> memMap;
+    
+    // The registers the function writes, by X86Reg, and where each return starts, so the
+    // callee-saved ones can be saved and restored once the body is done
+    std::vector<bool> usedRegs;
+    std::vector<size_t> returns;
+    std::vector<std::string> labels;
+    CompactFunction *code = nullptr;
+};
+
+/*! \brief Generates x86-64 assembly for a module
+ *
+ * The functions are lowered in parallel (see parallelFor), and the fragments are joined in module
+ * order. The output is the same no matter how many threads are used.
+ */
 class Amd64Writer {
 public:
     explicit Amd64Writer(Module *mod);
     ~Amd64Writer();
     void compile();
-    void compileInstruction(Instruction *instr, std::string prefix);
-    X86Operand *compileOperand(Operand *src, Type *type, std::string prefix);
     void dump();
     void writeToFile();
     void writeToFile(std::string path);
     void build();
-protected:
-    std::string getSizeForType(Type *type);
-    int getIntSizeForType(Type *type);
 private:
+    friend class Amd64FunctionWriter;
+    
     Module *mod = nullptr;
     X86File *file;
     
-    int stackPos = 0;
-    std::map<std::string, int> memMap;
+    // These are only read once compile starts
     std::map<int, X86Reg> regMap;
     std::map<int, X86Reg> argRegMap;
 };
@@ -87,6 +87,7 @@ std::string X86Cmp::print() {
 }
 
 std::string X86IMul::print() {
+    if (dest == nullptr) return "imul " + op1->print() + ", " + op2->print();
     return "imul " + dest->print() + ", " + op1->print() + ", " + op2->print();
 }
 
@@ -163,6 +163,18 @@ public:
     void addData(X86Data *d) { data.push_back(d); }
     void addCode(X86Instr *c) { code.push_back(c); }
     
+    // Inserts an instruction before the one at a given position
+    void insertCode(size_t pos, X86Instr *c) { code.insert(code.begin() + pos, c); }
+    size_t getCodeSize() { return code.size(); }
+    
+    // Moves the contents of another file to the end of this one
+    void append(X86File *other) {
+        data.insert(data.end(), other->data.begin(), other->data.end());
+        code.insert(code.end(), other->code.begin(), other->code.end());
+        other->data.clear();
+        other->code.clear();
+    }
+    
     std::string print(AsmType type = AsmType::GAS);
 private:
     std::string name = "";
@@ -319,9 +331,15 @@ public:
         this->op2 = op2;
     }
     
+    // The two operand form, which multiplies op1 by op2 in place
+    explicit X86IMul(X86Operand *op1, X86Operand *op2) : X86Instr(X86Type::IMul) {
+        this->op1 = op1;
+        this->op2 = op2;
+    }
+    
     std::string print();
 private:
-    X86Operand *dest;
+    X86Operand *dest = nullptr;
 };
 
 // An IDIV instruction
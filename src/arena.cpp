@@ -0,0 +1,63 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <cstdint>
+#include <cstdlib>
+
+#include <arena.hpp>
+
+namespace LLIR {
+
+Arena::Arena(size_t slabSize) {
+    this->slabSize = slabSize;
+}
+
+// Run the destructors newest-first, since later objects may refer to earlier ones
+Arena::~Arena() {
+    for (auto it = dtors.rbegin(); it != dtors.rend(); it++) {
+        it->fn(it->obj);
+    }
+    for (char *slab : slabs) {
+        free(slab);
+    }
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+    // Oversized requests get a slab of their own so we don't waste the rest of the current one
+    if (size + align > slabSize) {
+        char *slab = static_cast<char *>(malloc(size + align));
+        if (slab == nullptr) throw std::bad_alloc();
+        slabs.push_back(slab);
+        
+        bytesAllocated += size;
+        uintptr_t pos = reinterpret_cast<uintptr_t>(slab);
+        return reinterpret_cast<void *>((pos + align - 1) & ~(uintptr_t)(align - 1));
+    }
+    
+    uintptr_t pos = reinterpret_cast<uintptr_t>(current);
+    uintptr_t aligned = (pos + align - 1) & ~(uintptr_t)(align - 1);
+    
+    if (current == nullptr || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+        newSlab();
+        pos = reinterpret_cast<uintptr_t>(current);
+        aligned = (pos + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    
+    current = reinterpret_cast<char *>(aligned + size);
+    bytesAllocated += size;
+    return reinterpret_cast<void *>(aligned);
+}
+
+void Arena::newSlab() {
+    char *slab = static_cast<char *>(malloc(slabSize));
+    if (slab == nullptr) throw std::bad_alloc();
+    slabs.push_back(slab);
+    
+    current = slab;
+    end = slab + slabSize;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,90 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace LLIR {
+
+/*! \brief A bump-pointer allocator for IR objects
+ *
+ * Every object created through an arena lives until the arena itself is destroyed, at which
+ * point all of the objects are released at once. Memory is carved out of large slabs, so creating
+ * an object is usually just a pointer increment. Objects with non-trivial destructors are recorded,
+ * and their destructors are run (in reverse order of creation) when the arena is destroyed.
+ *
+ * Objects allocated from an arena must never be freed with delete.
+ */
+class Arena {
+public:
+    /*! \brief Creates a new arena
+     *
+     * @param slabSize The size of each memory slab in bytes
+     */
+    explicit Arena(size_t slabSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /*! \brief Allocates raw, uninitialized memory from the arena
+     *
+     * @param size The number of bytes to allocate
+     * @param align The required alignment of the memory
+     */
+    void *allocate(size_t size, size_t align);
+
+    /*! \brief Constructs a new object inside the arena
+     *
+     * The arguments are forwarded to the constructor of the object. The object is owned by
+     * the arena, and will be destroyed along with it.
+     */
+    template <class T, class... Args>
+    T *create(Args&&... args) {
+        void *mem = allocate(sizeof(T), alignof(T));
+        T *obj = new (mem) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            dtors.push_back({ obj, &destroy<T> });
+        }
+        return obj;
+    }
+
+    /*! \brief Returns the number of bytes handed out by the arena
+     *
+     */
+    size_t getBytesAllocated() { return bytesAllocated; }
+
+    /*! \brief Returns the number of slabs reserved by the arena
+     *
+     */
+    size_t getSlabCount() { return slabs.size(); }
+private:
+    struct Destructor {
+        void *obj;
+        void (*fn)(void *);
+    };
+
+    template <class T>
+    static void destroy(void *obj) {
+        static_cast<T *>(obj)->~T();
+    }
+
+    void newSlab();
+
+    size_t slabSize = 0;
+    size_t bytesAllocated = 0;
+    char *current = nullptr;
+    char *end = nullptr;
+    std::vector<char *> slabs;
+    std::vector<Destructor> dtors;
+};
+
+} // end namespace LLIR
+
@@ -0,0 +1,131 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "../llir.hpp"
+
+namespace LLIR {
+
+// The first four bytes of every bitcode file
+const char BITCODE_MAGIC[4] = { 'L', 'L', 'B', 'C' };
+const uint32_t BITCODE_VERSION = 2;
+
+/*! \brief Serializes a module to the binary bitcode format
+ *
+ * The format is a flat byte stream. Integers are stored as LEB128 varints, and every name in the
+ * module is stored once in a string table and referred to by index. The layout is:
+ *
+ *   magic, version, module name
+ *   string table:      count, then (length, bytes) for each string
+ *   type table:        count, then each type; pointer and structure types refer to earlier entries
+ *   string constants:  count, then (name, value) for each
+ *   function table:    count, then for each function its name, linkage, type, arguments, the names
+ *                      of its argument registers, and the offset and size of its body
+ *   bodies:            the function bodies, back to back
+ *
+ * Bodies are self-contained and located through the function table, so a reader can decode any one
+ * of them without looking at the others.
+ */
+class BitcodeWriter {
+public:
+    explicit BitcodeWriter(Module *mod);
+
+    /*! \brief Encodes the module
+     *
+     * This must be called before the buffer is retrieved or written.
+     */
+    void write();
+
+    /*! \brief Returns the encoded bytes
+     *
+     */
+    const std::vector<uint8_t> &getBuffer() { return buffer; }
+
+    /*! \brief Writes the encoded bytes to a file
+     *
+     * @return False if the file could not be written
+     */
+    bool writeToFile(std::string path);
+private:
+    void writeBody(Function *func, std::vector<uint8_t> &out);
+    void writeInstruction(Instruction *instr, std::vector<uint8_t> &out);
+    void writeOperand(Operand *op, std::vector<uint8_t> &out);
+
+    void collectType(Type *type);
+    int getTypeRef(Type *type);
+    int getRegNameRef(Reg *reg);
+    int getStringIndex(Symbol sym);
+
+    Module *mod = nullptr;
+    std::vector<uint8_t> buffer;
+
+    std::vector<Symbol> strings;
+    std::unordered_map<Symbol, int> stringMap;
+    std::vector<Type *> types;
+    std::unordered_map<Type *, int> typeMap;
+};
+
+class ModuleDecoder;
+
+/*! \brief Loads a module from the binary bitcode format
+ *
+ * The reader decodes directly out of the file's memory mapping, so the only copies made are the
+ * strings going into the module's string table.
+ *
+ * A module can also be read lazily. Then only the tables and a stub for each function are decoded,
+ * and the body of a function is decoded the first time it is used (see Materializer).
+ */
+class BitcodeReader {
+public:
+    /*! \brief Maps a bitcode file into memory
+     *
+     * If the file cannot be opened, read will report the error.
+     */
+    explicit BitcodeReader(std::string path);
+
+    /*! \brief Reads bitcode from a buffer in memory
+     *
+     * The buffer is not copied, and must stay alive until reading is done.
+     */
+    explicit BitcodeReader(const uint8_t *data, size_t size);
+    ~BitcodeReader();
+
+    /*! \brief Decodes the module
+     *
+     * @return The new module, or nullptr if the bitcode is invalid. The caller owns the module.
+     */
+    Module *read();
+
+    /*! \brief Decodes the module, leaving every function as a stub
+     *
+     * The module keeps the file mapping until it is destroyed, so the reader may be deleted. When
+     * reading from a buffer in memory, the buffer must outlive the module.
+     *
+     * @return The new module, or nullptr if the bitcode is invalid. The caller owns the module.
+     */
+    Module *readLazy();
+
+    /*! \brief Returns true if a buffer starts with the bitcode magic
+     *
+     */
+    static bool isBitcode(const uint8_t *data, size_t size);
+    static bool isBitcodeFile(std::string path);
+private:
+    ModuleDecoder *open();
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string path = "";
+};
+
+} // end namespace LLIR
+
@@ -0,0 +1,475 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bitcode/bitcode.hpp>
+
+namespace LLIR {
+
+//
+// A bounds-checked view of the bytes being decoded. Reading past the end, or finding a
+// malformed value, marks the stream as failed and returns zero from then on.
+//
+struct BitcodeStream {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool failed = false;
+
+    BitcodeStream(const uint8_t *pos, const uint8_t *end) {
+        this->pos = pos;
+        this->end = end;
+    }
+
+    uint64_t readVarint() {
+        uint64_t val = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= end) {
+                failed = true;
+                return 0;
+            }
+            uint8_t byte = *pos++;
+            val |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return val;
+        }
+        failed = true;
+        return 0;
+    }
+
+    int64_t readSigned() {
+        uint64_t val = readVarint();
+        return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+    // Checks that a count or index is below a limit
+    uint64_t readIndex(uint64_t limit) {
+        uint64_t val = readVarint();
+        if (val >= limit) {
+            failed = true;
+            return 0;
+        }
+        return val;
+    }
+
+    const uint8_t *readBytes(size_t length) {
+        if ((size_t)(end - pos) < length) {
+            failed = true;
+            return pos;
+        }
+        const uint8_t *start = pos;
+        pos += length;
+        return start;
+    }
+};
+
+//
+// Decodes a module. The tables and a stub for every function are built up front. The
+// decoder then stays with the module as its materializer, and decodes each body the
+// first time it is needed.
+//
+class ModuleDecoder : public Materializer {
+public:
+    explicit ModuleDecoder(const uint8_t *data, size_t size) {
+        this->data = data;
+        this->size = size;
+    }
+
+    ~ModuleDecoder() {
+        if (ownsMapping) munmap(const_cast<uint8_t *>(data), size);
+    }
+
+    Module *decode();
+    bool materialize(Function *func);
+
+    // The mapping is released along with the decoder
+    void takeMapping() { ownsMapping = true; }
+    bool hasFailed() { return failed; }
+private:
+    // Where to find the body of a stub, and the registers created along with it
+    struct Stub {
+        uint64_t offset;
+        uint64_t size;
+        std::vector<Reg *> regs;
+    };
+
+    bool readStrings(BitcodeStream &in);
+    bool readTypes(BitcodeStream &in);
+    bool readFunction(BitcodeStream &in);
+    bool readBody(Function *func, std::vector<Reg *> &regs, BitcodeStream &body);
+    Operand *readOperand(BitcodeStream &body, std::vector<Reg *> &regs);
+
+    Symbol readSymbol(BitcodeStream &s);
+    Type *readType(BitcodeStream &s);
+
+    const uint8_t *data;
+    size_t size;
+    bool ownsMapping = false;
+    bool failed = false;
+
+    Module *mod = nullptr;
+    Arena *arena = nullptr;
+    std::vector<Symbol> strings;
+    std::vector<Type *> types;
+    std::unordered_map<Function *, Stub> stubs;
+    const uint8_t *bodies = nullptr;
+};
+
+Module *ModuleDecoder::decode() {
+    BitcodeStream in(data, data + size);
+    in.readBytes(4);
+    if (in.readVarint() != BITCODE_VERSION) return nullptr;
+
+    uint64_t nameLength = in.readVarint();
+    const uint8_t *name = in.readBytes(nameLength);
+    if (in.failed) return nullptr;
+
+    mod = new Module(std::string(reinterpret_cast<const char *>(name), nameLength));
+    arena = mod->getArena();
+
+    if (!readStrings(in) || !readTypes(in)) {
+        delete mod;
+        return nullptr;
+    }
+
+    uint64_t stringCount = in.readVarint();
+    for (uint64_t i = 0; i<stringCount && !in.failed; i++) {
+        Symbol name = readSymbol(in);
+        Symbol val = readSymbol(in);
+        mod->addStringPtr(arena->create<StringPtr>(name, val));
+    }
+
+    uint64_t funcCount = in.readVarint();
+    for (uint64_t i = 0; i<funcCount && !in.failed; i++) {
+        if (!readFunction(in)) in.failed = true;
+    }
+
+    // Everything after the function table is the body section
+    bodies = in.pos;
+    uint64_t bodySize = in.end - in.pos;
+    for (auto &entry : stubs) {
+        if (entry.second.offset > bodySize || entry.second.size > bodySize - entry.second.offset) {
+            in.failed = true;
+        }
+    }
+
+    if (in.failed) {
+        delete mod;
+        return nullptr;
+    }
+    return mod;
+}
+
+bool ModuleDecoder::materialize(Function *func) {
+    auto it = stubs.find(func);
+    if (it == stubs.end()) return false;
+
+    const uint8_t *start = bodies + it->second.offset;
+    BitcodeStream body(start, start + it->second.size);
+    std::vector<Reg *> regs = std::move(it->second.regs);
+    stubs.erase(it);
+
+    // Registers are created in order, so they get back their original IDs
+    uint64_t regCount = body.readVarint();
+    if (regCount < regs.size()) body.failed = true;
+    for (uint64_t i = regs.size(); i<regCount && !body.failed; i++) {
+        uint64_t ref = body.readIndex(strings.size() + 1);
+        if (ref == 0) regs.push_back(func->createReg());
+        else regs.push_back(func->createReg(strings[ref - 1].str()));
+    }
+
+    if (body.failed || !readBody(func, regs, body)) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+// The strings are copied straight out of the mapping into the module's table
+bool ModuleDecoder::readStrings(BitcodeStream &in) {
+    uint64_t count = in.readVarint();
+    for (uint64_t i = 0; i<count && !in.failed; i++) {
+        uint64_t length = in.readVarint();
+        const uint8_t *bytes = in.readBytes(length);
+        if (in.failed) break;
+        strings.push_back(mod->intern(std::string(reinterpret_cast<const char *>(bytes), length)));
+    }
+    return !in.failed;
+}
+
+bool ModuleDecoder::readTypes(BitcodeStream &in) {
+    TypeContext *context = mod->getTypeContext();
+    uint64_t count = in.readVarint();
+    for (uint64_t i = 0; i<count && !in.failed; i++) {
+        uint64_t kind = in.readIndex((int)DataType::Struct + 1);
+        Type *type = nullptr;
+        switch ((DataType)kind) {
+            case DataType::Ptr: {
+                Type *base = readType(in);
+                if (base == nullptr) return false;
+                type = context->getPointerType(base);
+            } break;
+
+            case DataType::Struct: {
+                Symbol name = readSymbol(in);
+                uint64_t elementCount = in.readVarint();
+                std::vector<Type *> elements;
+                for (uint64_t j = 0; j<elementCount && !in.failed; j++) {
+                    Type *element = readType(in);
+                    if (element == nullptr) return false;
+                    elements.push_back(element);
+                }
+                type = context->getStructType(name.str(), elements);
+            } break;
+
+            default: type = TypeContext::getType((DataType)kind);
+        }
+        types.push_back(type);
+    }
+    return !in.failed;
+}
+
+Symbol ModuleDecoder::readSymbol(BitcodeStream &s) {
+    uint64_t index = s.readIndex(strings.size());
+    if (s.failed) return Symbol();
+    return strings[index];
+}
+
+// A type reference of zero means no type
+Type *ModuleDecoder::readType(BitcodeStream &s) {
+    uint64_t ref = s.readIndex(types.size() + 1);
+    if (ref == 0) return nullptr;
+    return types[ref - 1];
+}
+
+// Creates the stub of a function. Its body is only located here, not decoded.
+bool ModuleDecoder::readFunction(BitcodeStream &in) {
+    Symbol name = readSymbol(in);
+    uint64_t linkage = in.readIndex((int)Linkage::Extern + 1);
+    Type *dataType = readType(in);
+    if (in.failed) return false;
+
+    Function *func = Function::Create(mod, name.str(), (Linkage)linkage, dataType);
+
+    std::vector<Type *> argTypes;
+    std::vector<uint64_t> argRegs;
+    uint64_t argCount = in.readVarint();
+    for (uint64_t i = 0; i<argCount && !in.failed; i++) {
+        argTypes.push_back(readType(in));
+        argRegs.push_back(in.readVarint());
+    }
+
+    // The stub gets the registers up to its last argument
+    Stub stub;
+    uint64_t regCount = in.readVarint();
+    for (uint64_t i = 0; i<regCount && !in.failed; i++) {
+        uint64_t ref = in.readIndex(strings.size() + 1);
+        if (ref == 0) stub.regs.push_back(func->createReg());
+        else stub.regs.push_back(func->createReg(strings[ref - 1].str()));
+    }
+
+    for (uint64_t i = 0; i<argRegs.size(); i++) {
+        if (argRegs[i] >= stub.regs.size()) return false;
+        func->addArgPair(argTypes[i], stub.regs[argRegs[i]]);
+    }
+
+    stub.offset = in.readVarint();
+    stub.size = in.readVarint();
+    if (in.failed) return false;
+
+    stubs[func] = std::move(stub);
+    func->setMaterializer(this);
+    mod->addFunction(func);
+    return true;
+}
+
+bool ModuleDecoder::readBody(Function *func, std::vector<Reg *> &regs, BitcodeStream &body) {
+    uint64_t blockCount = body.readVarint();
+    for (uint64_t i = 0; i<blockCount && !body.failed; i++) {
+        Block *block = Block::Create(func, readSymbol(body).str());
+        func->addBlock(block);
+
+        uint64_t instrCount = body.readVarint();
+        for (uint64_t j = 0; j<instrCount && !body.failed; j++) {
+            InstrType type = (InstrType)body.readIndex((int)InstrType::Copy + 1);
+            Type *dataType = readType(body);
+            Operand *dest = readOperand(body, regs);
+
+            Instruction *instr;
+            if (type == InstrType::Call) {
+                Symbol callee = readSymbol(body);
+                std::vector<Operand *> args;
+                uint64_t argCount = body.readVarint();
+                for (uint64_t k = 0; k<argCount && !body.failed; k++) {
+                    args.push_back(readOperand(body, regs));
+                }
+                instr = arena->create<FunctionCall>(callee, args);
+            } else if (type == InstrType::Phi) {
+                PhiNode *phi = arena->create<PhiNode>();
+                uint64_t count = body.readVarint();
+                if (count % 2) return false;
+                for (uint64_t k = 0; k<count && !body.failed; k += 2) {
+                    Operand *value = readOperand(body, regs);
+                    Operand *label = readOperand(body, regs);
+                    if (label == nullptr || label->getType() != OpType::Label) return false;
+                    phi->addIncoming(value, static_cast<Label *>(label));
+                }
+                instr = phi;
+            } else {
+                instr = arena->create<Instruction>(type);
+                uint64_t srcCount = body.readIndex(4);
+                if (srcCount > 0) instr->setOperand1(readOperand(body, regs));
+                if (srcCount > 1) instr->setOperand2(readOperand(body, regs));
+                if (srcCount > 2) instr->setOperand3(readOperand(body, regs));
+            }
+
+            instr->setDataType(dataType);
+            if (dest) instr->setDest(dest);
+            block->addInstruction(instr);
+        }
+    }
+
+    return !body.failed && body.pos == body.end;
+}
+
+Operand *ModuleDecoder::readOperand(BitcodeStream &body, std::vector<Reg *> &regs) {
+    OpType kind = (OpType)body.readIndex((int)OpType::PReg + 1);
+    switch (kind) {
+        case OpType::None: return nullptr;
+        case OpType::Imm: return arena->create<Imm>(body.readSigned());
+        case OpType::Reg: {
+            uint64_t id = body.readIndex(regs.size());
+            if (body.failed) return nullptr;
+            return regs[id];
+        }
+        case OpType::Label: return arena->create<Label>(readSymbol(body));
+
+        // String constants refer back to the module's copy where there is one
+        case OpType::String: {
+            Symbol name = readSymbol(body);
+            Symbol val = readSymbol(body);
+            StringPtr *str = mod->getStringByName(name);
+            if (str && str->getValue() == val) return str;
+            return arena->create<StringPtr>(name, val);
+        }
+
+        case OpType::Mem: return arena->create<Mem>(body.readVarint());
+        case OpType::HReg: return arena->create<HReg>(body.readSigned());
+        case OpType::AReg: return arena->create<AReg>(body.readSigned());
+        case OpType::PReg: return arena->create<PReg>(body.readSigned());
+    }
+
+    return nullptr;
+}
+
+//
+// The reader
+//
+BitcodeReader::BitcodeReader(std::string path) {
+    this->path = path;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(map);
+            size = info.st_size;
+            mapped = true;
+        }
+    }
+    close(fd);
+}
+
+BitcodeReader::BitcodeReader(const uint8_t *data, size_t size) {
+    this->data = data;
+    this->size = size;
+}
+
+BitcodeReader::~BitcodeReader() {
+    if (mapped) munmap(const_cast<uint8_t *>(data), size);
+}
+
+// Reading the whole module is a lazy read with every body materialized right away
+Module *BitcodeReader::read() {
+    ModuleDecoder *decoder = open();
+    if (decoder == nullptr) return nullptr;
+
+    Module *mod = decoder->decode();
+    if (mod == nullptr) {
+        std::cerr << "Error: Invalid or corrupt bitcode." << std::endl;
+        delete decoder;
+        return nullptr;
+    }
+
+    mod->setMaterializer(decoder);
+    mod->materializeAll();
+    bool failed = decoder->hasFailed();
+    mod->setMaterializer(nullptr);
+
+    if (failed) {
+        std::cerr << "Error: Invalid or corrupt bitcode." << std::endl;
+        delete mod;
+        return nullptr;
+    }
+    return mod;
+}
+
+Module *BitcodeReader::readLazy() {
+    ModuleDecoder *decoder = open();
+    if (decoder == nullptr) return nullptr;
+
+    Module *mod = decoder->decode();
+    if (mod == nullptr) {
+        std::cerr << "Error: Invalid or corrupt bitcode." << std::endl;
+        delete decoder;
+        return nullptr;
+    }
+
+    // The module now needs the mapping for as long as it has stubs
+    if (mapped) {
+        decoder->takeMapping();
+        mapped = false;
+    }
+    mod->setMaterializer(decoder);
+    return mod;
+}
+
+ModuleDecoder *BitcodeReader::open() {
+    if (data == nullptr) {
+        std::cerr << "Error: Unable to open bitcode file: " << path << std::endl;
+        return nullptr;
+    }
+
+    if (!isBitcode(data, size)) {
+        std::cerr << "Error: Not a bitcode file." << std::endl;
+        return nullptr;
+    }
+
+    return new ModuleDecoder(data, size);
+}
+
+bool BitcodeReader::isBitcode(const uint8_t *data, size_t size) {
+    return size >= 4 && memcmp(data, BITCODE_MAGIC, 4) == 0;
+}
+
+bool BitcodeReader::isBitcodeFile(std::string path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    uint8_t magic[4];
+    bool result = ::read(fd, magic, 4) == 4 && isBitcode(magic, 4);
+    close(fd);
+    return result;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,262 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <fstream>
+
+#include <bitcode/bitcode.hpp>
+
+namespace LLIR {
+
+//
+// Encoding helpers
+//
+static void writeVarint(std::vector<uint8_t> &out, uint64_t val) {
+    do {
+        uint8_t byte = val & 0x7F;
+        val >>= 7;
+        if (val != 0) byte |= 0x80;
+        out.push_back(byte);
+    } while (val != 0);
+}
+
+// Signed values are zigzag encoded so small negative numbers stay small
+static void writeSigned(std::vector<uint8_t> &out, int64_t val) {
+    writeVarint(out, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+static void writeString(std::vector<uint8_t> &out, const std::string &str) {
+    writeVarint(out, str.length());
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+//
+// The writer
+//
+BitcodeWriter::BitcodeWriter(Module *mod) {
+    this->mod = mod;
+}
+
+// The tables are only complete once everything else is encoded, so the rest of the
+// module is encoded into separate buffers which are appended at the end
+void BitcodeWriter::write() {
+    buffer.clear();
+    strings.clear();
+    stringMap.clear();
+    types.clear();
+    typeMap.clear();
+
+    std::vector<uint8_t> table;
+    writeVarint(table, mod->getStringCount());
+    for (int i = 0; i<mod->getStringCount(); i++) {
+        StringPtr *str = mod->getString(i);
+        writeVarint(table, getStringIndex(str->getName()));
+        writeVarint(table, getStringIndex(str->getValue()));
+    }
+
+    // The function table holds everything needed to create a stub, plus the position
+    // of the body within the body section
+    std::vector<uint8_t> bodies;
+    writeVarint(table, mod->getFunctionCount());
+    for (int i = 0; i<mod->getFunctionCount(); i++) {
+        Function *func = mod->getFunction(i);
+
+        // Registers are recreated in ID order, so only their names are needed
+        std::vector<int> regNames(func->getRegCount(), 0);
+        for (int j = 0; j<func->getArgCount(); j++) {
+            Reg *reg = func->getArg(j);
+            regNames[reg->getID()] = getRegNameRef(reg);
+        }
+        for (Block *block : *func) {
+            for (Instruction *instr : *block) {
+                Operand *dest = instr->getDest();
+                if (dest && dest->getType() == OpType::Reg) {
+                    Reg *reg = static_cast<Reg *>(dest);
+                    regNames[reg->getID()] = getRegNameRef(reg);
+                }
+                for (int j = 0; j<instr->getOperandCount(); j++) {
+                    Operand *op = instr->getOperand(j);
+                    if (op && op->getType() == OpType::Reg) {
+                        Reg *reg = static_cast<Reg *>(op);
+                        regNames[reg->getID()] = getRegNameRef(reg);
+                    }
+                }
+            }
+        }
+
+        // A stub needs the registers up to the last argument; the body creates the rest
+        int stubRegs = 0;
+        for (int j = 0; j<func->getArgCount(); j++) {
+            int id = func->getArg(j)->getID();
+            if (id >= stubRegs) stubRegs = id + 1;
+        }
+
+        writeVarint(table, getStringIndex(func->getName()));
+        writeVarint(table, (int)func->getLinkage());
+        writeVarint(table, getTypeRef(func->getDataType()));
+
+        writeVarint(table, func->getArgCount());
+        for (int j = 0; j<func->getArgCount(); j++) {
+            writeVarint(table, getTypeRef(func->getArgType(j)));
+            writeVarint(table, func->getArg(j)->getID());
+        }
+
+        writeVarint(table, stubRegs);
+        for (int j = 0; j<stubRegs; j++) writeVarint(table, regNames[j]);
+
+        std::vector<uint8_t> funcBody;
+        writeVarint(funcBody, regNames.size());
+        for (int j = stubRegs; j<regNames.size(); j++) writeVarint(funcBody, regNames[j]);
+        writeBody(func, funcBody);
+
+        writeVarint(table, bodies.size());
+        writeVarint(table, funcBody.size());
+        bodies.insert(bodies.end(), funcBody.begin(), funcBody.end());
+    }
+
+    // Header
+    buffer.insert(buffer.end(), BITCODE_MAGIC, BITCODE_MAGIC + 4);
+    writeVarint(buffer, BITCODE_VERSION);
+    writeString(buffer, mod->getName());
+
+    writeVarint(buffer, strings.size());
+    for (Symbol sym : strings) writeString(buffer, sym.str());
+
+    writeVarint(buffer, types.size());
+    for (Type *type : types) {
+        writeVarint(buffer, (int)type->getType());
+        if (type->getType() == DataType::Ptr) {
+            PointerType *ptrType = static_cast<PointerType *>(type);
+            writeVarint(buffer, typeMap[ptrType->getBaseType()] + 1);
+        } else if (type->getType() == DataType::Struct) {
+            StructType *structType = static_cast<StructType *>(type);
+            writeVarint(buffer, stringMap[mod->intern(structType->getName())]);
+            writeVarint(buffer, structType->getElementTypes().size());
+            for (Type *element : structType->getElementTypes()) {
+                writeVarint(buffer, typeMap[element] + 1);
+            }
+        }
+    }
+
+    buffer.insert(buffer.end(), table.begin(), table.end());
+    buffer.insert(buffer.end(), bodies.begin(), bodies.end());
+}
+
+void BitcodeWriter::writeBody(Function *func, std::vector<uint8_t> &out) {
+    writeVarint(out, func->getBlockCount());
+    for (Block *block : *func) {
+        writeVarint(out, getStringIndex(block->getName()));
+        writeVarint(out, block->getInstrCount());
+        for (Instruction *instr : *block) {
+            writeInstruction(instr, out);
+        }
+    }
+}
+
+void BitcodeWriter::writeInstruction(Instruction *instr, std::vector<uint8_t> &out) {
+    writeVarint(out, (int)instr->getType());
+    writeVarint(out, getTypeRef(instr->getDataType()));
+    writeOperand(instr->getDest(), out);
+
+    if (instr->getType() == InstrType::Call) {
+        FunctionCall *fc = static_cast<FunctionCall *>(instr);
+        std::vector<Operand *> args = fc->getArgs();
+
+        writeVarint(out, getStringIndex(fc->getName()));
+        writeVarint(out, args.size());
+        for (Operand *arg : args) writeOperand(arg, out);
+        return;
+    }
+
+    // The incoming values and labels of a phi node are stored in pairs
+    if (instr->getType() == InstrType::Phi) {
+        writeVarint(out, instr->getOperandCount());
+        for (int i = 0; i<instr->getOperandCount(); i++) writeOperand(instr->getOperand(i), out);
+        return;
+    }
+
+    // Trailing empty sources are not stored
+    int count = 3;
+    while (count > 0 && instr->getOperand(count - 1) == nullptr) --count;
+
+    writeVarint(out, count);
+    for (int i = 0; i<count; i++) writeOperand(instr->getOperand(i), out);
+}
+
+void BitcodeWriter::writeOperand(Operand *op, std::vector<uint8_t> &out) {
+    if (op == nullptr) {
+        writeVarint(out, (int)OpType::None);
+        return;
+    }
+
+    writeVarint(out, (int)op->getType());
+    switch (op->getType()) {
+        case OpType::None: break;
+        case OpType::Imm: writeSigned(out, static_cast<Imm *>(op)->getValue()); break;
+        case OpType::Reg: writeVarint(out, static_cast<Reg *>(op)->getID()); break;
+        case OpType::Label: writeVarint(out, getStringIndex(static_cast<Label *>(op)->getName())); break;
+
+        case OpType::String: {
+            StringPtr *str = static_cast<StringPtr *>(op);
+            writeVarint(out, getStringIndex(str->getName()));
+            writeVarint(out, getStringIndex(str->getValue()));
+        } break;
+
+        case OpType::Mem: writeVarint(out, static_cast<Mem *>(op)->getID()); break;
+        case OpType::HReg: writeSigned(out, static_cast<HReg *>(op)->getNum()); break;
+        case OpType::AReg: writeSigned(out, static_cast<AReg *>(op)->getNum()); break;
+        case OpType::PReg: writeSigned(out, static_cast<PReg *>(op)->getNum()); break;
+    }
+}
+
+// Types are added after the types they refer to, so the reader can build them in order
+void BitcodeWriter::collectType(Type *type) {
+    if (typeMap.find(type) != typeMap.end()) return;
+
+    if (type->getType() == DataType::Ptr) {
+        collectType(static_cast<PointerType *>(type)->getBaseType());
+    } else if (type->getType() == DataType::Struct) {
+        StructType *structType = static_cast<StructType *>(type);
+        getStringIndex(mod->intern(structType->getName()));
+        for (Type *element : structType->getElementTypes()) collectType(element);
+    }
+
+    typeMap[type] = types.size();
+    types.push_back(type);
+}
+
+// Zero stands for no name; everything else is the string index plus one
+int BitcodeWriter::getRegNameRef(Reg *reg) {
+    std::string name = reg->getName();
+    if (name.empty()) return 0;
+    return getStringIndex(mod->intern(name)) + 1;
+}
+
+// Zero stands for no type; everything else is the table index plus one
+int BitcodeWriter::getTypeRef(Type *type) {
+    if (type == nullptr) return 0;
+    collectType(type);
+    return typeMap[type] + 1;
+}
+
+int BitcodeWriter::getStringIndex(Symbol sym) {
+    auto it = stringMap.find(sym);
+    if (it != stringMap.end()) return it->second;
+
+    int index = strings.size();
+    strings.push_back(sym);
+    stringMap[sym] = index;
+    return index;
+}
+
+bool BitcodeWriter::writeToFile(std::string path) {
+    std::ofstream writer(path, std::ios::binary);
+    if (!writer.is_open()) return false;
+    writer.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    writer.close();
+    return !writer.fail();
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,157 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace LLIR {
+
+/*! \brief A fixed-size set of small integers, stored as one bit each
+ *
+ * The set operations work a whole 64-bit word at a time, in plain loops the compiler can
+ * vectorize. Both sides of a set operation must have the same size.
+ */
+class BitVector {
+public:
+    BitVector() {}
+    explicit BitVector(size_t size) { resize(size); }
+
+    /*! \brief Changes the number of bits. New bits are clear.
+     *
+     */
+    void resize(size_t size) {
+        bits = size;
+        words.resize((size + 63) / 64, 0);
+        clearUnused();
+    }
+
+    size_t size() const { return bits; }
+
+    bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+    void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+    void reset(size_t i) { words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+    /*! \brief Clears every bit
+     *
+     */
+    void clear() {
+        for (uint64_t &word : words) word = 0;
+    }
+
+    /*! \brief Sets every bit
+     *
+     */
+    void setAll() {
+        for (uint64_t &word : words) word = ~uint64_t(0);
+        clearUnused();
+    }
+
+    /*! \brief Returns true if no bit is set
+     *
+     */
+    bool none() const {
+        for (uint64_t word : words) {
+            if (word) return false;
+        }
+        return true;
+    }
+
+    /*! \brief Returns the number of set bits
+     *
+     */
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t word : words) total += __builtin_popcountll(word);
+        return total;
+    }
+
+    /*! \brief Returns the first set bit at or after a position, or size() if there is none
+     *
+     * Loop over the set bits with:
+     *
+     *     for (size_t i = bv.findNext(0); i<bv.size(); i = bv.findNext(i + 1))
+     */
+    size_t findNext(size_t i) const {
+        if (i >= bits) return bits;
+
+        size_t w = i / 64;
+        uint64_t word = words[w] & (~uint64_t(0) << (i % 64));
+        while (true) {
+            if (word) return w * 64 + __builtin_ctzll(word);
+            if (++w == words.size()) return bits;
+            word = words[w];
+        }
+    }
+
+    /*! \brief Adds every bit of another set. Returns true if anything changed.
+     *
+     */
+    bool unionWith(const BitVector &other) {
+        uint64_t changed = 0;
+        for (size_t w = 0; w<words.size(); w++) {
+            uint64_t old = words[w];
+            words[w] |= other.words[w];
+            changed |= old ^ words[w];
+        }
+        return changed != 0;
+    }
+
+    /*! \brief Keeps only the bits that are also in another set. Returns true if anything changed.
+     *
+     */
+    bool intersectWith(const BitVector &other) {
+        uint64_t changed = 0;
+        for (size_t w = 0; w<words.size(); w++) {
+            uint64_t old = words[w];
+            words[w] &= other.words[w];
+            changed |= old ^ words[w];
+        }
+        return changed != 0;
+    }
+
+    /*! \brief Removes every bit of another set. Returns true if anything changed.
+     *
+     */
+    bool subtract(const BitVector &other) {
+        uint64_t changed = 0;
+        for (size_t w = 0; w<words.size(); w++) {
+            uint64_t old = words[w];
+            words[w] &= ~other.words[w];
+            changed |= old ^ words[w];
+        }
+        return changed != 0;
+    }
+
+    /*! \brief Sets this to (in - remove) | add in a single pass. Returns true if anything changed.
+     *
+     * This is the transfer function of most dataflow problems.
+     */
+    bool assignTransfer(const BitVector &in, const BitVector &remove, const BitVector &add) {
+        uint64_t changed = 0;
+        for (size_t w = 0; w<words.size(); w++) {
+            uint64_t old = words[w];
+            words[w] = (in.words[w] & ~remove.words[w]) | add.words[w];
+            changed |= old ^ words[w];
+        }
+        return changed != 0;
+    }
+
+    bool operator==(const BitVector &other) const { return bits == other.bits && words == other.words; }
+    bool operator!=(const BitVector &other) const { return !(*this == other); }
+private:
+    // The bits past the end of the last word are always clear, so whole words can be compared
+    void clearUnused() {
+        if (bits % 64) words.back() &= (uint64_t(1) << (bits % 64)) - 1;
+    }
+
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+};
+
+} // end namespace LLIR
+
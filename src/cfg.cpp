@@ -0,0 +1,190 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include <llir.hpp>
+
+namespace LLIR {
+
+//
+// Block edges
+//
+const std::vector<Block *> &Block::getSuccessors() {
+    if (succsDirty && parent) parent->computeSuccessors(this);
+    return succs;
+}
+
+// A predecessor can be any block, so all of them have to be up to date
+const std::vector<Block *> &Block::getPredecessors() {
+    if (parent) parent->updateCFG();
+    return preds;
+}
+
+//
+// Function control flow
+//
+
+// Blocks stay queued after they are removed; they are skipped once their parent changes
+void Function::invalidateSuccessors(Block *block) {
+    ordersValid = false;
+    if (block->succsDirty) return;
+
+    block->succsDirty = true;
+    dirtyBlocks.push_back(block);
+}
+
+// Control goes to every branch target up to the first terminator, and falls through
+// to the next block if there is no terminator. Anything after a terminator is dead.
+// An old successor may have been removed from the function, and its edges with it.
+void Function::computeSuccessors(Block *block) {
+    for (Block *succ : block->succs) {
+        auto edge = std::find(succ->preds.begin(), succ->preds.end(), block);
+        if (edge != succ->preds.end()) succ->preds.erase(edge);
+    }
+    block->succs.clear();
+
+    bool fallsThrough = true;
+    bool unresolved = false;
+    for (Instruction *instr : *block) {
+        Label *label = instr->getBranchLabel();
+        if (label) {
+            Block *target = getBlockByName(label->getName());
+            if (target == nullptr) unresolved = true;
+            else if (std::find(block->succs.begin(), block->succs.end(), target) == block->succs.end()) {
+                block->succs.push_back(target);
+            }
+        }
+
+        if (instr->isTerminator()) {
+            fallsThrough = false;
+            break;
+        }
+    }
+
+    Block *next = block->getNext();
+    if (fallsThrough && next && std::find(block->succs.begin(), block->succs.end(), next) == block->succs.end()) {
+        block->succs.push_back(next);
+    }
+
+    for (Block *succ : block->succs) succ->preds.push_back(block);
+    if (unresolved) unresolvedBlocks.push_back(block);
+    block->succsDirty = false;
+}
+
+void Function::updateCFG() {
+    requireBody();
+    for (size_t i = 0; i<dirtyBlocks.size(); i++) {
+        Block *block = dirtyBlocks[i];
+        if (block->getParent() == this && block->succsDirty) computeSuccessors(block);
+    }
+    dirtyBlocks.clear();
+}
+
+// An iterative depth-first search, so very long chains of blocks can't overflow the stack.
+// Block IDs are dense, so they index the visited set directly.
+const std::vector<Block *> &Function::getPostOrder() {
+    updateCFG();
+    if (ordersValid) return postOrder;
+
+    postOrder.clear();
+    Block *entry = blocks.front();
+    if (entry) {
+        std::vector<bool> visited(blockIDTable.size() + 1, false);
+        std::vector<std::pair<Block *, size_t>> stack;
+        visited[entry->getID()] = true;
+        stack.push_back({ entry, 0 });
+
+        while (!stack.empty()) {
+            Block *block = stack.back().first;
+            size_t next = stack.back().second;
+            if (next == block->succs.size()) {
+                postOrder.push_back(block);
+                stack.pop_back();
+                continue;
+            }
+
+            ++stack.back().second;
+            Block *succ = block->succs[next];
+            if (!visited[succ->getID()]) {
+                visited[succ->getID()] = true;
+                stack.push_back({ succ, 0 });
+            }
+        }
+    }
+
+    reversePostOrder.assign(postOrder.rbegin(), postOrder.rend());
+    ordersValid = true;
+    return postOrder;
+}
+
+const std::vector<Block *> &Function::getReversePostOrder() {
+    getPostOrder();
+    return reversePostOrder;
+}
+
+// Only a conditional branch followed by something other than more branches needs a split. The
+// new block starts at that first other instruction. The successors of the new block now see an
+// edge from it instead of the old block, or as well as it if the old block still branches there.
+bool Function::splitAtBranches() {
+    requireBody();
+    Arena *arena = mod->getArena();
+    bool changed = false;
+
+    for (Block *block = blocks.front(); block; block = block->getNext()) {
+        Instruction *first = nullptr;
+        bool branched = false;
+        for (Instruction *instr : *block) {
+            if (instr->isTerminator()) break;
+            if (instr->isBranch()) {
+                branched = true;
+            } else if (branched) {
+                first = instr;
+                break;
+            }
+        }
+        if (first == nullptr) continue;
+
+        std::string name;
+        int count = 1;
+        do {
+            name = block->getName().str() + "_" + std::to_string(count++);
+        } while (getBlockByName(name));
+
+        Block *rest = Block::Create(this, name);
+        addBlockAfter(block, rest);
+
+        Instruction *next = nullptr;
+        for (Instruction *instr = first; instr; instr = next) {
+            next = instr->getNext();
+            block->removeInstruction(instr);
+            rest->addInstruction(instr);
+        }
+
+        std::vector<Block *> blockSuccs = block->getSuccessors();
+        std::vector<Block *> restSuccs = rest->getSuccessors();
+        for (Block *succ : restSuccs) {
+            bool both = std::find(blockSuccs.begin(), blockSuccs.end(), succ) != blockSuccs.end();
+            for (Instruction *instr : *succ) {
+                if (instr->getType() != InstrType::Phi) break;
+
+                PhiNode *phi = static_cast<PhiNode *>(instr);
+                int index = phi->getIncomingIndex(block->getName());
+                if (index < 0) continue;
+                if (both) phi->addIncoming(phi->getIncomingValue(index), arena->create<Label>(rest->getName()));
+                else phi->setIncomingLabel(index, arena->create<Label>(rest->getName()));
+            }
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,171 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <compact.hpp>
+
+namespace LLIR {
+
+static_assert((int)CompactKind::PReg == (int)OpType::PReg, "CompactKind must line up with OpType");
+
+//
+// Encoding
+//
+CompactFunction::CompactFunction(Function *func) {
+    this->func = func;
+
+    // Blocks are numbered first, so forward branches can be resolved to a block index
+    for (Block *block : *func) {
+        blockMap.emplace(block->getName(), blockNames.size());
+        blockNames.push_back(block->getName());
+    }
+
+    for (Block *block : *func) {
+        blockStart.push_back(opcodes.size());
+        for (Instruction *instr : *block) {
+            encodeInstruction(instr);
+        }
+    }
+
+    blockStart.push_back(opcodes.size());
+    operandStart.push_back(kinds.size());
+
+    // The lookup maps are only needed while encoding
+    std::unordered_map<Type *, int>().swap(typeMap);
+    std::unordered_map<Symbol, int>().swap(symbolMap);
+    std::unordered_map<Symbol, int>().swap(blockMap);
+}
+
+void CompactFunction::encodeInstruction(Instruction *instr) {
+    opcodes.push_back((uint8_t)instr->getType());
+    typeIndexes.push_back(getTypeIndex(instr->getDataType()));
+    operandStart.push_back(kinds.size());
+
+    encodeOperand(instr->getDest());
+
+    if (instr->getType() == InstrType::Call) {
+        FunctionCall *fc = static_cast<FunctionCall *>(instr);
+        kinds.push_back(CompactKind::Symbol);
+        values.push_back(getSymbolIndex(fc->getName()));
+
+        for (Operand *arg : fc->getArgs()) encodeOperand(arg);
+        return;
+    }
+
+    // Trailing empty sources are not stored
+    int count = 3;
+    while (count > 0 && instr->getOperand(count - 1) == nullptr) --count;
+    for (int i = 0; i<count; i++) encodeOperand(instr->getOperand(i));
+}
+
+void CompactFunction::encodeOperand(Operand *op) {
+    if (op == nullptr) {
+        kinds.push_back(CompactKind::None);
+        values.push_back(0);
+        return;
+    }
+
+    switch (op->getType()) {
+        case OpType::None: {
+            kinds.push_back(CompactKind::None);
+            values.push_back(0);
+        } break;
+
+        case OpType::Imm: {
+            kinds.push_back(CompactKind::Imm);
+            values.push_back(static_cast<Imm *>(op)->getValue());
+        } break;
+
+        case OpType::Reg: {
+            kinds.push_back(CompactKind::Reg);
+            values.push_back(static_cast<Reg *>(op)->getID());
+        } break;
+
+        // Labels that don't name a block are kept by name
+        case OpType::Label: {
+            Symbol name = static_cast<Label *>(op)->getName();
+            auto it = blockMap.find(name);
+            if (it != blockMap.end()) {
+                kinds.push_back(CompactKind::Label);
+                values.push_back(it->second);
+            } else {
+                kinds.push_back(CompactKind::Symbol);
+                values.push_back(getSymbolIndex(name));
+            }
+        } break;
+
+        case OpType::String: {
+            kinds.push_back(CompactKind::String);
+            values.push_back(getSymbolIndex(static_cast<StringPtr *>(op)->getName()));
+        } break;
+
+        case OpType::Mem: {
+            kinds.push_back(CompactKind::Mem);
+            values.push_back(static_cast<Mem *>(op)->getID());
+        } break;
+
+        case OpType::HReg: {
+            kinds.push_back(CompactKind::HReg);
+            values.push_back(static_cast<HReg *>(op)->getNum());
+        } break;
+
+        case OpType::AReg: {
+            kinds.push_back(CompactKind::AReg);
+            values.push_back(static_cast<AReg *>(op)->getNum());
+        } break;
+
+        case OpType::PReg: {
+            kinds.push_back(CompactKind::PReg);
+            values.push_back(static_cast<PReg *>(op)->getNum());
+        } break;
+    }
+}
+
+int CompactFunction::getTypeIndex(Type *type) {
+    auto it = typeMap.find(type);
+    if (it != typeMap.end()) return it->second;
+
+    int index = types.size();
+    types.push_back(type);
+    typeMap[type] = index;
+    return index;
+}
+
+int CompactFunction::getSymbolIndex(Symbol sym) {
+    auto it = symbolMap.find(sym);
+    if (it != symbolMap.end()) return it->second;
+
+    int index = symbols.size();
+    symbols.push_back(sym);
+    symbolMap[sym] = index;
+    return index;
+}
+
+//
+// Access
+//
+CompactCursor CompactFunction::begin() const {
+    return CompactCursor(this, 0, opcodes.size());
+}
+
+CompactCursor CompactFunction::begin(int block) const {
+    return CompactCursor(this, blockStart[block], blockStart[block+1]);
+}
+
+size_t CompactFunction::getMemoryUsage() const {
+    size_t size = 0;
+    size += opcodes.capacity() * sizeof(uint8_t);
+    size += typeIndexes.capacity() * sizeof(uint32_t);
+    size += operandStart.capacity() * sizeof(uint32_t);
+    size += kinds.capacity() * sizeof(CompactKind);
+    size += values.capacity() * sizeof(int64_t);
+    size += blockStart.capacity() * sizeof(uint32_t);
+    size += blockNames.capacity() * sizeof(Symbol);
+    size += types.capacity() * sizeof(Type *);
+    size += symbols.capacity() * sizeof(Symbol);
+    return size;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,205 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llir.hpp"
+
+namespace LLIR {
+
+class CompactCursor;
+
+// Represents the kind of an encoded operand
+// The first values line up with OpType so operands can be converted with a cast
+enum class CompactKind : uint8_t {
+    None,
+
+    Imm,
+    Reg,
+    Label,       // The value is the index of the target block
+    String,      // The value is an index into the symbol table
+
+    Mem,
+    HReg,
+    AReg,
+    PReg,
+
+    Symbol       // A name that is not a block; the value is an index into the symbol table
+};
+
+/*! \brief A single encoded operand
+ *
+ * Operands are decoded into this small value type on access. Immediates, register numbers, and
+ * memory IDs are stored directly in the value; labels and names are stored as indexes.
+ */
+struct CompactOperand {
+    CompactKind kind = CompactKind::None;
+    int64_t value = 0;
+
+    CompactOperand() {}
+    CompactOperand(CompactKind kind, int64_t value) {
+        this->kind = kind;
+        this->value = value;
+    }
+};
+
+/*! \brief A compact, structure-of-arrays encoding of a function body
+ *
+ * Instead of one heap object per instruction and operand, the body is stored as a set of packed
+ * parallel arrays: one opcode and one type index per instruction, and one kind and one value per
+ * operand slot. Walking the body is a linear scan over a handful of arrays, which is much friendlier
+ * to the cache than chasing instruction and operand pointers.
+ *
+ * Every instruction has a destination slot (which may be None) followed by its sources. For function
+ * calls, the first source is the callee (a Symbol) and the rest are the arguments.
+ *
+ * The encoding is a snapshot: it does not change if the function is modified afterwards.
+ */
+class CompactFunction {
+public:
+    /*! \brief Encodes the body of a function
+     *
+     * @param func The function to encode
+     */
+    explicit CompactFunction(Function *func);
+
+    /*! \brief Returns the function this encoding was built from
+     *
+     */
+    Function *getFunction() { return func; }
+
+    /*! \brief Returns the number of instructions in the function
+     *
+     */
+    int getInstrCount() const { return opcodes.size(); }
+
+    /*! \brief Returns the number of blocks in the function
+     *
+     */
+    int getBlockCount() const { return blockNames.size(); }
+
+    /*! \brief Returns the name of a block
+     *
+     * @param block The index of the block, in layout order
+     */
+    Symbol getBlockName(int block) const { return blockNames[block]; }
+
+    /*! \brief Returns a symbol from the symbol table
+     *
+     */
+    Symbol getSymbol(int index) const { return symbols[index]; }
+
+    /*! \brief Returns a cursor over every instruction of the function
+     *
+     */
+    CompactCursor begin() const;
+
+    /*! \brief Returns a cursor over the instructions of a single block
+     *
+     * @param block The index of the block, in layout order
+     */
+    CompactCursor begin(int block) const;
+
+    /*! \brief Returns the number of bytes used by the encoding
+     *
+     */
+    size_t getMemoryUsage() const;
+private:
+    friend class CompactCursor;
+
+    void encodeInstruction(Instruction *instr);
+    void encodeOperand(Operand *op);
+    int getTypeIndex(Type *type);
+    int getSymbolIndex(Symbol sym);
+
+    Function *func = nullptr;
+
+    // Per instruction
+    std::vector<uint8_t> opcodes;
+    std::vector<uint32_t> typeIndexes;
+    std::vector<uint32_t> operandStart;
+
+    // Per operand slot
+    std::vector<CompactKind> kinds;
+    std::vector<int64_t> values;
+
+    // Per block; the start of each block is an instruction index
+    std::vector<uint32_t> blockStart;
+    std::vector<Symbol> blockNames;
+
+    // Tables referred to by index
+    std::vector<Type *> types;
+    std::vector<Symbol> symbols;
+    std::unordered_map<Type *, int> typeMap;
+    std::unordered_map<Symbol, int> symbolMap;
+    std::unordered_map<Symbol, int> blockMap;
+};
+
+/*! \brief A cursor over the instructions of a compact function
+ *
+ * The cursor is a plain position into the arrays, so it is cheap to copy. Slot 0 of an instruction
+ * is its destination, and slots 1 to 3 are its sources.
+ */
+class CompactCursor {
+public:
+    CompactCursor(const CompactFunction *code, uint32_t pos, uint32_t end) {
+        this->code = code;
+        this->pos = pos;
+        this->end = end;
+    }
+
+    /*! \brief Returns true once the cursor has moved past the last instruction
+     *
+     */
+    bool atEnd() const { return pos >= end; }
+
+    /*! \brief Moves to the next instruction
+     *
+     */
+    void next() { ++pos; }
+
+    /*! \brief Returns the index of the current instruction within the function
+     *
+     */
+    uint32_t getPosition() const { return pos; }
+
+    InstrType getType() const { return (InstrType)code->opcodes[pos]; }
+    Type *getDataType() const { return code->types[code->typeIndexes[pos]]; }
+
+    /*! \brief Returns the number of operand slots, including the destination
+     *
+     */
+    int getOperandCount() const { return code->operandStart[pos+1] - code->operandStart[pos]; }
+
+    /*! \brief Returns the operand in a given slot, or a None operand if the slot is empty
+     *
+     */
+    CompactOperand getOperand(int slot) const {
+        uint32_t index = code->operandStart[pos] + slot;
+        if (index >= code->operandStart[pos+1]) return CompactOperand();
+        return CompactOperand(code->kinds[index], code->values[index]);
+    }
+
+    CompactOperand getDest() const { return getOperand(0); }
+    CompactOperand getOperand1() const { return getOperand(1); }
+    CompactOperand getOperand2() const { return getOperand(2); }
+    CompactOperand getOperand3() const { return getOperand(3); }
+
+    /*! \brief Returns the symbol an operand refers to
+     *
+     * The operand must be a String or Symbol operand.
+     */
+    Symbol getSymbol(CompactOperand op) const { return code->symbols[op.value]; }
+private:
+    const CompactFunction *code;
+    uint32_t pos;
+    uint32_t end;
+};
+
+} // end namespace LLIR
+
@@ -0,0 +1,159 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <vector>
+
+#include "llir.hpp"
+#include "bitvector.hpp"
+
+namespace LLIR {
+
+/*! \brief Which way facts flow in a dataflow problem
+ *
+ */
+enum class Direction {
+    Forward,
+    Backward
+};
+
+/*! \brief How the facts coming in along several edges are combined
+ *
+ * Union is for problems about some path (such as liveness), and Intersect for problems about
+ * every path (such as available expressions).
+ */
+enum class Meet {
+    Union,
+    Intersect
+};
+
+/*! \brief Solves a dataflow problem over the blocks of a function
+ *
+ * The problem is a class of the form:
+ *
+ *     class MyProblem {
+ *     public:
+ *         typedef BitVector Value;
+ *         static const Direction direction = Direction::Forward;
+ *
+ *         // The value flowing into the entry block, or out of the exits of a backward problem
+ *         Value boundary();
+ *
+ *         // The value every other block starts from, before anything flows into it
+ *         Value initial();
+ *
+ *         // Combines the value flowing in along one more edge
+ *         void meet(Value &into, const Value &other);
+ *
+ *         // Computes what flows out of a block from what flows in. Returns true if output changed.
+ *         bool transfer(Block *block, const Value &input, Value &output);
+ *     };
+ *
+ * The values are returned by block ID: entries holds the value at the start of each block, and
+ * exits the value at the end, whichever the direction. The exits of a backward problem are the
+ * blocks without successors.
+ *
+ * The worklist is kept in reverse post-order for a forward problem and in post-order for a backward
+ * one, so a block normally comes after everything flowing into it. It is swept from front to back,
+ * and a block goes back on it only when one of its inputs changes. Unreachable blocks are still
+ * compiled, so they are solved as well, after the others.
+ */
+template <class Problem>
+void solveDataflow(Function *func, Problem &problem, std::vector<typename Problem::Value> &entries,
+                    std::vector<typename Problem::Value> &exits) {
+    const bool forward = Problem::direction == Direction::Forward;
+    size_t blockCount = func->getMaxBlockID() + 1;
+    entries.assign(blockCount, problem.initial());
+    exits.assign(blockCount, problem.initial());
+    if (func->getBlockCount() == 0) return;
+
+    std::vector<Block *> order = forward ? func->getReversePostOrder() : func->getPostOrder();
+    std::vector<int> position(blockCount, -1);
+    for (size_t i = 0; i<order.size(); i++) position[order[i]->getID()] = i;
+    for (Block *block : *func) {
+        if (position[block->getID()] >= 0) continue;
+        position[block->getID()] = order.size();
+        order.push_back(block);
+    }
+
+    std::vector<typename Problem::Value> &inputs = forward ? entries : exits;
+    std::vector<typename Problem::Value> &outputs = forward ? exits : entries;
+    Block *entry = func->getEntryBlock();
+
+    BitVector pending(order.size());
+    pending.setAll();
+    size_t pos = 0;
+    while (true) {
+        pos = pending.findNext(pos);
+        if (pos == order.size()) {
+            pos = pending.findNext(0);
+            if (pos == order.size()) break;
+        }
+        pending.reset(pos);
+
+        Block *block = order[pos];
+        const std::vector<Block *> &sources = forward ? block->getPredecessors() : block->getSuccessors();
+        const std::vector<Block *> &targets = forward ? block->getSuccessors() : block->getPredecessors();
+
+        typename Problem::Value &input = inputs[block->getID()];
+        size_t first = 0;
+        if (forward ? block == entry : sources.empty()) {
+            input = problem.boundary();
+        } else if (sources.empty()) {
+            input = problem.initial();
+        } else {
+            input = outputs[sources[0]->getID()];
+            first = 1;
+        }
+        for (size_t i = first; i<sources.size(); i++) problem.meet(input, outputs[sources[i]->getID()]);
+
+        if (!problem.transfer(block, input, outputs[block->getID()])) continue;
+        for (Block *target : targets) pending.set(position[target->getID()]);
+    }
+}
+
+/*! \brief A bitvector problem where each block removes some bits and adds others
+ *
+ * Fill in the gen and kill sets of each block, by block ID, then solve. What flows out of a block
+ * is (in - kill) | gen. The boundary is empty. The other blocks start empty for a union problem,
+ * and full for an intersection problem, so the loops don't lose anything on the first round.
+ */
+template <Direction dir, Meet meetKind>
+class GenKillProblem {
+public:
+    typedef BitVector Value;
+    static const Direction direction = dir;
+
+    GenKillProblem(Function *func, size_t bits) : bits(bits) {
+        gen.assign(func->getMaxBlockID() + 1, BitVector(bits));
+        kill.assign(func->getMaxBlockID() + 1, BitVector(bits));
+    }
+
+    Value boundary() { return BitVector(bits); }
+
+    Value initial() {
+        BitVector value(bits);
+        if (meetKind == Meet::Intersect) value.setAll();
+        return value;
+    }
+
+    void meet(Value &into, const Value &other) {
+        if (meetKind == Meet::Union) into.unionWith(other);
+        else into.intersectWith(other);
+    }
+
+    bool transfer(Block *block, const Value &input, Value &output) {
+        int id = block->getID();
+        return output.assignTransfer(input, kill[id], gen[id]);
+    }
+
+    std::vector<BitVector> gen;
+    std::vector<BitVector> kill;
+private:
+    size_t bits;
+};
+
+} // end namespace LLIR
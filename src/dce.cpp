@@ -0,0 +1,251 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+
+#include <dce.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+
+namespace LLIR {
+
+namespace {
+
+class Eliminator {
+public:
+    explicit Eliminator(Function *func) {
+        this->func = func;
+        this->arena = func->getModule()->getArena();
+    }
+
+    size_t removeUnreachable();
+    size_t removeDeadCode();
+    size_t removeEmpty();
+private:
+    void findDeadVars();
+    bool isRoot(Instruction *instr);
+    bool isDeadVar(Operand *ptr);
+
+    Function *func;
+    Arena *arena;
+
+    // The allocas that are only ever stored to, by register ID
+    std::vector<bool> deadVars;
+};
+
+// The phi nodes of the blocks that are left lose the values from the removed ones
+size_t Eliminator::removeUnreachable() {
+    std::vector<bool> reached(func->getMaxBlockID() + 1, false);
+    std::vector<Block *> worklist;
+    reached[func->getEntryBlock()->getID()] = true;
+    worklist.push_back(func->getEntryBlock());
+
+    while (!worklist.empty()) {
+        Block *block = worklist.back();
+        worklist.pop_back();
+        for (Block *succ : block->getSuccessors()) {
+            if (reached[succ->getID()]) continue;
+            reached[succ->getID()] = true;
+            worklist.push_back(succ);
+        }
+    }
+
+    std::vector<Block *> dead;
+    for (Block *block : *func) {
+        if (!reached[block->getID()]) dead.push_back(block);
+    }
+    if (dead.empty()) return 0;
+
+    for (Block *block : dead) {
+        for (Instruction *instr : *block) instr->dropAllReferences();
+    }
+    for (Block *block : dead) func->removeBlock(block);
+
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (instr->getType() != InstrType::Phi) continue;
+
+            PhiNode *phi = static_cast<PhiNode *>(instr);
+            for (int i = phi->getIncomingCount() - 1; i >= 0; i--) {
+                Block *pred = func->getBlockByName(phi->getIncomingLabel(i)->getName());
+                if (pred == nullptr || pred->getParent() == nullptr) phi->removeIncoming(i);
+            }
+        }
+    }
+    return dead.size();
+}
+
+// Everything an instruction with a side effect uses is live. The registers are followed back to
+// their definitions, and arguments have none.
+size_t Eliminator::removeDeadCode() {
+    findDeadVars();
+
+    std::vector<Instruction *> defs(func->getRegCount(), nullptr);
+    std::vector<Instruction *> worklist;
+    std::vector<bool> live(func->getRegCount(), false);
+
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            Operand *dest = instr->getDest();
+            if (dest && dest->getType() == OpType::Reg) defs[static_cast<Reg *>(dest)->getID()] = instr;
+        }
+    }
+
+    auto mark = [&](Instruction *instr) {
+        for (int i = 0; i<instr->getOperandCount(); i++) {
+            Operand *op = instr->getOperandUse(i)->get();
+            if (op == nullptr || op->getType() != OpType::Reg) continue;
+
+            int id = static_cast<Reg *>(op)->getID();
+            if (id >= (int)defs.size() || live[id] || defs[id] == nullptr) continue;
+            live[id] = true;
+            worklist.push_back(defs[id]);
+        }
+    };
+
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (isRoot(instr)) mark(instr);
+        }
+    }
+    while (!worklist.empty()) {
+        Instruction *instr = worklist.back();
+        worklist.pop_back();
+        mark(instr);
+    }
+
+    // A root may define a register that nobody reads, such as the one of a branch
+    size_t count = 0;
+    for (Block *block : *func) {
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            Operand *dest = instr->getDest();
+            if (dest && dest->getType() == OpType::Reg && live[static_cast<Reg *>(dest)->getID()]) continue;
+            if (isRoot(instr)) continue;
+
+            instr->eraseFromParent();
+            ++count;
+        }
+    }
+    return count;
+}
+
+// A local variable that is only ever written holds nothing anyone can see
+void Eliminator::findDeadVars() {
+    deadVars.assign(func->getRegCount(), false);
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (instr->getType() != InstrType::Alloca) continue;
+
+            Operand *ptr = instr->getDest();
+            bool dead = true;
+            for (Use *use : ptr->getUses()) {
+                if (use->getUser()->getType() != InstrType::Store || use->getOperandNo() != 1) {
+                    dead = false;
+                    break;
+                }
+            }
+            if (dead) deadVars[static_cast<Reg *>(ptr)->getID()] = true;
+        }
+    }
+}
+
+bool Eliminator::isDeadVar(Operand *ptr) {
+    if (ptr == nullptr || ptr->getType() != OpType::Reg) return false;
+    int id = static_cast<Reg *>(ptr)->getID();
+    return id < (int)deadVars.size() && deadVars[id];
+}
+
+// A division traps if its divisor is zero, so it is only dead if the divisor is known not to be
+bool Eliminator::isRoot(Instruction *instr) {
+    switch (instr->getType()) {
+        case InstrType::Ret:
+        case InstrType::RetVoid:
+        case InstrType::Br:
+        case InstrType::Beq:
+        case InstrType::Bne:
+        case InstrType::Bgt:
+        case InstrType::Blt:
+        case InstrType::Bge:
+        case InstrType::Ble:
+        case InstrType::Call:
+        case InstrType::StructStore: return true;
+
+        case InstrType::Store: return !isDeadVar(instr->getOperand2());
+
+        case InstrType::SDiv:
+        case InstrType::UDiv:
+        case InstrType::SRem:
+        case InstrType::URem: {
+            Operand *divisor = instr->getOperand2();
+            return divisor == nullptr || divisor->getType() != OpType::Imm || static_cast<Imm *>(divisor)->getValue() == 0;
+        }
+
+        default: {}
+    }
+    return false;
+}
+
+// Control reaches an empty block only to fall through it, so the branches to it can go to the next
+// block directly. The entry block stays, and so does a last block, which has nowhere to fall.
+size_t Eliminator::removeEmpty() {
+    size_t count = 0;
+    Block *next = nullptr;
+    for (Block *block = func->getEntryBlock()->getNext(); block; block = next) {
+        next = block->getNext();
+        if (block->getFirst() || next == nullptr) continue;
+
+        Instruction *first = next->getFirst();
+        if (first && first->getType() == InstrType::Phi) continue;
+
+        std::vector<Block *> preds = block->getPredecessors();
+        for (Block *pred : preds) {
+            for (Instruction *instr : *pred) {
+                Label *label = instr->getBranchLabel();
+                if (label == nullptr || label->getName() != block->getName()) continue;
+
+                int pos = (instr->getType() == InstrType::Br) ? 0 : 2;
+                instr->setOperand(pos, arena->create<Label>(next->getName()));
+            }
+        }
+
+        func->removeBlock(block);
+        ++count;
+    }
+    return count;
+}
+
+} // end namespace
+
+PreservedAnalyses DCEPass::run(Function *func, AnalysisManager &am) {
+    size_t before = func->getInstrCount();
+
+    Eliminator eliminator(func);
+    size_t blocks = eliminator.removeUnreachable();
+    eliminator.removeDeadCode();
+    blocks += eliminator.removeEmpty();
+
+    size_t count = before - func->getInstrCount();
+    deleted += count;
+    deletedBlocks += blocks;
+
+    if (blocks > 0) return PreservedAnalyses::none();
+    if (count == 0) return PreservedAnalyses::all();
+
+    // Branches are never deleted, so the control flow is the same
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    preserved.preserve<PostDominatorTree>();
+    preserved.preserve<LoopInfo>();
+    return preserved;
+}
+
+void DCEPass::printStatistics(std::ostream &out) {
+    out << getName() << ": " << deleted << " instructions and " << deletedBlocks << " blocks deleted" << std::endl;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,44 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <atomic>
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief Removes dead instructions and blocks
+ *
+ * The pass first deletes the blocks that cannot be reached from the entry. Then it marks the
+ * instructions with side effects (calls, stores, branches, returns, and divisions that may trap),
+ * along with everything they use, directly or not. The rest is deleted. A store is not counted as
+ * a side effect when it writes to a local variable that is never read or passed anywhere, and such
+ * variables go too.
+ *
+ * Finally, blocks left empty are removed, and the branches to them go to the block they fell
+ * through to. A block whose successor has phi nodes is kept, since its edge would have to be merged
+ * with the others.
+ */
+class DCEPass : public FunctionPass {
+public:
+    std::string getName() { return "dce"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+
+    /*! \brief Returns the number of instructions deleted so far
+     *
+     */
+    size_t getDeletedCount() { return deleted; }
+
+    void printStatistics(std::ostream &out);
+private:
+    std::atomic<size_t> deleted{0};
+    std::atomic<size_t> deletedBlocks{0};
+};
+
+} // end namespace LLIR
+
@@ -0,0 +1,238 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <algorithm>
+#include <utility>
+
+#include <dominators.hpp>
+
+namespace LLIR {
+
+char DominatorTree::ID = 0;
+char PostDominatorTree::ID = 0;
+
+DominatorTreeBase::DominatorTreeBase(Function *func, bool post) {
+    this->post = post;
+
+    buildOrder(func);
+    buildEdges();
+    buildTree();
+}
+
+//
+// Construction
+//
+
+// The dominator tree walks the function in the reverse post-order it already caches. The
+// post-dominator tree walks the edges backwards, starting from a virtual exit whose successors
+// are the blocks that have none.
+void DominatorTreeBase::buildOrder(Function *func) {
+    nodeOf.assign(func->getMaxBlockID() + 1, -1);
+
+    if (!post) {
+        blocks = func->getReversePostOrder();
+    } else {
+        std::vector<Block *> exits;
+        for (Block *block : *func) {
+            if (block->getSuccessors().empty()) exits.push_back(block);
+        }
+
+        std::vector<bool> visited(nodeOf.size(), false);
+        std::vector<std::pair<Block *, size_t>> stack;
+        stack.push_back({ nullptr, 0 });
+        blocks.clear();
+
+        while (!stack.empty()) {
+            Block *block = stack.back().first;
+            size_t next = stack.back().second;
+            const std::vector<Block *> &edges = block ? block->getPredecessors() : exits;
+            if (next == edges.size()) {
+                blocks.push_back(block);
+                stack.pop_back();
+                continue;
+            }
+
+            ++stack.back().second;
+            Block *pred = edges[next];
+            if (!visited[pred->getID()]) {
+                visited[pred->getID()] = true;
+                stack.push_back({ pred, 0 });
+            }
+        }
+
+        std::reverse(blocks.begin(), blocks.end());
+    }
+
+    for (size_t i = 0; i<blocks.size(); i++) {
+        if (blocks[i]) nodeOf[blocks[i]->getID()] = i;
+    }
+}
+
+// The predecessors in the graph being walked. For post-dominators these are the successors,
+// and the exits get the virtual root.
+void DominatorTreeBase::buildEdges() {
+    predStart.assign(1, 0);
+    preds.clear();
+
+    for (size_t i = 0; i<blocks.size(); i++) {
+        Block *block = blocks[i];
+        if (!post) {
+            for (Block *pred : block->getPredecessors()) {
+                int node = getNode(pred);
+                if (node >= 0) preds.push_back(node);
+            }
+        } else if (block) {
+            for (Block *succ : block->getSuccessors()) {
+                int node = getNode(succ);
+                if (node >= 0) preds.push_back(node);
+            }
+            if (block->getSuccessors().empty()) preds.push_back(0);
+        }
+        predStart.push_back(preds.size());
+    }
+}
+
+// Nodes are numbered in reverse post-order, so a node's dominators all have smaller numbers,
+// and walking up from the larger of two nodes finds where their paths to the root meet
+int DominatorTreeBase::intersect(int a, int b) {
+    while (a != b) {
+        while (a > b) a = idom[a];
+        while (b > a) b = idom[b];
+    }
+    return a;
+}
+
+void DominatorTreeBase::buildTree() {
+    int count = blocks.size();
+    idom.assign(count, -1);
+    if (count == 0) return;
+    idom[0] = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int node = 1; node<count; node++) {
+            int newIdom = -1;
+            for (int i = predStart[node]; i<predStart[node+1]; i++) {
+                int pred = preds[i];
+                if (idom[pred] == -1) continue;
+                newIdom = (newIdom == -1) ? pred : intersect(pred, newIdom);
+            }
+
+            if (idom[node] != newIdom) {
+                idom[node] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    children.assign(count, std::vector<Block *>());
+    for (int node = 1; node<count; node++) children[idom[node]].push_back(blocks[node]);
+
+    // Number the tree depth-first. A dominates B exactly when B's interval is inside A's.
+    enter.assign(count, 0);
+    leave.assign(count, 0);
+    std::vector<std::pair<int, size_t>> stack;
+    stack.push_back({ 0, 0 });
+    int clock = 0;
+    enter[0] = clock++;
+
+    while (!stack.empty()) {
+        int node = stack.back().first;
+        size_t next = stack.back().second;
+        if (next == children[node].size()) {
+            leave[node] = clock++;
+            stack.pop_back();
+            continue;
+        }
+
+        ++stack.back().second;
+        int child = nodeOf[children[node][next]->getID()];
+        enter[child] = clock++;
+        stack.push_back({ child, 0 });
+    }
+}
+
+// Only join points end up in a frontier. From each predecessor of a join point, walk up the
+// tree until reaching the join point's immediate dominator; every node passed on the way has
+// the join point in its frontier. Control also enters the root from outside, so the root is a
+// join point as soon as it has one predecessor. It has no immediate dominator, so walks toward
+// it go all the way up.
+void DominatorTreeBase::buildFrontiers() {
+    int count = blocks.size();
+    frontiers.assign(count, std::vector<Block *>());
+
+    for (int node = 0; node<count; node++) {
+        int predCount = predStart[node+1] - predStart[node];
+        if (predCount == 0 || (node > 0 && predCount < 2)) continue;
+
+        int stop = (node == 0) ? -1 : idom[node];
+        for (int i = predStart[node]; i<predStart[node+1]; i++) {
+            int runner = preds[i];
+            while (runner != stop) {
+                std::vector<Block *> &frontier = frontiers[runner];
+                if (frontier.empty() || frontier.back() != blocks[node]) frontier.push_back(blocks[node]);
+                runner = (runner == 0) ? -1 : idom[runner];
+            }
+        }
+    }
+
+    frontiersBuilt = true;
+}
+
+//
+// Queries
+//
+int DominatorTreeBase::getNode(Block *block) {
+    if (block == nullptr) return (post && !blocks.empty()) ? 0 : -1;
+
+    int id = block->getID();
+    if (id <= 0 || id >= (int)nodeOf.size()) return -1;
+
+    int node = nodeOf[id];
+    if (node < 0 || blocks[node] != block) return -1;
+    return node;
+}
+
+Block *DominatorTreeBase::getIDom(Block *block) {
+    int node = getNode(block);
+    if (node <= 0) return nullptr;
+    return blocks[idom[node]];
+}
+
+const std::vector<Block *> &DominatorTreeBase::getChildren(Block *block) {
+    static const std::vector<Block *> none;
+    int node = getNode(block);
+    if (node < 0) return none;
+    return children[node];
+}
+
+bool DominatorTreeBase::dominates(Block *a, Block *b) {
+    if (a == b) return true;
+
+    int nodeA = getNode(a);
+    int nodeB = getNode(b);
+    if (nodeA < 0 || nodeB < 0) return false;
+    return enter[nodeA] <= enter[nodeB] && leave[nodeB] <= leave[nodeA];
+}
+
+Block *DominatorTreeBase::findNearestCommonDominator(Block *a, Block *b) {
+    int nodeA = getNode(a);
+    int nodeB = getNode(b);
+    if (nodeA < 0 || nodeB < 0) return nullptr;
+    return blocks[intersect(nodeA, nodeB)];
+}
+
+const std::vector<Block *> &DominatorTreeBase::getFrontier(Block *block) {
+    static const std::vector<Block *> none;
+    if (!frontiersBuilt) buildFrontiers();
+
+    int node = getNode(block);
+    if (node < 0) return none;
+    return frontiers[node];
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,141 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <vector>
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief The parts shared by the dominator and post-dominator trees
+ *
+ * The tree is built with the iterative algorithm of Cooper, Harvey, and Kennedy, over the blocks
+ * in reverse post-order. The nodes are then numbered by a depth-first walk of the tree, so asking
+ * whether one block dominates another takes constant time.
+ *
+ * Blocks that can't be reached from the root are not in the tree. They dominate nothing but
+ * themselves, and nothing else dominates them.
+ */
+class DominatorTreeBase : public FunctionAnalysis {
+public:
+    /*! \brief Returns the root of the tree
+     *
+     * For the post-dominator tree, this is nullptr (see PostDominatorTree).
+     */
+    Block *getRoot() { return blocks.empty() ? nullptr : blocks[0]; }
+
+    /*! \brief Returns the immediate dominator of a block
+     *
+     * This is nullptr for the root, for blocks directly below the virtual root of the post-dominator
+     * tree, and for blocks that aren't in the tree.
+     */
+    Block *getIDom(Block *block);
+
+    /*! \brief Returns the blocks a block immediately dominates
+     *
+     */
+    const std::vector<Block *> &getChildren(Block *block);
+
+    /*! \brief Returns true if a block is in the tree
+     *
+     */
+    bool isReachable(Block *block) { return getNode(block) >= 0; }
+
+    /*! \brief Returns true if every path from the root to b goes through a
+     *
+     * A block dominates itself.
+     */
+    bool dominates(Block *a, Block *b);
+
+    /*! \brief Returns true if a dominates b, and they are different blocks
+     *
+     */
+    bool strictlyDominates(Block *a, Block *b) { return a != b && dominates(a, b); }
+
+    /*! \brief Returns the closest block that dominates both a and b
+     *
+     * Returns nullptr if either block isn't in the tree, or if only the virtual root of the
+     * post-dominator tree dominates both.
+     */
+    Block *findNearestCommonDominator(Block *a, Block *b);
+
+    /*! \brief Returns the dominance frontier of a block
+     *
+     * These are the blocks where the dominance of the block ends: each one has a predecessor
+     * dominated by the block, without being strictly dominated by it. For the post-dominator tree,
+     * the predecessors are taken in the reversed graph, which gives the blocks the block is control
+     * dependent on.
+     *
+     * The frontiers of every block are computed together, the first time one is asked for.
+     */
+    const std::vector<Block *> &getFrontier(Block *block);
+
+    /*! \brief Returns the blocks of the tree in the order it was built
+     *
+     * For the dominator tree, this is the reverse post-order of the function. The first entry is the
+     * root, which may be nullptr.
+     */
+    const std::vector<Block *> &getBlocks() { return blocks; }
+protected:
+    // Builds the tree. For post-dominators, the edges are reversed and node 0 is a virtual exit.
+    DominatorTreeBase(Function *func, bool post);
+private:
+    int getNode(Block *block);
+    int intersect(int a, int b);
+    void buildOrder(Function *func);
+    void buildEdges();
+    void buildTree();
+    void buildFrontiers();
+
+    bool post;
+
+    // The nodes in reverse post-order of the graph being walked, and the node of each block ID
+    std::vector<Block *> blocks;
+    std::vector<int> nodeOf;
+
+    // The predecessors of each node in the graph being walked, stored back to back
+    std::vector<int> predStart;
+    std::vector<int> preds;
+
+    std::vector<int> idom;
+    std::vector<std::vector<Block *>> children;
+    std::vector<int> enter;
+    std::vector<int> leave;
+
+    std::vector<std::vector<Block *>> frontiers;
+    bool frontiersBuilt = false;
+};
+
+/*! \brief The dominator tree of a function
+ *
+ * The root is the entry block.
+ */
+class DominatorTree : public DominatorTreeBase {
+public:
+    static char ID;
+
+    DominatorTree(Function *func, AnalysisManager &am) : DominatorTreeBase(func, false) {}
+};
+
+/*! \brief The post-dominator tree of a function
+ *
+ * A function can have several exits (the blocks without successors), so the root of the tree is a
+ * virtual exit that all of them lead to. It is represented by nullptr: getRoot returns nullptr, and
+ * getChildren(nullptr) returns the blocks right below it.
+ *
+ * Blocks that can't reach an exit, such as those in an infinite loop, are not in the tree.
+ */
+class PostDominatorTree : public DominatorTreeBase {
+public:
+    static char ID;
+
+    PostDominatorTree(Function *func, AnalysisManager &am) : DominatorTreeBase(func, true) {}
+};
+
+} // end namespace LLIR
+
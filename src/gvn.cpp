@@ -0,0 +1,234 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include <gvn.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+
+namespace LLIR {
+
+// The tables are scoped: a block sees the expressions of the blocks that dominate it, since those
+// have always run before it. Each block logs what it adds, and it is taken out again once the
+// walk leaves its subtree.
+namespace {
+
+// Registers are keyed by ID and immediates by value. Two equal immediates are usually different
+// objects, so they can't be keyed by address.
+struct OperandKey {
+    OpType kind = OpType::None;
+    int64_t value = 0;
+
+    bool operator==(const OperandKey &other) const { return kind == other.kind && value == other.value; }
+    bool operator<(const OperandKey &other) const {
+        if (kind != other.kind) return kind < other.kind;
+        return value < other.value;
+    }
+};
+
+struct ExprKey {
+    InstrType op = InstrType::None;
+    Type *type = nullptr;
+    OperandKey lhs;
+    OperandKey rhs;
+
+    bool operator==(const ExprKey &other) const {
+        return op == other.op && type == other.type && lhs == other.lhs && rhs == other.rhs;
+    }
+};
+
+struct ExprKeyHash {
+    size_t operator()(const ExprKey &key) const {
+        size_t h = std::hash<int>()((int)key.op);
+        auto combine = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+        combine(std::hash<Type *>()(key.type));
+        combine(std::hash<int>()((int)key.lhs.kind));
+        combine(std::hash<int64_t>()(key.lhs.value));
+        combine(std::hash<int>()((int)key.rhs.kind));
+        combine(std::hash<int64_t>()(key.rhs.value));
+        return h;
+    }
+};
+
+bool isCommutative(InstrType type) {
+    switch (type) {
+        case InstrType::Add:
+        case InstrType::SMul:
+        case InstrType::UMul:
+        case InstrType::And:
+        case InstrType::Or:
+        case InstrType::Xor: return true;
+
+        default: {}
+    }
+    return false;
+}
+
+// Division is included: if the first one did not trap, the second one can't either
+bool isNumbered(InstrType type) {
+    switch (type) {
+        case InstrType::Add:
+        case InstrType::Sub:
+        case InstrType::SMul:
+        case InstrType::UMul:
+        case InstrType::SDiv:
+        case InstrType::UDiv:
+        case InstrType::SRem:
+        case InstrType::URem:
+        case InstrType::And:
+        case InstrType::Or:
+        case InstrType::Xor:
+        case InstrType::Not:
+        case InstrType::GEP: return true;
+
+        default: {}
+    }
+    return false;
+}
+
+bool getOperandKey(Operand *op, OperandKey &key) {
+    if (op == nullptr) return true;
+
+    key.kind = op->getType();
+    switch (op->getType()) {
+        case OpType::Reg: key.value = static_cast<Reg *>(op)->getID(); return true;
+        case OpType::Imm: key.value = static_cast<Imm *>(op)->getValue(); return true;
+        default: {}
+    }
+    return false;
+}
+
+class Numbering {
+public:
+    explicit Numbering(Function *func, DominatorTree *domTree) {
+        this->func = func;
+        this->domTree = domTree;
+    }
+
+    size_t run();
+private:
+    void visit(Block *block);
+    bool getKey(Instruction *instr, ExprKey &key);
+
+    Function *func;
+    DominatorTree *domTree;
+
+    std::unordered_map<ExprKey, Reg *, ExprKeyHash> exprs;
+    std::vector<ExprKey> undo;
+
+    // The addresses of the current block since the last call
+    std::unordered_map<ExprKey, Reg *, ExprKeyHash> addresses;
+
+    size_t removed = 0;
+};
+
+// The walk is iterative, like the renaming in mem2reg
+size_t Numbering::run() {
+    struct Frame {
+        Block *block;
+        size_t child;
+        size_t mark;
+    };
+    std::vector<Frame> stack;
+
+    Block *entry = func->getEntryBlock();
+    stack.push_back({ entry, 0, undo.size() });
+    visit(entry);
+
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        const std::vector<Block *> &children = domTree->getChildren(frame.block);
+        if (frame.child < children.size()) {
+            Block *child = children[frame.child++];
+            stack.push_back({ child, 0, undo.size() });
+            visit(child);
+            continue;
+        }
+
+        while (undo.size() > frame.mark) {
+            exprs.erase(undo.back());
+            undo.pop_back();
+        }
+        stack.pop_back();
+    }
+
+    return removed;
+}
+
+void Numbering::visit(Block *block) {
+    addresses.clear();
+
+    Instruction *next = nullptr;
+    for (Instruction *instr = block->getFirst(); instr; instr = next) {
+        next = instr->getNext();
+        if (instr->getType() == InstrType::Call) {
+            addresses.clear();
+            continue;
+        }
+
+        ExprKey key;
+        if (!getKey(instr, key)) continue;
+
+        bool isAddress = instr->getType() == InstrType::GEP;
+        auto &table = isAddress ? addresses : exprs;
+        auto it = table.find(key);
+        if (it == table.end()) {
+            table[key] = static_cast<Reg *>(instr->getDest());
+            if (!isAddress) undo.push_back(key);
+            continue;
+        }
+
+        instr->getDest()->replaceAllUsesWith(it->second);
+        instr->eraseFromParent();
+        ++removed;
+    }
+}
+
+bool Numbering::getKey(Instruction *instr, ExprKey &key) {
+    if (!isNumbered(instr->getType())) return false;
+
+    Operand *dest = instr->getDest();
+    if (dest == nullptr || dest->getType() != OpType::Reg) return false;
+
+    key.op = instr->getType();
+    key.type = instr->getDataType();
+    if (!getOperandKey(instr->getOperand1(), key.lhs)) return false;
+    if (!getOperandKey(instr->getOperand2(), key.rhs)) return false;
+
+    if (isCommutative(key.op) && key.rhs < key.lhs) std::swap(key.lhs, key.rhs);
+    return true;
+}
+
+} // end namespace
+
+// An expression after a conditional branch has not run on the way out of that branch, so the
+// blocks are split first. Apart from that, only instructions are deleted, never the control flow.
+PreservedAnalyses GVNPass::run(Function *func, AnalysisManager &am) {
+    bool split = func->splitAtBranches();
+    if (split) am.invalidate(func, PreservedAnalyses::none());
+
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    size_t count = Numbering(func, domTree).run();
+    removed += count;
+
+    if (split) return PreservedAnalyses::none();
+    if (count == 0) return PreservedAnalyses::all();
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    preserved.preserve<PostDominatorTree>();
+    preserved.preserve<LoopInfo>();
+    return preserved;
+}
+
+void GVNPass::printStatistics(std::ostream &out) {
+    out << getName() << ": " << removed << " instructions deleted" << std::endl;
+}
+
+} // end namespace LLIR
+
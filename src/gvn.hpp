@@ -0,0 +1,38 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <atomic>
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief Removes computations that were already done on the same values
+ *
+ * The pass walks the dominator tree, keeping a table of the expressions computed on the way down.
+ * An expression is its opcode, its type and its operands, with the operands of commutative
+ * operations in a fixed order. When an instruction computes an expression that is already in the
+ * table, its uses are replaced by the earlier result and it is deleted. Only arithmetic and address
+ * computations are numbered; loads, calls and phi nodes are left alone. Blocks with code after a
+ * conditional branch are split first (see Function::splitAtBranches).
+ *
+ * The hardware transformation cannot spill addresses, so an address computation is only reused
+ * within its block, and not across a call, which keeps the number of live addresses small.
+ */
+class GVNPass : public FunctionPass {
+public:
+    std::string getName() { return "gvn"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+
+    void printStatistics(std::ostream &out);
+private:
+    std::atomic<size_t> removed{0};
+};
+
+} // end namespace LLIR
+
@@ -0,0 +1,185 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <cstddef>
+
+namespace LLIR {
+
+template <class T> class IList;
+template <class T> class IListIterator;
+
+/*! \brief The base of anything that can be placed in an intrusive list
+ *
+ * The links live inside the object itself, so adding or removing an object from a list never allocates,
+ * and an object can be unlinked in constant time without searching for it. An object can only be in one
+ * list at a time.
+ */
+template <class T>
+class IListNode {
+public:
+    /*! \brief Returns the previous node in the list, or nullptr if this is the first
+     *
+     */
+    T *getPrev() { return prev; }
+
+    /*! \brief Returns the next node in the list, or nullptr if this is the last
+     *
+     */
+    T *getNext() { return next; }
+private:
+    friend class IList<T>;
+    friend class IListIterator<T>;
+
+    T *prev = nullptr;
+    T *next = nullptr;
+};
+
+/*! \brief An iterator over an intrusive list
+ *
+ * Dereferencing the iterator returns a pointer to the node. Iterators stay valid as long as the node
+ * they refer to stays in the list, no matter what else is inserted or removed.
+ */
+template <class T>
+class IListIterator {
+public:
+    IListIterator(T *node, const IList<T> *list) {
+        this->node = node;
+        this->list = list;
+    }
+
+    T *operator*() const { return node; }
+    T *operator->() const { return node; }
+
+    IListIterator &operator++() {
+        node = static_cast<IListNode<T> *>(node)->next;
+        return *this;
+    }
+
+    IListIterator operator++(int) {
+        IListIterator old = *this;
+        ++(*this);
+        return old;
+    }
+
+    // Stepping back from end() lands on the last node
+    IListIterator &operator--() {
+        if (node == nullptr) node = list->back();
+        else node = static_cast<IListNode<T> *>(node)->prev;
+        return *this;
+    }
+
+    IListIterator operator--(int) {
+        IListIterator old = *this;
+        --(*this);
+        return old;
+    }
+
+    bool operator==(const IListIterator &other) const { return node == other.node; }
+    bool operator!=(const IListIterator &other) const { return node != other.node; }
+private:
+    T *node;
+    const IList<T> *list;
+};
+
+/*! \brief An intrusive doubly-linked list
+ *
+ * Insertion and removal are constant time anywhere in the list. The list does not own its nodes; removing
+ * a node only unlinks it.
+ */
+template <class T>
+class IList {
+public:
+    typedef IListIterator<T> iterator;
+
+    iterator begin() const { return iterator(head, this); }
+    iterator end() const { return iterator(nullptr, this); }
+
+    T *front() const { return head; }
+    T *back() const { return tail; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /*! \brief Adds a node to the end of the list
+     */
+    void push_back(T *node) {
+        insertAfter(tail, node);
+    }
+
+    /*! \brief Adds a node to the start of the list
+     */
+    void push_front(T *node) {
+        insertBefore(head, node);
+    }
+
+    /*! \brief Inserts a node after another node
+     *
+     * @param pos The node to insert after. If this is nullptr, the node is added to the front.
+     * @param node The node to insert
+     */
+    void insertAfter(T *pos, T *node) {
+        IListNode<T> *n = node;
+        n->prev = pos;
+        if (pos) {
+            n->next = link(pos)->next;
+            link(pos)->next = node;
+        } else {
+            n->next = head;
+            head = node;
+        }
+
+        if (n->next) link(n->next)->prev = node;
+        else tail = node;
+        ++count;
+    }
+
+    /*! \brief Inserts a node before another node
+     *
+     * @param pos The node to insert before. If this is nullptr, the node is added to the back.
+     * @param node The node to insert
+     */
+    void insertBefore(T *pos, T *node) {
+        if (pos) insertAfter(link(pos)->prev, node);
+        else insertAfter(tail, node);
+    }
+
+    /*! \brief Unlinks a node from the list
+     *
+     * @param node The node to remove. It must be part of this list.
+     */
+    void remove(T *node) {
+        IListNode<T> *n = node;
+        if (n->prev) link(n->prev)->next = n->next;
+        else head = n->next;
+
+        if (n->next) link(n->next)->prev = n->prev;
+        else tail = n->prev;
+
+        n->prev = nullptr;
+        n->next = nullptr;
+        --count;
+    }
+
+    /*! \brief Unlinks the node at an iterator
+     *
+     * @return An iterator to the node after the removed one
+     */
+    iterator erase(iterator it) {
+        T *node = *it;
+        iterator next(link(node)->next, this);
+        remove(node);
+        return next;
+    }
+private:
+    static IListNode<T> *link(T *node) { return node; }
+
+    T *head = nullptr;
+    T *tail = nullptr;
+    size_t count = 0;
+};
+
+} // end namespace LLIR
+
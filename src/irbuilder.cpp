@@ -10,10 +10,11 @@ namespace LLIR {
 
 IRBuilder::IRBuilder(Module *mod) {
     this->mod = mod;
+    this->arena = mod->getArena();
 }
 
 Block *IRBuilder::createBlock(std::string name) {
-    currentBlock = new Block(name);
+    currentBlock = Block::Create(currentFunc, name);
     currentFunc->addBlock(currentBlock);
     return currentBlock;
 }
@@ -35,43 +36,39 @@ Block *IRBuilder::getInsertPoint() {
 }
 
 Operand *IRBuilder::createI8(int8_t val) {
-    return new Imm(val);
+    return arena->create<Imm>(val);
 }
 
 Operand *IRBuilder::createI16(int16_t val) {
-    return new Imm(val);
+    return arena->create<Imm>(val);
 }
 
 Operand *IRBuilder::createI32(int val) {
-    return new Imm(val);
+    return arena->create<Imm>(val);
 }
 
 Operand *IRBuilder::createI64(int64_t val) {
-    return new Imm(val);
+    return arena->create<Imm>(val);
 }
 
 Operand *IRBuilder::createString(std::string val) {
-    std::string name = "STR" + std::to_string(lblCounter);
-    ++lblCounter;
-    
     std::string val2 = "";
     for (char c : val) {
         if (c == '\n') val2 += "\\n";
         else val2 += c;
     }
     
-    StringPtr *ptr = new StringPtr(name, val2);
+    StringPtr *ptr = arena->create<StringPtr>(mod->createStringName(), mod->intern(val2));
     mod->addStringPtr(ptr);
     
     return ptr;
 }
 
 Reg *IRBuilder::createAlloca(Type *type) {
-    Instruction *alloc = new Instruction(InstrType::Alloca);
+    Instruction *alloc = arena->create<Instruction>(InstrType::Alloca);
     alloc->setDataType(type);
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     alloc->setDest(dest);
     
     currentBlock->addInstruction(alloc);
@@ -79,7 +76,7 @@ Reg *IRBuilder::createAlloca(Type *type) {
 }
 
 Instruction *IRBuilder::createStore(Type *type, Operand *op, Operand *dest) {
-    Instruction *store = new Instruction(InstrType::Store);
+    Instruction *store = arena->create<Instruction>(InstrType::Store);
     store->setDataType(type);
     store->setOperand1(op);
     store->setOperand2(dest);
@@ -88,10 +85,10 @@ Instruction *IRBuilder::createStore(Type *type, Operand *op, Operand *dest) {
 }
 
 Instruction *IRBuilder::createStructStore(Type *type, Operand *ptr, int index, Operand *val) {
-    Instruction *op = new Instruction(InstrType::StructStore);
+    Instruction *op = arena->create<Instruction>(InstrType::StructStore);
     op->setDataType(type);
     op->setOperand1(ptr);
-    op->setOperand2(new Imm(index));
+    op->setOperand2(arena->create<Imm>(index));
     op->setOperand3(val);
     
     currentBlock->addInstruction(op);
@@ -99,12 +96,11 @@ Instruction *IRBuilder::createStructStore(Type *type, Operand *ptr, int index, O
 }
 
 Reg *IRBuilder::createLoad(Type *type, Operand *src) {
-    Instruction *load = new Instruction(InstrType::Load);
+    Instruction *load = arena->create<Instruction>(InstrType::Load);
     load->setDataType(type);
     load->setOperand1(src);
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     load->setDest(dest);
     
     currentBlock->addInstruction(load);
@@ -112,13 +108,12 @@ Reg *IRBuilder::createLoad(Type *type, Operand *src) {
 }
 
 Reg *IRBuilder::createStructLoad(Type *type, Operand *src, int index) {
-    Instruction *load = new Instruction(InstrType::StructLoad);
+    Instruction *load = arena->create<Instruction>(InstrType::StructLoad);
     load->setDataType(type);
     load->setOperand1(src);
-    load->setOperand2(new Imm(index));
+    load->setOperand2(arena->create<Imm>(index));
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     load->setDest(dest);
     
     currentBlock->addInstruction(load);
@@ -131,27 +126,26 @@ Operand *IRBuilder::createBinaryOp(Type *type, Operand *op1, Operand *op2, Instr
         Imm *imm2 = static_cast<Imm *>(op2);
         
         switch (iType) {
-            case InstrType::Add: return new Imm(imm1->getValue() + imm2->getValue());
-            case InstrType::Sub: return new Imm(imm1->getValue() - imm2->getValue());
-            case InstrType::SMul: return new Imm(imm1->getValue() * imm2->getValue());
-            case InstrType::SDiv: return new Imm(imm1->getValue() / imm2->getValue());
-            case InstrType::And: return new Imm(imm1->getValue() & imm2->getValue());
-            case InstrType::Or: return new Imm(imm1->getValue() | imm2->getValue());
-            case InstrType::Xor: return new Imm(imm1->getValue() ^ imm2->getValue());
+            case InstrType::Add: return arena->create<Imm>(imm1->getValue() + imm2->getValue());
+            case InstrType::Sub: return arena->create<Imm>(imm1->getValue() - imm2->getValue());
+            case InstrType::SMul: return arena->create<Imm>(imm1->getValue() * imm2->getValue());
+            case InstrType::SDiv: return arena->create<Imm>(imm1->getValue() / imm2->getValue());
+            case InstrType::And: return arena->create<Imm>(imm1->getValue() & imm2->getValue());
+            case InstrType::Or: return arena->create<Imm>(imm1->getValue() | imm2->getValue());
+            case InstrType::Xor: return arena->create<Imm>(imm1->getValue() ^ imm2->getValue());
             
             default: {}
         }
     }
     
-    Instruction *op = new Instruction(iType);
+    Instruction *op = arena->create<Instruction>(iType);
     op->setDataType(type);
     op->setOperand1(op1);
     op->setOperand2(op2);
     
-    if (destBlock != nullptr) op->setOperand3(new Label(destBlock->getName()));
+    if (destBlock != nullptr) op->setOperand3(arena->create<Label>(destBlock->getName()));
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     op->setDest(dest);
     
     currentBlock->addInstruction(op);
@@ -198,12 +192,11 @@ Operand *IRBuilder::createNeg(Type *type, Operand *op1) {
         return imm;    
     }
     
-    Instruction *op = new Instruction(InstrType::Not);
+    Instruction *op = arena->create<Instruction>(InstrType::Not);
     op->setDataType(type);
     op->setOperand1(op1);
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     op->setDest(dest);
     
     currentBlock->addInstruction(op);
@@ -215,12 +208,11 @@ Operand *IRBuilder::createBeq(Type *type, Operand *op1, Operand *op2, Block *des
         Imm *imm1 = static_cast<Imm *>(op1);
         Imm *imm2 = static_cast<Imm *>(op2);
         if (imm1->getValue() == imm2->getValue()) {
-            Label *lbl = new Label(destBlock->getName());
-            Instruction *op = new Instruction(InstrType::Br);
+            Label *lbl = arena->create<Label>(destBlock->getName());
+            Instruction *op = arena->create<Instruction>(InstrType::Br);
             op->setOperand1(lbl);
             
-            Reg *dest = new Reg(std::to_string(regCounter));
-            ++regCounter;
+            Reg *dest = currentFunc->createReg();
             op->setDest(dest);
             
             currentBlock->addInstruction(op);
@@ -251,25 +243,24 @@ Operand *IRBuilder::createBle(Type *type, Operand *op1, Operand *op2, Block *des
 }
 
 Instruction *IRBuilder::createBr(Block *block) {
-    Label *lbl = new Label(block->getName());
-    Instruction *op = new Instruction(InstrType::Br);
+    Label *lbl = arena->create<Label>(block->getName());
+    Instruction *op = arena->create<Instruction>(InstrType::Br);
     op->setOperand1(lbl);
     currentBlock->addInstruction(op);
     return op;
 }
 
 Instruction *IRBuilder::createVoidCall(std::string name, std::vector<Operand *> args) {
-    FunctionCall *fc = new FunctionCall(name, args);
+    FunctionCall *fc = arena->create<FunctionCall>(mod->intern(name), args);
     currentBlock->addInstruction(fc);
     return fc;
 }
 
 Reg *IRBuilder::createCall(Type *type, std::string name, std::vector<Operand *> args) {
-    FunctionCall *fc = new FunctionCall(name, args);
+    FunctionCall *fc = arena->create<FunctionCall>(mod->intern(name), args);
     fc->setDataType(type);
     
-    Reg *dest = new Reg(std::to_string(regCounter));
-    ++regCounter;
+    Reg *dest = currentFunc->createReg();
     fc->setDest(dest);
     
     currentBlock->addInstruction(fc);
@@ -277,14 +268,14 @@ Reg *IRBuilder::createCall(Type *type, std::string name, std::vector<Operand *>
 }
 
 Instruction *IRBuilder::createRetVoid() {
-    Instruction *ret = new Instruction(InstrType::Ret);
-    ret->setDataType(Type::createVoidType());
+    Instruction *ret = arena->create<Instruction>(InstrType::Ret);
+    ret->setDataType(TypeContext::getVoidType());
     currentBlock->addInstruction(ret);
     return ret;
 }
 
 Instruction *IRBuilder::createRet(Type *type, Operand *op) {
-    Instruction *ret = new Instruction(InstrType::Ret);
+    Instruction *ret = arena->create<Instruction>(InstrType::Ret);
     ret->setDataType(type);
     ret->setOperand1(op);
     currentBlock->addInstruction(ret);
@@ -14,6 +14,11 @@ namespace LLIR {
  * This class is meant to make it easy to build an LLIR module. In general, you should use this class when creating
  * LLIR unless you are experimenting or doing something internal to LLIR. This class will take care of many tedious
  * tasks such as register naming, operands, and so forth.
+ *
+ * Everything created by the builder is allocated in the arena of the module being built.
+ *
+ * A builder belongs to the thread that created it. To build several functions of a module in parallel,
+ * give each thread its own builder (see Module for the rules).
  */
 class IRBuilder {
 public:
@@ -35,7 +40,6 @@ public:
      */
     void setCurrentFunction(Function *func) {
         currentFunc = func;
-        regCounter = currentFunc->getArgCount();
     };
     
     Function *getCurrentFunction() {
@@ -210,10 +214,9 @@ protected:
     Operand *createBinaryOp(Type *type, Operand *op1, Operand *op2, InstrType iType, Block *destBlock = nullptr);
 private:
     Module *mod;
+    Arena *arena;
     Function *currentFunc;
     Block *currentBlock;
-    int regCounter = 0;
-    int lblCounter = 0;
 };
 
 }
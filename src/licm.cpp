@@ -0,0 +1,422 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include <licm.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+
+namespace LLIR {
+
+namespace {
+
+// The addresses hoisted out of a loop nest stay in registers through all of it
+const int MaxHoistedAddresses = 2;
+
+// The allocas a loop accesses, and whether it may write memory that other pointers can reach
+struct MemoryEffects {
+    std::vector<int> stores;
+    std::vector<int> loads;
+    bool unknownStore = false;
+    bool escapingStore = false;
+    bool hasCall = false;
+};
+
+class Mover {
+public:
+    explicit Mover(Function *func) {
+        this->func = func;
+        this->arena = func->getModule()->getArena();
+    }
+
+    bool createPreheaders(LoopInfo *loopInfo);
+    bool run(LoopInfo *loopInfo, DominatorTree *domTree);
+
+    size_t getHoistedCount() { return hoisted; }
+    size_t getSunkCount() { return sunk; }
+private:
+    Block *createPreheader(Loop *loop);
+    void findAllocas();
+    Instruction *getDef(Operand *op);
+    Instruction *getBase(Operand *ptr);
+    int getAddressSlot(Instruction *instr);
+    bool isInvariant(Operand *op, Loop *loop);
+    bool isGuaranteed(Instruction *instr, Loop *loop);
+    MemoryEffects getEffects(Loop *loop);
+    bool canHoist(Instruction *instr, Loop *loop, MemoryEffects &effects);
+    bool hoist(Loop *loop, int &addressBudget);
+    bool sink(Loop *loop, LoopInfo *loopInfo, DominatorTree *domTree, MemoryEffects &effects);
+
+    Function *func;
+    Arena *arena;
+    int preheaderCount = 0;
+    size_t hoisted = 0;
+    size_t sunk = 0;
+
+    // The instruction defining each register, and whether each alloca escapes, by register ID
+    std::vector<Instruction *> defs;
+    std::vector<bool> escapes;
+};
+
+bool Mover::createPreheaders(LoopInfo *loopInfo) {
+    bool changed = false;
+    for (Loop *loop : loopInfo->getLoopsInnermostFirst()) {
+        if (loop->getPreheader() == nullptr && createPreheader(loop)) changed = true;
+    }
+    return changed;
+}
+
+// The preheader goes right before the header and falls into it. A block of the loop that used to
+// fall into the header jumps to it instead. The header's phi nodes get a single value from the
+// preheader, which merges the values from outside the loop if there are several.
+Block *Mover::createPreheader(Loop *loop) {
+    Block *header = loop->getHeader();
+    std::vector<Block *> outside;
+    for (Block *pred : header->getPredecessors()) {
+        if (!loop->contains(pred)) outside.push_back(pred);
+    }
+    if (outside.empty()) return nullptr;
+
+    std::string name;
+    do {
+        name = "preheader" + std::to_string(preheaderCount++);
+    } while (func->getBlockByName(name));
+    Block *preheader = Block::Create(func, name);
+
+    Block *prev = header->getPrev();
+    if (prev && loop->contains(prev) && (prev->getLast() == nullptr || !prev->getLast()->isTerminator())) {
+        Instruction *br = arena->create<Instruction>(InstrType::Br);
+        br->setDataType(TypeContext::getVoidType());
+        br->setOperand1(arena->create<Label>(header->getName()));
+        prev->addInstruction(br);
+    }
+    func->addBlockBefore(header, preheader);
+
+    for (Block *pred : outside) {
+        for (Instruction *instr : *pred) {
+            if (!instr->isBranch() || instr->getBranchLabel()->getName() != header->getName()) continue;
+            int slot = instr->getType() == InstrType::Br ? 0 : 2;
+            instr->setOperand(slot, arena->create<Label>(preheader->getName()));
+        }
+    }
+
+    for (Instruction *instr : *header) {
+        if (instr->getType() != InstrType::Phi) break;
+        PhiNode *phi = static_cast<PhiNode *>(instr);
+
+        if (outside.size() == 1) {
+            int index = phi->getIncomingIndex(outside[0]->getName());
+            if (index >= 0) phi->setIncomingLabel(index, arena->create<Label>(preheader->getName()));
+            continue;
+        }
+
+        PhiNode *merge = arena->create<PhiNode>();
+        merge->setDataType(phi->getDataType());
+        merge->setDest(func->createReg());
+        for (Block *pred : outside) {
+            int index = phi->getIncomingIndex(pred->getName());
+            if (index < 0) continue;
+            merge->addIncoming(phi->getIncomingValue(index), arena->create<Label>(pred->getName()));
+            phi->removeIncoming(index);
+        }
+        preheader->addInstruction(merge);
+        phi->addIncoming(merge->getDest(), arena->create<Label>(preheader->getName()));
+    }
+
+    return preheader;
+}
+
+// An alloca escapes if its address is used other than to load from it or store to it
+void Mover::findAllocas() {
+    defs.assign(func->getRegCount(), nullptr);
+    escapes.assign(func->getRegCount(), false);
+
+    std::vector<Instruction *> allocas;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            Operand *dest = instr->getDest();
+            if (dest && dest->getType() == OpType::Reg) defs[static_cast<Reg *>(dest)->getID()] = instr;
+            if (instr->getType() == InstrType::Alloca) allocas.push_back(instr);
+        }
+    }
+
+    for (Instruction *alloca : allocas) {
+        bool escaped = false;
+        for (Use *use : alloca->getDest()->getUses()) {
+            if (use->getOperandNo() != getAddressSlot(use->getUser())) escaped = true;
+        }
+        escapes[static_cast<Reg *>(alloca->getDest())->getID()] = escaped;
+    }
+}
+
+Instruction *Mover::getDef(Operand *op) {
+    if (op == nullptr || op->getType() != OpType::Reg) return nullptr;
+    int id = static_cast<Reg *>(op)->getID();
+    return id < (int)defs.size() ? defs[id] : nullptr;
+}
+
+// Returns the alloca an address is, or nullptr if it points somewhere else. An address computation
+// reads the pointer held in an alloca, so it is never the alloca itself.
+Instruction *Mover::getBase(Operand *ptr) {
+    Instruction *def = getDef(ptr);
+    if (def && def->getType() == InstrType::Alloca) return def;
+    return nullptr;
+}
+
+// Returns the operand slot holding the address a memory access goes to, or -1 for other instructions
+int Mover::getAddressSlot(Instruction *instr) {
+    switch (instr->getType()) {
+        case InstrType::Load:
+        case InstrType::StructLoad:
+        case InstrType::StructStore: return 0;
+        case InstrType::Store: return 1;
+        default: {}
+    }
+    return -1;
+}
+
+// Arguments and values defined outside the loop, including those already hoisted, don't change
+bool Mover::isInvariant(Operand *op, Loop *loop) {
+    if (op == nullptr || op->getType() != OpType::Reg) return true;
+    Instruction *def = getDef(op);
+    return def == nullptr || !loop->contains(def->getParent());
+}
+
+MemoryEffects Mover::getEffects(Loop *loop) {
+    MemoryEffects effects;
+    for (Block *block : loop->getBlocks()) {
+        for (Instruction *instr : *block) {
+            InstrType type = instr->getType();
+            if (type == InstrType::Call) {
+                effects.hasCall = true;
+                continue;
+            }
+
+            int slot = getAddressSlot(instr);
+            if (slot < 0) continue;
+
+            Instruction *base = getBase(instr->getOperandUse(slot)->get());
+            bool isStore = type == InstrType::Store || type == InstrType::StructStore;
+            if (base == nullptr) {
+                if (isStore) effects.unknownStore = true;
+                continue;
+            }
+
+            int id = static_cast<Reg *>(base->getDest())->getID();
+            if (isStore) effects.stores.push_back(id);
+            else effects.loads.push_back(id);
+            if (isStore && escapes[id]) effects.escapingStore = true;
+        }
+    }
+    return effects;
+}
+
+// Returns true if an instruction runs whenever the loop is entered: it is in the header, and no
+// branch comes before it
+bool Mover::isGuaranteed(Instruction *instr, Loop *loop) {
+    if (instr->getParent() != loop->getHeader()) return false;
+    for (Instruction *prev = instr->getPrev(); prev; prev = prev->getPrev()) {
+        if (prev->isBranch()) return false;
+    }
+    return true;
+}
+
+// A hoisted instruction runs even if the loop body never does, so it must not be able to trap.
+// Loads from an alloca are always safe. Loads through other pointers are only hoisted if they run
+// anyway, and if nothing in the loop can write where they point.
+bool Mover::canHoist(Instruction *instr, Loop *loop, MemoryEffects &effects) {
+    Operand *dest = instr->getDest();
+    if (dest == nullptr || dest->getType() != OpType::Reg) return false;
+
+    switch (instr->getType()) {
+        case InstrType::Add:
+        case InstrType::Sub:
+        case InstrType::SMul:
+        case InstrType::UMul:
+        case InstrType::And:
+        case InstrType::Or:
+        case InstrType::Xor:
+        case InstrType::Not:
+        case InstrType::GEP: break;
+
+        case InstrType::SDiv:
+        case InstrType::UDiv:
+        case InstrType::SRem:
+        case InstrType::URem: {
+            Operand *divisor = instr->getOperand2();
+            if (divisor == nullptr || divisor->getType() != OpType::Imm) return false;
+            int64_t value = static_cast<Imm *>(divisor)->getValue();
+            if (value == 0 || value == -1) return false;
+        } break;
+
+        case InstrType::Load:
+        case InstrType::StructLoad: {
+            Instruction *base = getBase(instr->getOperand1());
+            if (base == nullptr) {
+                if (!isGuaranteed(instr, loop)) return false;
+                if (effects.unknownStore || effects.escapingStore || effects.hasCall) return false;
+                break;
+            }
+
+            int id = static_cast<Reg *>(base->getDest())->getID();
+            if (escapes[id] && (effects.unknownStore || effects.hasCall)) return false;
+            for (int store : effects.stores) {
+                if (store == id) return false;
+            }
+        } break;
+
+        default: return false;
+    }
+
+    for (int i = 0; i<instr->getOperandCount(); i++) {
+        if (!isInvariant(instr->getOperandUse(i)->get(), loop)) return false;
+    }
+    return true;
+}
+
+// The blocks are in reverse post-order, so an instruction is seen after those it depends on
+bool Mover::hoist(Loop *loop, int &addressBudget) {
+    Block *preheader = loop->getPreheader();
+    if (preheader == nullptr) return false;
+
+    Instruction *pos = nullptr;
+    for (Instruction *instr : *preheader) {
+        if (instr->isBranch() || instr->isTerminator()) {
+            pos = instr;
+            break;
+        }
+    }
+
+    MemoryEffects effects = getEffects(loop);
+    bool changed = false;
+    for (Block *block : loop->getBlocks()) {
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            if (!canHoist(instr, loop, effects)) continue;
+
+            if (instr->getType() == InstrType::GEP) {
+                if (addressBudget == 0) continue;
+                --addressBudget;
+            }
+
+            block->removeInstruction(instr);
+            if (pos) preheader->insertBefore(pos, instr);
+            else preheader->addInstruction(instr);
+            ++hoisted;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// The store must run on every way out of the loop, and its value must be the last one stored. Its
+// block dominating every exiting block is not enough if a branch before it in its block leaves the
+// loop, so a store is only sunk if no branch comes before it.
+// A store in a sub-loop, or of a value from a sub-loop, could run again after its value changed,
+// so only those of the loop itself are sunk.
+bool Mover::sink(Loop *loop, LoopInfo *loopInfo, DominatorTree *domTree, MemoryEffects &effects) {
+    const std::vector<Block *> &exits = loop->getExitBlocks();
+    if (exits.size() != 1) return false;
+
+    Block *exit = exits[0];
+    for (Block *pred : exit->getPredecessors()) {
+        if (!loop->contains(pred)) return false;
+    }
+
+    auto count = [](const std::vector<int> &ids, int id) {
+        int n = 0;
+        for (int other : ids) n += other == id;
+        return n;
+    };
+
+    bool changed = false;
+    for (Block *block : loop->getBlocks()) {
+        if (loopInfo->getLoopFor(block) != loop) continue;
+
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            if (instr->isBranch()) break;
+            if (instr->getType() != InstrType::Store || !isInvariant(instr->getOperand2(), loop)) continue;
+
+            Instruction *base = getBase(instr->getOperand2());
+            if (base == nullptr) continue;
+            int id = static_cast<Reg *>(base->getDest())->getID();
+            if (escapes[id] || count(effects.stores, id) != 1 || count(effects.loads, id) != 0) continue;
+
+            Instruction *value = getDef(instr->getOperand1());
+            if (value && loop->contains(value->getParent()) && loopInfo->getLoopFor(value->getParent()) != loop) continue;
+
+            bool everyExit = true;
+            for (Block *exiting : loop->getExitingBlocks()) {
+                if (!domTree->dominates(block, exiting)) everyExit = false;
+            }
+            if (!everyExit) continue;
+
+            Instruction *pos = exit->getFirst();
+            while (pos && pos->getType() == InstrType::Phi) pos = pos->getNext();
+
+            block->removeInstruction(instr);
+            if (pos) exit->insertBefore(pos, instr);
+            else exit->addInstruction(instr);
+            ++sunk;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool Mover::run(LoopInfo *loopInfo, DominatorTree *domTree) {
+    findAllocas();
+
+    std::unordered_map<Loop *, int> budgets;
+    bool changed = false;
+    for (Loop *loop : loopInfo->getLoopsInnermostFirst()) {
+        Loop *outermost = loop;
+        while (outermost->getParent()) outermost = outermost->getParent();
+        if (budgets.find(outermost) == budgets.end()) budgets[outermost] = MaxHoistedAddresses;
+
+        if (hoist(loop, budgets[outermost])) changed = true;
+
+        MemoryEffects effects = getEffects(loop);
+        if (sink(loop, loopInfo, domTree, effects)) changed = true;
+    }
+    return changed;
+}
+
+} // end namespace
+
+// New preheaders change the control flow, so the loops are found again before anything moves
+PreservedAnalyses LICMPass::run(Function *func, AnalysisManager &am) {
+    Mover mover(func);
+    bool cfgChanged = mover.createPreheaders(am.getResult<LoopInfo>(func));
+    if (cfgChanged) am.invalidate(func, PreservedAnalyses::none());
+
+    LoopInfo *loopInfo = am.getResult<LoopInfo>(func);
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    bool changed = mover.run(loopInfo, domTree);
+    hoisted += mover.getHoistedCount();
+    sunk += mover.getSunkCount();
+
+    if (cfgChanged) return PreservedAnalyses::none();
+    if (!changed) return PreservedAnalyses::all();
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    preserved.preserve<PostDominatorTree>();
+    preserved.preserve<LoopInfo>();
+    return preserved;
+}
+
+void LICMPass::printStatistics(std::ostream &out) {
+    out << getName() << ": " << hoisted << " instructions hoisted and " << sunk << " stores sunk" << std::endl;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,47 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <atomic>
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief Moves loop-invariant code out of loops
+ *
+ * Every loop is first given a preheader if it doesn't have one. Then, innermost loop first, the
+ * instructions whose operands are all defined outside the loop are moved to the preheader, as
+ * long as they can run even when the loop body would not: arithmetic, address computations,
+ * divisions by a constant that can't trap, and loads from local variables that nothing in the
+ * loop may write. A load through another pointer is only moved if it is in the header, before
+ * any branch, and the loop has no call and no store that could reach it.
+ *
+ * Memory is modelled with allocas. Two distinct allocas never overlap. An alloca whose address
+ * is used other than to load from it or store to it escapes, and may be touched by any call or
+ * any store through another pointer.
+ *
+ * A store to a local variable that doesn't escape is sunk to the loop exit, if the loop only has
+ * one, nothing else in the loop accesses the variable, and the store runs on every way out of the
+ * loop. The variable then gets written once instead of on every iteration.
+ *
+ * The hardware transformation can't spill addresses, so only a few are hoisted out of each loop
+ * nest.
+ */
+class LICMPass : public FunctionPass {
+public:
+    std::string getName() { return "licm"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+
+    void printStatistics(std::ostream &out);
+private:
+    std::atomic<size_t> hoisted{0};
+    std::atomic<size_t> sunk{0};
+};
+
+} // end namespace LLIR
+
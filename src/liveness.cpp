@@ -0,0 +1,143 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <algorithm>
+
+#include <liveness.hpp>
+#include <dataflow.hpp>
+
+namespace LLIR {
+
+char Liveness::ID = 0;
+
+Liveness::Liveness(Function *func, AnalysisManager &am) {
+    regCount = func->getRegCount();
+    scan(func);
+    solve(func);
+    buildRanges(func);
+}
+
+// A register becomes global when some block reads it before writing it, since only then can its
+// value come from another block. The kill lists can only be filtered once every block is scanned.
+void Liveness::scan(Function *func) {
+    int blockCount = func->getMaxBlockID() + 1;
+    globalIndex.assign(regCount, -1);
+    gen.assign(blockCount, std::vector<int>());
+    kill.assign(blockCount, std::vector<int>());
+
+    // The last block to write or to read each register, so each is listed once per block
+    std::vector<int> defBlock(regCount, -1);
+    std::vector<int> useBlock(regCount, -1);
+
+    for (Block *block : *func) {
+        int id = block->getID();
+        std::vector<int> &blockGen = gen[id];
+        std::vector<int> &blockKill = kill[id];
+
+        for (Instruction *instr : *block) {
+            forEachUse(instr, [&](Reg *reg) {
+                int r = reg->getID();
+                if (defBlock[r] == id || useBlock[r] == id) return;
+                useBlock[r] = id;
+
+                if (globalIndex[r] < 0) {
+                    globalIndex[r] = globalRegs.size();
+                    globalRegs.push_back(r);
+                }
+                blockGen.push_back(globalIndex[r]);
+            });
+
+            Reg *def = getDef(instr);
+            if (def && defBlock[def->getID()] != id) {
+                defBlock[def->getID()] = id;
+                blockKill.push_back(def->getID());
+            }
+        }
+    }
+
+    for (std::vector<int> &blockKill : kill) {
+        size_t count = 0;
+        for (int r : blockKill) {
+            if (globalIndex[r] >= 0) blockKill[count++] = globalIndex[r];
+        }
+        blockKill.resize(count);
+    }
+}
+
+// Liveness flows backwards, and what is live out of a block is everything live into its successors.
+// The gen and kill sets are short lists, so the transfer goes through them instead of full sets.
+class LiveProblem {
+public:
+    typedef BitVector Value;
+    static const Direction direction = Direction::Backward;
+
+    LiveProblem(size_t bits, std::vector<std::vector<int>> &gen, std::vector<std::vector<int>> &kill)
+        : bits(bits), gen(gen), kill(kill), scratch(bits) {}
+
+    Value boundary() { return BitVector(bits); }
+    Value initial() { return BitVector(bits); }
+    void meet(Value &into, const Value &other) { into.unionWith(other); }
+
+    bool transfer(Block *block, const Value &out, Value &in) {
+        scratch = out;
+        for (int r : kill[block->getID()]) scratch.reset(r);
+        for (int r : gen[block->getID()]) scratch.set(r);
+        if (scratch == in) return false;
+
+        std::swap(scratch, in);
+        return true;
+    }
+private:
+    size_t bits;
+    std::vector<std::vector<int>> &gen;
+    std::vector<std::vector<int>> &kill;
+    BitVector scratch;
+};
+
+void Liveness::solve(Function *func) {
+    LiveProblem problem(globalRegs.size(), gen, kill);
+    solveDataflow(func, problem, liveIn, liveOut);
+}
+
+void Liveness::buildRanges(Function *func) {
+    ranges.assign(regCount, LiveRange());
+    blockStart.assign(liveIn.size(), 0);
+
+    auto extend = [this](int id, int pos) {
+        LiveRange &range = ranges[id];
+        if (range.empty()) {
+            range.start = pos;
+            range.end = pos;
+        } else {
+            range.start = std::min(range.start, pos);
+            range.end = std::max(range.end, pos);
+        }
+    };
+
+    int pos = 0;
+    for (Block *block : *func) {
+        int id = block->getID();
+        int start = pos;
+        blockStart[id] = start;
+
+        const BitVector &in = liveIn[id];
+        for (size_t i = in.findNext(0); i<in.size(); i = in.findNext(i + 1)) extend(globalRegs[i], start);
+
+        for (Instruction *instr : *block) {
+            forEachUse(instr, [&](Reg *reg) { extend(reg->getID(), pos); });
+            Reg *def = getDef(instr);
+            if (def) extend(def->getID(), pos);
+            ++pos;
+        }
+
+        int last = std::max(start, pos - 1);
+        const BitVector &out = liveOut[id];
+        for (size_t i = out.findNext(0); i<out.size(); i = out.findNext(i + 1)) extend(globalRegs[i], last);
+    }
+
+    instrCount = pos;
+}
+
+} // end namespace LLIR
@@ -0,0 +1,157 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <vector>
+
+#include "llir.hpp"
+#include "pass.hpp"
+#include "bitvector.hpp"
+
+namespace LLIR {
+
+/*! \brief The stretch of a function where a register holds a value that is still needed
+ *
+ * Positions are instruction numbers (see Liveness). The range covers both ends, and spans any
+ * holes in between, so two registers whose ranges don't overlap can share a location.
+ */
+struct LiveRange {
+    int start = -1;
+    int end = -1;
+
+    bool empty() const { return start < 0; }
+    bool overlaps(const LiveRange &other) const {
+        return !empty() && !other.empty() && start <= other.end && other.start <= end;
+    }
+};
+
+/*! \brief Which virtual registers are live where
+ *
+ * A register is live at a point if some path from there reads it before writing it. The analysis
+ * gives the registers live on entry to and exit from each block, and the live range of each register.
+ *
+ * Most registers are written and read within a single block, and can never be live across a block
+ * boundary. Only the others, the global registers, are tracked from block to block. They are
+ * numbered densely, and the live-in and live-out sets are bitvectors indexed by that number.
+ *
+ * For the ranges, the instructions of the function are numbered from 0 in layout order. A register
+ * live into a block is live from the block's first instruction, and one live out of a block is live
+ * through its last.
+ *
+ * Registers read before any write (such as the arguments) are live on entry to the function.
+ */
+class Liveness : public FunctionAnalysis {
+public:
+    static char ID;
+
+    Liveness(Function *func, AnalysisManager &am);
+
+    /*! \brief Returns the global registers live on entry to a block
+     *
+     */
+    const BitVector &getLiveIn(Block *block) { return liveIn[block->getID()]; }
+
+    /*! \brief Returns the global registers live on exit from a block
+     *
+     */
+    const BitVector &getLiveOut(Block *block) { return liveOut[block->getID()]; }
+
+    /*! \brief Returns true if a register is live on entry to a block
+     *
+     */
+    bool isLiveIn(Block *block, Reg *reg) {
+        int index = globalIndex[reg->getID()];
+        return index >= 0 && liveIn[block->getID()].test(index);
+    }
+
+    /*! \brief Returns true if a register is live on exit from a block
+     *
+     */
+    bool isLiveOut(Block *block, Reg *reg) {
+        int index = globalIndex[reg->getID()];
+        return index >= 0 && liveOut[block->getID()].test(index);
+    }
+
+    /*! \brief Returns the number of a global register in the live sets, or -1 for a local register
+     *
+     */
+    int getGlobalIndex(Reg *reg) { return globalIndex[reg->getID()]; }
+
+    /*! \brief Returns the ID of the register with a given number in the live sets
+     *
+     */
+    int getGlobalReg(int index) { return globalRegs[index]; }
+
+    /*! \brief Returns the number of global registers, which is the size of every live set
+     *
+     */
+    int getGlobalCount() { return globalRegs.size(); }
+
+    /*! \brief Returns the live range of a register
+     *
+     * The range is empty for registers that are never used nor defined.
+     */
+    const LiveRange &getRange(Reg *reg) { return ranges[reg->getID()]; }
+    const LiveRange &getRange(int id) { return ranges[id]; }
+
+    /*! \brief Returns the number of the first instruction of a block
+     *
+     * For an empty block, this is the number of the next instruction in the function.
+     */
+    int getBlockStart(Block *block) { return blockStart[block->getID()]; }
+
+    /*! \brief Returns how many instructions were numbered
+     *
+     */
+    int getInstrCount() { return instrCount; }
+
+    /*! \brief Returns the number of registers of the function
+     *
+     */
+    int getRegCount() { return regCount; }
+
+    /*! \brief Calls a function for every register an instruction reads
+     *
+     */
+    template <class F>
+    static void forEachUse(Instruction *instr, F f) {
+        for (int i = 0; i<instr->getOperandCount(); i++) {
+            Operand *op = instr->getOperand(i);
+            if (op && op->getType() == OpType::Reg) f(static_cast<Reg *>(op));
+        }
+    }
+
+    /*! \brief Returns the register an instruction writes, or nullptr if it doesn't write one
+     *
+     */
+    static Reg *getDef(Instruction *instr) {
+        Operand *dest = instr->getDest();
+        if (dest && dest->getType() == OpType::Reg) return static_cast<Reg *>(dest);
+        return nullptr;
+    }
+private:
+    void scan(Function *func);
+    void solve(Function *func);
+    void buildRanges(Function *func);
+
+    int regCount = 0;
+    int instrCount = 0;
+    std::vector<int> globalIndex;
+    std::vector<int> globalRegs;
+
+    // What each block reads before writing (gen) and writes (kill), as global register numbers.
+    // These are short, so they are kept as lists rather than sets.
+    std::vector<std::vector<int>> gen;
+    std::vector<std::vector<int>> kill;
+
+    std::vector<BitVector> liveIn;
+    std::vector<BitVector> liveOut;
+    std::vector<LiveRange> ranges;
+    std::vector<int> blockStart;
+};
+
+} // end namespace LLIR
+
@@ -3,6 +3,9 @@
 // This file is part of the LLIR framework.
 // LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
 //
+#include <iostream>
+#include <algorithm>
+
 #include "llir.hpp"
 
 namespace LLIR {
@@ -15,15 +18,6 @@ PointerType::PointerType(Type *baseType) {
     this->baseType = baseType;
 }
 
-PointerType::PointerType(DataType type) {
-    this->type = DataType::Ptr;
-    this->baseType = new Type(type);
-}
-
-PointerType::~PointerType() {
-    if (baseType) delete baseType;
-}
-
 //
 // Structure Type
 //
@@ -34,14 +28,72 @@ StructType::StructType(std::string name, std::vector<Type *> elementTypes) {
     this->elementTypes = elementTypes;
 }
 
-StructType::~StructType() {
-    for (Type *t : elementTypes) {
-        if (t) delete t;
+//
+// Type context
+//
+
+// The primitive types
+// These are immutable, so they are shared by every type context
+Type TypeContext::voidType(DataType::Void);
+Type TypeContext::i8Type(DataType::I8);
+Type TypeContext::i16Type(DataType::I16);
+Type TypeContext::i32Type(DataType::I32);
+Type TypeContext::i64Type(DataType::I64);
+Type TypeContext::f32Type(DataType::F32);
+Type TypeContext::f64Type(DataType::F64);
+
+TypeContext::TypeContext() {}
+
+Type *TypeContext::getVoidType() { return &voidType; }
+Type *TypeContext::getI8Type() { return &i8Type; }
+Type *TypeContext::getI16Type() { return &i16Type; }
+Type *TypeContext::getI32Type() { return &i32Type; }
+Type *TypeContext::getI64Type() { return &i64Type; }
+
+Type *TypeContext::getType(DataType type) {
+    switch (type) {
+        case DataType::Void: return &voidType;
+        case DataType::I8: return &i8Type;
+        case DataType::I16: return &i16Type;
+        case DataType::I32: return &i32Type;
+        case DataType::I64: return &i64Type;
+        case DataType::F32: return &f32Type;
+        case DataType::F64: return &f64Type;
+        
+        default: {}
     }
+    
+    return nullptr;
+}
+
+PointerType *TypeContext::getPointerType(Type *baseType) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = pointerTypes.find(baseType);
+    if (it != pointerTypes.end()) return it->second;
+    
+    PointerType *type = arena.create<PointerType>(baseType);
+    pointerTypes[baseType] = type;
+    return type;
+}
+
+StructType *TypeContext::getStructType(std::string name, std::vector<Type *> elementTypes) {
+    StructKey key = { name, elementTypes };
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = structTypes.find(key);
+    if (it != structTypes.end()) return it->second;
+    
+    StructType *type = arena.create<StructType>(name, elementTypes);
+    structTypes[key] = type;
+    return type;
 }
 
-std::vector<Type *> StructType::getElementTypes() {
-    return elementTypes;
+// Element types are uniqued, so hashing their pointers is enough
+size_t TypeContext::StructKeyHash::operator()(const StructKey &key) const {
+    size_t hash = std::hash<std::string>()(key.name);
+    for (Type *t : key.elementTypes) {
+        hash = hash * 31 + std::hash<Type *>()(t);
+    }
+    return hash;
 }
 
 //
@@ -50,19 +102,17 @@ std::vector<Type *> StructType::getElementTypes() {
 
 Instruction::Instruction(InstrType type) {
     this->type = type;
-    dataType = new Type(DataType::Void);
+    dataType = TypeContext::getVoidType();
+    
+    for (int i = 0; i<3; i++) {
+        srcs[i].init(this, i);
+    }
 }
 
-Instruction::~Instruction() {
-    if (dataType) delete dataType;
-    if (dest) delete dest;
-    if (src1) delete src1;
-    if (src2) delete src2;
-    if (src3) delete src3;
-}
+// The operands and types are owned by the module arena
+Instruction::~Instruction() {}
 
 void Instruction::setDataType(Type *d) {
-    if (dataType) delete dataType;
     dataType = d;
 }
 
@@ -71,15 +121,21 @@ void Instruction::setDest(Operand *d) {
 }
 
 void Instruction::setOperand1(Operand *o) {
-    src1 = o;
+    setOperand(0, o);
 }
 
 void Instruction::setOperand2(Operand *o) {
-    src2 = o;
+    setOperand(1, o);
 }
 
 void Instruction::setOperand3(Operand *o) {
-    src3 = o;
+    setOperand(2, o);
+}
+
+// Retargeting a branch changes the edges of its block
+void Instruction::setOperand(int pos, Operand *o) {
+    getOperandUse(pos)->set(o);
+    if (parent && isBranch()) parent->invalidateSuccessors();
 }
 
 InstrType Instruction::getType() {
@@ -95,60 +151,200 @@ Operand *Instruction::getDest() {
 }
 
 Operand *Instruction::getOperand1() {
-    return src1;
+    return srcs[0].get();
 }
 
 Operand *Instruction::getOperand2() {
-    return src2;
+    return srcs[1].get();
 }
 
 Operand *Instruction::getOperand3() {
-    return src3; 
+    return srcs[2].get();
+}
+
+int Instruction::getOperandCount() {
+    return 3;
+}
+
+Use *Instruction::getOperandUse(int pos) {
+    return &srcs[pos];
+}
+
+bool Instruction::isBranch() {
+    switch (type) {
+        case InstrType::Br:
+        case InstrType::Beq:
+        case InstrType::Bne:
+        case InstrType::Bgt:
+        case InstrType::Blt:
+        case InstrType::Bge:
+        case InstrType::Ble: return true;
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+bool Instruction::isTerminator() {
+    return type == InstrType::Br || type == InstrType::Ret || type == InstrType::RetVoid;
+}
+
+// The unconditional branch takes its label first; the conditional ones take it after
+// the two values they compare
+Label *Instruction::getBranchLabel() {
+    if (!isBranch()) return nullptr;
+    
+    Operand *label = (type == InstrType::Br) ? getOperand1() : getOperand3();
+    if (label == nullptr || label->getType() != OpType::Label) return nullptr;
+    return static_cast<Label *>(label);
+}
+
+void Instruction::dropAllReferences() {
+    for (int i = 0; i<getOperandCount(); i++) {
+        getOperandUse(i)->set(nullptr);
+    }
+}
+
+void Instruction::eraseFromParent() {
+    dropAllReferences();
+    if (parent) parent->removeInstruction(this);
 }
 
 //
 // Function call instructions
 //
 
-FunctionCall::FunctionCall(std::string name, std::vector<Operand *> args) : Instruction(InstrType::Call) {
+FunctionCall::FunctionCall(Symbol name, std::vector<Operand *> args) : Instruction(InstrType::Call) {
     this->name = name;
-    this->args = args;
+    setArgs(args);
 }
 
 void FunctionCall::setArgs(std::vector<Operand *> args) {
-    this->args = args;
+    dropAllReferences();
+    
+    argCount = args.size();
+    this->args.reset(new Use[argCount]);
+    for (int i = 0; i<argCount; i++) {
+        this->args[i].init(this, i);
+        this->args[i].set(args.at(i));
+    }
 }
 
-std::string FunctionCall::getName() {
+Symbol FunctionCall::getName() {
     return name;
 }
 
 std::vector<Operand *> FunctionCall::getArgs() {
-    return args;
+    std::vector<Operand *> list;
+    for (int i = 0; i<argCount; i++) {
+        list.push_back(args[i].get());
+    }
+    return list;
+}
+
+int FunctionCall::getOperandCount() {
+    return argCount;
+}
+
+Use *FunctionCall::getOperandUse(int pos) {
+    return &args[pos];
+}
+
+//
+// Phi nodes
+//
+
+void PhiNode::addIncoming(Operand *value, Label *block) {
+    for (Operand *op : { value, static_cast<Operand *>(block) }) {
+        incoming.emplace_back();
+        incoming.back().init(this, incoming.size() - 1);
+        incoming.back().set(op);
+    }
+}
+
+void PhiNode::removeIncoming(int pos) {
+    int last = getIncomingCount() - 1;
+    if (pos != last) {
+        incoming[pos * 2].set(incoming[last * 2].get());
+        incoming[pos * 2 + 1].set(incoming[last * 2 + 1].get());
+    }
+    
+    for (int i = 0; i<2; i++) {
+        incoming.back().set(nullptr);
+        incoming.pop_back();
+    }
+}
+
+Label *PhiNode::getIncomingLabel(int pos) {
+    return static_cast<Label *>(incoming[pos * 2 + 1].get());
+}
+
+int PhiNode::getIncomingIndex(Symbol block) {
+    for (int i = 0; i<getIncomingCount(); i++) {
+        if (getIncomingLabel(i)->getName() == block) return i;
+    }
+    return -1;
+}
+
+int PhiNode::getOperandCount() {
+    return incoming.size();
+}
+
+Use *PhiNode::getOperandUse(int pos) {
+    return &incoming[pos];
 }
 
 //
 // Blocks
 //
-Block::Block(std::string name) {
+Block::Block(Symbol name) {
     this->name = name;
 }
 
-Block::~Block() {
-    for (Instruction *i : instrs) {
-        if (i) delete i;
-    }
+Block::~Block() {}
+
+Block *Block::Create(Function *func, std::string name) {
+    Module *mod = func->getModule();
+    return mod->getArena()->create<Block>(mod->intern(name));
 }
 
+// Only branches and terminators decide where control goes, so nothing else
+// needs to touch the edges
 void Block::addInstruction(Instruction *i) {
+    i->setParent(this);
     instrs.push_back(i);
+    if (i->isBranch() || i->isTerminator()) invalidateSuccessors();
+}
+
+void Block::insertBefore(Instruction *pos, Instruction *i) {
+    i->setParent(this);
+    instrs.insertBefore(pos, i);
+    if (i->isBranch() || i->isTerminator()) invalidateSuccessors();
+}
+
+void Block::insertAfter(Instruction *pos, Instruction *i) {
+    i->setParent(this);
+    instrs.insertAfter(pos, i);
+    if (i->isBranch() || i->isTerminator()) invalidateSuccessors();
+}
+
+void Block::removeInstruction(Instruction *i) {
+    instrs.remove(i);
+    i->setParent(nullptr);
+    if (i->isBranch() || i->isTerminator()) invalidateSuccessors();
+}
+
+void Block::invalidateSuccessors() {
+    if (parent) parent->invalidateSuccessors(this);
+    else succsDirty = true;
 }
 
 void Block::setID(int id) {
     this->id = id;
 }
 
-std::string Block::getName() {
+Symbol Block::getName() {
     return name;
 }
 
@@ -160,67 +356,149 @@ int Block::getInstrCount() {
     return instrs.size();
 }
 
-Instruction *Block::getInstruction(int pos) {
-    return instrs.at(pos);
-}
-
 //
 // Functions
 //
-Function::Function(std::string name, Linkage linkage) {
-    this->name = name;
+Function::Function(Module *mod, std::string name, Linkage linkage) {
+    this->mod = mod;
+    this->name = mod->intern(name);
     this->linkage = linkage;
-    dataType = new Type(DataType::Void);
+    dataType = TypeContext::getVoidType();
 }
 
-Function::~Function() {
-    if (dataType) delete dataType;
-    for (Block *block : blocks) {
-        if (block) delete block;
-    }
-    for (Reg *reg : varRegs) {
-        if (reg) delete reg;
-    }
-    for (Type *t : args) {
-        if (t) delete t;
-    }
+// Blocks, registers, and types are owned by the module arena
+Function::~Function() {}
+
+Function *Function::Create(Module *mod, std::string name, Linkage linkage, Type *dataType) {
+    Function *func = mod->getArena()->create<Function>(mod, name, linkage);
+    func->setDataType(dataType);
+    return func;
 }
 
 void Function::setDataType(Type *d) {
-    if (dataType) delete dataType;
     dataType = d;
 }
 
 void Function::setArgs(std::vector<Type *> args) {
     this->args = args;
     for (int i = 0; i<args.size(); i++) {
-        Reg *reg = new Reg(std::to_string(i));
-        varRegs.push_back(reg);
+        varRegs.push_back(createReg());
     }
 }
 
+Reg *Function::createReg(std::string name) {
+    requireBody();
+    Reg *reg = mod->getArena()->create<Reg>(regCount, name);
+    ++regCount;
+    return reg;
+}
+
 void Function::addArgPair(Type *type, Reg *reg) {
     args.push_back(type);
     varRegs.push_back(reg);
 }
 
-void Function::addBlock(Block *block) {
+// Gives a newly linked block its ID and records it in the lookup tables.
+// The block before it may have fallen through to something else until now, and
+// branches that named the block before it existed can now be resolved.
+void Function::registerBlock(Block *block) {
     block->setID(blockID);
+    block->setParent(this);
     ++blockID;
+    
+    blockTable.emplace(block->getName(), block);
+    blockIDTable.push_back(block);
+    
+    block->succsDirty = true;
+    dirtyBlocks.push_back(block);
+    ordersValid = false;
+    
+    if (block->getPrev()) invalidateSuccessors(block->getPrev());
+    for (Block *unresolved : unresolvedBlocks) {
+        if (unresolved->getParent() == this) invalidateSuccessors(unresolved);
+    }
+    unresolvedBlocks.clear();
+}
+
+void Function::addBlock(Block *block) {
+    requireBody();
     blocks.push_back(block);
+    registerBlock(block);
 }
 
 void Function::addBlockAfter(Block *block, Block *newBlock) {
-    for (int i = 0; i<blocks.size(); i++) {
-        if (block->getID() == blocks.at(i)->getID()) {
-            blocks.insert(blocks.begin() + i + 1, newBlock);
-            newBlock->setID(blockID);
-            ++blockID;
-        }
+    requireBody();
+    blocks.insertAfter(block, newBlock);
+    registerBlock(newBlock);
+}
+
+void Function::addBlockBefore(Block *block, Block *newBlock) {
+    requireBody();
+    blocks.insertBefore(block, newBlock);
+    registerBlock(newBlock);
+}
+
+// The ID slot is left empty rather than reused, so the IDs of the other blocks don't change.
+// Every block with an edge to the removed one has to look at its branches again.
+void Function::removeBlock(Block *block) {
+    requireBody();
+    Block *prev = block->getPrev();
+    blocks.remove(block);
+    block->setParent(nullptr);
+    
+    if (prev) invalidateSuccessors(prev);
+    for (Block *pred : block->preds) invalidateSuccessors(pred);
+    // A successor that was removed first has already dropped its edges
+    for (Block *succ : block->succs) {
+        auto edge = std::find(succ->preds.begin(), succ->preds.end(), block);
+        if (edge != succ->preds.end()) succ->preds.erase(edge);
+    }
+    block->succs.clear();
+    block->preds.clear();
+    block->succsDirty = true;
+    ordersValid = false;
+    
+    auto it = blockTable.find(block->getName());
+    if (it != blockTable.end() && it->second == block) blockTable.erase(it);
+    
+    int id = block->getID();
+    if (id > 0 && id <= (int)blockIDTable.size() && blockIDTable[id-1] == block) {
+        blockIDTable[id-1] = nullptr;
+    }
+}
+
+Block *Function::getBlockByName(std::string name) {
+    Symbol sym = mod->getSymbolTable()->find(name);
+    if (sym.empty()) return nullptr;
+    return getBlockByName(sym);
+}
+
+Block *Function::getBlockByName(Symbol name) {
+    requireBody();
+    auto it = blockTable.find(name);
+    if (it == blockTable.end()) return nullptr;
+    return it->second;
+}
+
+Block *Function::getBlockByID(int id) {
+    requireBody();
+    if (id <= 0 || id > (int)blockIDTable.size()) return nullptr;
+    return blockIDTable[id-1];
+}
+
+// The materializer is cleared first, so building the body doesn't recurse back into here.
+// A body that fails to build is left empty.
+void Function::materialize() {
+    Materializer *m = materializer;
+    if (m == nullptr) return;
+    
+    materializer = nullptr;
+    if (!m->materialize(this)) {
+        std::cerr << "Error: Unable to load the body of function " << name << std::endl;
     }
 }
 
-std::string Function::getName() {
+Symbol Function::getName() {
     return name;
 }
 
@@ -229,11 +507,14 @@ Linkage Function::getLinkage() {
 }
 
 int Function::getBlockCount() {
+    requireBody();
     return blocks.size();
 }
 
-Block *Function::getBlock(int pos) {
-    return blocks.at(pos);
+int Function::getInstrCount() {
+    int count = 0;
+    for (Block *block : *this) count += block->getInstrCount();
+    return count;
 }
 
 int Function::getArgCount() {
@@ -251,22 +532,101 @@ Reg *Function::getArg(int pos) {
 //
 // Modules
 //
-Module::Module(std::string name) {
+
+// Each thread remembers the arena it last used, along with the serial number of its module.
+// Serial numbers are never reused, so the cache can't hand out the arena of a deleted module.
+namespace {
+
+struct ArenaCache {
+    uint64_t serial = 0;
+    Arena *arena = nullptr;
+};
+
+thread_local ArenaCache arenaCache;
+std::atomic<uint64_t> nextSerial(1);
+
+}
+
+Module::Module(std::string name) : stringCount(0) {
     this->name = name;
+    arena = new Arena;
+    owner = std::this_thread::get_id();
+    serial = nextSerial++;
+    typeContext = new TypeContext;
+    symbols = new StringInterner;
 }
 
+// Everything we own lives in the arenas, so this releases the entire module
 Module::~Module() {
-    for (Function *f : functions) {
-        if (f) delete f;
+    delete materializer;
+    delete typeContext;
+    for (auto &entry : threadArenas) delete entry.second;
+    delete arena;
+    delete symbols;
+}
+
+// The lock is only taken when a thread first uses the module, or comes back to it from another one
+Arena *Module::getArena() {
+    if (arenaCache.serial == serial) return arenaCache.arena;
+    
+    Arena *threadArena = arena;
+    if (std::this_thread::get_id() != owner) {
+        std::lock_guard<std::mutex> guard(arenaLock);
+        Arena *&entry = threadArenas[std::this_thread::get_id()];
+        if (entry == nullptr) entry = new Arena;
+        threadArena = entry;
     }
+    
+    arenaCache.serial = serial;
+    arenaCache.arena = threadArena;
+    return threadArena;
 }
 
 void Module::addFunction(Function *func) {
+    std::lock_guard<std::shared_timed_mutex> guard(tableLock);
     functions.push_back(func);
+    functionTable.emplace(func->getName(), func);
+}
+
+// If another function shares the name, it takes over the table entry
+void Module::removeFunction(Function *func) {
+    std::lock_guard<std::shared_timed_mutex> guard(tableLock);
+    for (auto it = functions.begin(); it != functions.end(); it++) {
+        if (*it == func) {
+            functions.erase(it);
+            break;
+        }
+    }
+    
+    auto entry = functionTable.find(func->getName());
+    if (entry == functionTable.end() || entry->second != func) return;
+    functionTable.erase(entry);
+    
+    for (Function *f : functions) {
+        if (f->getName() == func->getName()) {
+            functionTable.emplace(f->getName(), f);
+            break;
+        }
+    }
 }
 
 void Module::addStringPtr(StringPtr *ptr) {
+    std::lock_guard<std::shared_timed_mutex> guard(tableLock);
     strings.push_back(ptr); 
+    stringTable.emplace(ptr->getName(), ptr);
+}
+
+Symbol Module::createStringName() {
+    return intern("STR" + std::to_string(stringCount++));
+}
+
+void Module::setMaterializer(Materializer *materializer) {
+    if (this->materializer != materializer) delete this->materializer;
+    this->materializer = materializer;
+}
+
+void Module::materializeAll() {
+    for (Function *func : functions) func->materialize();
 }
 
 std::string Module::getName() {
@@ -289,11 +649,31 @@ StringPtr *Module::getString(int pos) {
     return strings.at(pos);
 }
 
+// A name that was never interned can't belong to any function
 Function *Module::getFunctionByName(std::string fname) {
-    for (Function *f : functions) {
-        if (f->getName() == fname) return f;
-    }
-    return nullptr;
+    Symbol sym = symbols->find(fname);
+    if (sym.empty()) return nullptr;
+    return getFunctionByName(sym);
+}
+
+Function *Module::getFunctionByName(Symbol fname) {
+    std::shared_lock<std::shared_timed_mutex> guard(tableLock);
+    auto it = functionTable.find(fname);
+    if (it == functionTable.end()) return nullptr;
+    return it->second;
+}
+
+StringPtr *Module::getStringByName(std::string name) {
+    Symbol sym = symbols->find(name);
+    if (sym.empty()) return nullptr;
+    return getStringByName(sym);
+}
+
+StringPtr *Module::getStringByName(Symbol name) {
+    std::shared_lock<std::shared_timed_mutex> guard(tableLock);
+    auto it = stringTable.find(name);
+    if (it == stringTable.end()) return nullptr;
+    return it->second;
 }
 
 
@@ -7,8 +7,18 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
 
 #include "llir_operand.hpp"
+#include "arena.hpp"
+#include "ilist.hpp"
+#include "symbol.hpp"
 
 namespace LLIR {
 
@@ -77,10 +87,17 @@ enum class InstrType {
     Load,
     GEP,
     StructStore,
-    Store
+    Store,
+    
+    // SSA form
+    // These only exist between mem2reg and the hardware transform, which turns
+    // the phi nodes back into copies
+    Phi,
+    Copy
 };
 
 // Forward declarations
+class Module;
 class Function;
 class Block;
 class Instruction;
@@ -91,34 +108,34 @@ class StringPtr;
 /*! \brief Type- The base of all data types
  *
  * This class represents the basic integer types, and forms the base of more advanced types such
- * as the PointerType and the Structure Type
+ * as the PointerType and the Structure Type.
+ *
+ * Types are immutable and uniqued. They can only be obtained from a TypeContext, which always hands
+ * back the same object for the same type. Because of this, two types are equal if and only if their
+ * pointers are equal.
  */
 class Type {
 public:
-    /*! \brief Create a new type
-     *
-     * @param type The "type" of our type
-     */
-    explicit Type(DataType type) {
-        this->type = type;
-    }
-    
     virtual ~Type() {}
     
-    // Convience creators for types
-    static Type *createVoidType() { return new Type(DataType::Void); }
-    static Type *createI8Type() { return new Type(DataType::I8); }
-    static Type *createI16Type() { return new Type(DataType::I16); }
-    static Type *createI32Type() { return new Type(DataType::I32); }
-    static Type *createI64Type() { return new Type(DataType::I64); }
-    
     /*! \brief Returns what kind of type you have
      *
      */
-    DataType getType() { return type; }
+    DataType getType() const { return type; }
     
     virtual void print();
 protected:
+    friend class Arena;
+    friend class TypeContext;
+    
+    /*! \brief Create a new type
+     *
+     * @param type The "type" of our type
+     */
+    explicit Type(DataType type) {
+        this->type = type;
+    }
+    
     explicit Type() {}
     DataType type = DataType::Void;
 };
@@ -130,33 +147,22 @@ protected:
  */
 class PointerType : public Type {
 public:
-    /*! \brief Create a new Pointer Type
-     *
-     * Creates a new pointer type with another Type (or PointerType) object as the base.
-     */
-    explicit PointerType(Type *baseType);
-    
-    /*! \brief Create a new Pointer Type
+    /*! \brief Returns the base type of the pointer
      *
-     * Creates a new pointer type based on a value from the type enumeration
      */
-    explicit PointerType(DataType type);
+    Type *getBaseType() const { return baseType; }
     
-    ~PointerType();
-    
-    static PointerType *createVoidPtrType() { return new PointerType(DataType::Void); }
-    static PointerType *createI8PtrType() { return new PointerType(DataType::I8); }
-    static PointerType *createI16PtrType() { return new PointerType(DataType::I16); }
-    static PointerType *createI32PtrType() { return new PointerType(DataType::I32); }
-    static PointerType *createI64PtrType() { return new PointerType(DataType::I64); }
+    void print();
+private:
+    friend class Arena;
+    friend class TypeContext;
     
-    /*! \brief Returns the base type of the pointer
+    /*! \brief Create a new Pointer Type
      *
+     * Creates a new pointer type with another Type (or PointerType) object as the base.
      */
-    Type *getBaseType() { return baseType; }
+    explicit PointerType(Type *baseType);
     
-    void print();
-private:
     Type *baseType = nullptr;
 };
 
@@ -167,22 +173,94 @@ private:
  */
 class StructType : public Type {
 public:
+    /*! \brief Returns a list of the element types
+     */
+    const std::vector<Type *> &getElementTypes() const { return elementTypes; }
+    
+    /*! \brief Returns the name of the structure
+     */
+    const std::string &getName() const { return name; }
+    
+    void print();
+private:
+    friend class Arena;
+    friend class TypeContext;
+    
     /*! \brief Create a new structure type
      *
      * @param name The name of the structure
      * @param elementTypes The types of each member
      */
     explicit StructType(std::string name, std::vector<Type *> elementTypes);
-    ~StructType();
     
-    /*! \brief Returns a list of the element types
+    std::string name = "";
+    std::vector<Type *> elementTypes;
+};
+
+/*! \brief The owner of all types in a module
+ *
+ * The type context hands out canonical type objects. The primitive types are singletons, and pointer
+ * and structure types are hash-consed, so asking for the same type twice returns the same object. This
+ * means types can be compared with a pointer compare.
+ *
+ * Every module has its own type context. Derived types live in an arena owned by the context.
+ *
+ * The type context is safe to use from several threads at once. The primitive types need no locking;
+ * the lookup of derived types takes a lock.
+ */
+class TypeContext {
+public:
+    /*! \brief Creates a new type context
+     *
      */
-    std::vector<Type *> getElementTypes();
+    TypeContext();
     
-    void print();
+    // The primitive types
+    // These are immutable singletons shared by every context
+    static Type *getVoidType();
+    static Type *getI8Type();
+    static Type *getI16Type();
+    static Type *getI32Type();
+    static Type *getI64Type();
+    
+    /*! \brief Returns the type for a primitive data type
+     *
+     * @param type The primitive data type. This may not be Ptr or Struct.
+     */
+    static Type *getType(DataType type);
+    
+    /*! \brief Returns the pointer type for a given base type
+     *
+     * @param baseType The type being pointed to
+     */
+    PointerType *getPointerType(Type *baseType);
+    
+    /*! \brief Returns the structure type with a given name and layout
+     *
+     * @param name The name of the structure
+     * @param elementTypes The types of each member
+     */
+    StructType *getStructType(std::string name, std::vector<Type *> elementTypes);
 private:
-    std::string name = "";
-    std::vector<Type *> elementTypes;
+    struct StructKey {
+        std::string name;
+        std::vector<Type *> elementTypes;
+        
+        bool operator==(const StructKey &other) const {
+            return name == other.name && elementTypes == other.elementTypes;
+        }
+    };
+    
+    struct StructKeyHash {
+        size_t operator()(const StructKey &key) const;
+    };
+
+    static Type voidType, i8Type, i16Type, i32Type, i64Type, f32Type, f64Type;
+    
+    Arena arena;
+    std::mutex lock;
+    std::unordered_map<Type *, PointerType *> pointerTypes;
+    std::unordered_map<StructKey, StructType *, StructKeyHash> structTypes;
 };
 
 /*! \brief Represents an instruction in LLIR
@@ -190,15 +268,21 @@ private:
  * This class is used to represent a structure in LLIR. Although inheritence for more specific instructions can
  * be done, in general using this class should suffice for most instructions. If you are working in LLIR, only
  * extend this class if you have a specific need.
+ *
+ * Instructions and their operands are owned by the arena of the module they belong to. They should be
+ * created through the IRBuilder or Arena::create, and never freed directly.
+ *
+ * Instructions are linked directly into the list of their parent block. Each source operand is held in a
+ * Use, so every operand knows which instructions read it.
  */
-class Instruction {
+class Instruction : public IListNode<Instruction> {
 public:
     /*! \brief Create a new instruction
      *
      * @param type The type of instruction to be created
      */
     explicit Instruction(InstrType type);
-    ~Instruction();
+    virtual ~Instruction();
     
     /*! \brief Set the data type of the instruction
      *
@@ -265,14 +349,75 @@ public:
      */
     Operand *getOperand3();
     
+    /*! \brief Returns the number of source operand slots
+     *
+     * For most instructions, these are the three source operands (some of which may be empty). For
+     * function calls, these are the arguments.
+     */
+    virtual int getOperandCount();
+    
+    /*! \brief Returns the use for a source operand slot
+     *
+     * @param pos The operand slot, between 0 and getOperandCount()
+     */
+    virtual Use *getOperandUse(int pos);
+    
+    /*! \brief Returns the source operand in a given slot, or nullptr if it is empty
+     *
+     */
+    Operand *getOperand(int pos) { return getOperandUse(pos)->get(); }
+    
+    /*! \brief Sets the source operand in a given slot
+     *
+     */
+    void setOperand(int pos, Operand *o);
+    
+    /*! \brief Returns true if the instruction is a branch, conditional or not
+     *
+     */
+    bool isBranch();
+    
+    /*! \brief Returns true if control never goes past the instruction
+     *
+     * These are the unconditional branch and the returns.
+     */
+    bool isTerminator();
+    
+    /*! \brief Returns the label a branch jumps to, or nullptr if the instruction isn't a branch
+     *
+     */
+    Label *getBranchLabel();
+    
+    /*! \brief Clears all source operands
+     *
+     * This removes the instruction from the use-lists of everything it reads.
+     */
+    void dropAllReferences();
+    
+    /*! \brief Removes the instruction from its block and drops its operands
+     *
+     * The instruction itself stays allocated in the module arena.
+     */
+    void eraseFromParent();
+    
+    /*! \brief Returns the block that contains the instruction
+     *
+     */
+    Block *getParent() { return parent; }
+    
+    /*! \brief Sets the block that contains the instruction
+     *
+     * IMPORTANT: You should not use this function directly. It is managed by the parent block.
+     */
+    void setParent(Block *block) { parent = block; }
+    
     virtual void print();
 protected:
+    Block *parent = nullptr;
     Type *dataType;
     InstrType type = InstrType::None;
     Operand *dest = nullptr;
-    Operand *src1 = nullptr;
-    Operand *src2 = nullptr;
-    Operand *src3 = nullptr;
+    Use srcs[3];
 };
 
 /*! \brief Represents a function call instruction
@@ -286,7 +431,7 @@ public:
      * @param name The name of the function
      * @param args The function arguments to be passed
      */
-    explicit FunctionCall(std::string name, std::vector<Operand *> args);
+    explicit FunctionCall(Symbol name, std::vector<Operand *> args);
     
     /*! \brief Sets the function arguments
      *
@@ -297,43 +442,130 @@ public:
     /*! \brief Returns the name of the function
      *
      */
-    std::string getName();
+    Symbol getName();
     
     /*! \brief Returns the arguments of the function
      *
      */
     std::vector<Operand *> getArgs();
     
+    int getOperandCount();
+    Use *getOperandUse(int pos);
+    
     void print();
 private:
-    std::string name = "";
-    std::vector<Operand *> args;
+    Symbol name;
+    std::unique_ptr<Use[]> args;
+    int argCount = 0;
+};
+
+/*! \brief Represents a phi node
+ *
+ * A phi node takes its value from the block control came from. It has one incoming value for each
+ * predecessor of its block, stored in pairs of operand slots: the value, then a label naming the
+ * block it comes from.
+ *
+ * Phi nodes come before everything else in their block.
+ */
+class PhiNode : public Instruction {
+public:
+    PhiNode() : Instruction(InstrType::Phi) {}
+    
+    /*! \brief Adds an incoming value
+     *
+     * @param value The value of the node when control comes from the block
+     * @param block A label naming the block
+     */
+    void addIncoming(Operand *value, Label *block);
+    
+    /*! \brief Removes an incoming value
+     *
+     * The last incoming value takes its place.
+     */
+    void removeIncoming(int pos);
+    
+    /*! \brief Returns the number of incoming values
+     *
+     */
+    int getIncomingCount() { return incoming.size() / 2; }
+    
+    Operand *getIncomingValue(int pos) { return incoming[pos * 2].get(); }
+    void setIncomingValue(int pos, Operand *value) { incoming[pos * 2].set(value); }
+    Label *getIncomingLabel(int pos);
+    void setIncomingLabel(int pos, Label *block) { incoming[pos * 2 + 1].set(block); }
+    
+    /*! \brief Returns the position of the value coming from a block, or -1 if there is none
+     *
+     */
+    int getIncomingIndex(Symbol block);
+    
+    int getOperandCount();
+    Use *getOperandUse(int pos);
+    
+    void print();
+private:
+    // A deque never moves its elements, and uses must stay put while they are in a use-list
+    std::deque<Use> incoming;
 };
 
 /*! \brief Represents a basic block in LLIR
  *
  * Basic blocks form the base of instructions in LLIR. A basic block contains a variable
  * number of instructions, and terminates with either a branch or a return.
+ *
+ * The instructions are kept in an intrusive list, so inserting or removing an instruction
+ * anywhere in the block is constant time. Iterate over a block with a range-based for loop.
  */
-class Block {
+class Block : public IListNode<Block> {
 public:
     /*! \brief Creates a new LLIR block
      *
-     * You should use this constructor directly when you need to create a basic block, but
-     * when you do not want it to become the current insert point and/or you wish to insert
-     * it somewhere else within the function
+     * NOTE: In most cases, you should use the static version of this function. Use it when you
+     * need to create a basic block, but when you do not want it to become the current insert
+     * point and/or you wish to insert it somewhere else within the function
      *
      * @param name The name of the block. This must be unique.
      */
-    explicit Block(std::string name);
+    explicit Block(Symbol name);
     ~Block();
     
-    /*! \brief Adds an instruction to the block
+    /*! \brief Creates and returns a new block owned by a function's module
+     *
+     * The block is allocated in the module arena, but it is not inserted into the function.
+     *
+     * @param func The function the block will belong to
+     * @param name The name of the block. This must be unique.
+     */
+    static Block *Create(Function *func, std::string name);
+    
+    /*! \brief Adds an instruction to the end of the block
      *
      * @param i The instruction to add
      */
     void addInstruction(Instruction *i);
     
+    /*! \brief Inserts an instruction before an existing instruction
+     *
+     * @param pos The instruction to insert before. It must be part of this block.
+     * @param i The instruction to insert
+     */
+    void insertBefore(Instruction *pos, Instruction *i);
+    
+    /*! \brief Inserts an instruction after an existing instruction
+     *
+     * @param pos The instruction to insert after. It must be part of this block.
+     * @param i The instruction to insert
+     */
+    void insertAfter(Instruction *pos, Instruction *i);
+    
+    /*! \brief Unlinks an instruction from the block
+     *
+     * The instruction is not destroyed; it can be inserted somewhere else.
+     *
+     * @param i The instruction to remove. It must be part of this block.
+     */
+    void removeInstruction(Instruction *i);
+    
     /*! \brief Sets the unique ID for the block
      *
      * IMPORTANT: You should not use this function directly. It is managed by the parent function.
@@ -345,7 +577,7 @@ public:
     /*! \brief Returns the name of the block
      *
      */
-    std::string getName();
+    Symbol getName();
     
     /*! \brief Returns the ID of the block
      *
@@ -357,22 +589,96 @@ public:
      */
     int getInstrCount();
     
-    /*! \brief Returns the instruction at a given position
+    /*! \brief Returns the first instruction, or nullptr if the block is empty
+     *
+     */
+    Instruction *getFirst() { return instrs.front(); }
+    
+    /*! \brief Returns the last instruction, or nullptr if the block is empty
+     *
+     */
+    Instruction *getLast() { return instrs.back(); }
+    
+    /*! \brief Returns the function that contains the block
+     *
+     */
+    Function *getParent() { return parent; }
+    
+    /*! \brief Sets the function that contains the block
+     *
+     * IMPORTANT: You should not use this function directly. It is managed by the parent function.
+     */
+    void setParent(Function *func) { parent = func; }
+    
+    /*! \brief Returns the blocks control can go to from this block
+     *
+     * These are the targets of the branches in the block, followed by the next block in layout
+     * order if control can fall off the end of the block. Each block is listed once, and labels
+     * that don't name a block of the function are skipped.
      *
+     * The edges of a function are computed the first time they are needed, and cached. Adding,
+     * inserting, or removing instructions, setting the operands of a branch, and adding or removing
+     * blocks all keep the cache up to date.
      */
-    Instruction *getInstruction(int pos);
+    const std::vector<Block *> &getSuccessors();
+    
+    /*! \brief Returns the blocks that can go to this block, in no particular order
+     *
+     * See getSuccessors.
+     */
+    const std::vector<Block *> &getPredecessors();
+    
+    /*! \brief Marks the successors of the block as out of date
+     *
+     * The mutation functions call this already. It is only needed after retargeting a branch behind
+     * the block's back, such as through Use::set.
+     */
+    void invalidateSuccessors();
+    
+    // Iteration over the instructions
+    IList<Instruction>::iterator begin() { return instrs.begin(); }
+    IList<Instruction>::iterator end() { return instrs.end(); }
     
     void print();
 private:
-    std::string name = "";
-    std::vector<Instruction *> instrs;
+    friend class Function;
+    
+    Function *parent = nullptr;
+    Symbol name;
+    IList<Instruction> instrs;
     int id = 0;
+    
+    // The control flow edges. The successors are only valid while succsDirty is clear; the
+    // predecessors are only valid once every block of the function has valid successors.
+    std::vector<Block *> succs;
+    std::vector<Block *> preds;
+    bool succsDirty = true;
+};
+
+/*! \brief Provides the bodies of functions on demand
+ *
+ * A module loaded lazily starts out with stub functions: their name, linkage, type, and arguments
+ * are known, but their blocks have not been built yet. The first time the body of a stub is needed,
+ * the function asks its materializer to build it.
+ */
+class Materializer {
+public:
+    virtual ~Materializer() {}
+    
+    /*! \brief Builds the body of a stub function
+     *
+     * @return False if the body could not be built
+     */
+    virtual bool materialize(Function *func) = 0;
 };
 
 /*! \brief Represents a function in LLIR
  *
  * Represents a function in LLIR. An LLIR function can be a complete function with a body,
  * or it can be an extern function for linking purposes.
+ *
+ * The blocks are kept in an intrusive list in layout order. Iterate over a function with a
+ * range-based for loop.
  */
 class Function {
 public:
@@ -380,23 +686,24 @@ public:
      *
      * NOTE: In most cases, you should use the static version of this function.
      *
+     * @param mod The module that owns the function
      * @param name The name of the function
      * @param linkage The linkage type of the function
      */
-    explicit Function(std::string name, Linkage linkage);
+    explicit Function(Module *mod, std::string name, Linkage linkage);
     ~Function();
     
     /*! \brief Creates and returns a new function
      *
+     * The function is allocated in the module arena. It still needs to be added to the
+     * module with Module::addFunction.
+     *
+     * @param mod The module that owns the function
      * @param name The name of the function
      * @param linkage The linkage type of the function
      * @param dataType The data type (return type) of the function
      */
-    static Function *Create(std::string name, Linkage linkage, Type *dataType) {
-        Function *func = new Function(name, linkage);
-        func->setDataType(dataType);
-        return func;
-    }
+    static Function *Create(Module *mod, std::string name, Linkage linkage, Type *dataType);
     
     /*! \brief Sets the data type (return type) of the function
      *
@@ -414,13 +721,30 @@ public:
      */
     void setArgs(std::vector<Type *> args);
     
+    /*! \brief Creates a new virtual register for this function
+     *
+     * Registers are numbered densely in order of creation, starting at zero.
+     *
+     * @param name An optional name, used only when printing
+     */
+    Reg *createReg(std::string name = "");
+    
+    /*! \brief Returns the number of virtual registers created for this function
+     *
+     * Every register ID is less than this number.
+     */
+    int getRegCount() {
+        requireBody();
+        return regCount;
+    }
+    
     /*! \brief Sets an type-register pair for the function
      *
      * This adds an argument of a specific type with an associated register to the function. Note
      * that in most cases, you should not have to use this.
      *
      * @param type The type of the argument
-     * @param reg The associated register for the argument
+     * @param reg The associated register for the argument. This must come from createReg.
      */
     void addArgPair(Type *type, Reg *reg);
     
@@ -437,10 +761,30 @@ public:
      */
     void addBlockAfter(Block *block, Block *newBlock);
     
+    /*! \brief Adds a new block before an existing block
+     *
+     * @param block The current block- the "after" block
+     * @param newBlock The new block to add
+     */
+    void addBlockBefore(Block *block, Block *newBlock);
+    
+    /*! \brief Unlinks a block from the function
+     *
+     * The block and its instructions are not destroyed.
+     *
+     * @param block The block to remove. It must be part of this function.
+     */
+    void removeBlock(Block *block);
+    
     /*! \brief Returns the name of the function
      *
      */
-    std::string getName();
+    Symbol getName();
+    
+    /*! \brief Returns the module that owns the function
+     *
+     */
+    Module *getModule() { return mod; }
     
     /*! \brief Returns the linkage of the function
      *
@@ -452,10 +796,112 @@ public:
      */
     int getBlockCount();
     
-    /*! \brief Returns a block at given position
+    /*! \brief Returns the number of instructions in the function
+     *
+     * This walks the blocks, but not the instructions.
+     */
+    int getInstrCount();
+    
+    /*! \brief Returns the entry block, or nullptr if the function has no body
      *
      */
-    Block *getBlock(int pos);
+    Block *getEntryBlock() {
+        requireBody();
+        return blocks.front();
+    }
+    
+    /*! \brief Returns the last block in layout order
+     *
+     */
+    Block *getLastBlock() {
+        requireBody();
+        return blocks.back();
+    }
+    
+    /*! \brief Returns the block with a given name, or nullptr if there is none
+     *
+     */
+    Block *getBlockByName(std::string name);
+    Block *getBlockByName(Symbol name);
+    
+    /*! \brief Returns the block with a given ID, or nullptr if there is none
+     *
+     * Block IDs are assigned when a block is added to the function, starting at 1.
+     */
+    Block *getBlockByID(int id);
+    
+    /*! \brief Returns the largest block ID handed out so far
+     *
+     * IDs of removed blocks are never reused, so this can be more than the number of blocks. It is
+     * meant for sizing tables indexed by block ID.
+     */
+    int getMaxBlockID() {
+        requireBody();
+        return blockID - 1;
+    }
+    
+    // Iteration over the blocks
+    IList<Block>::iterator begin() {
+        requireBody();
+        return blocks.begin();
+    }
+    IList<Block>::iterator end() { return blocks.end(); }
+    
+    /*! \brief Returns the blocks reachable from the entry block, in post-order
+     *
+     * Every block comes after all of its successors, except along back edges. Like the edges
+     * themselves, the order is computed on first use and cached until the control flow changes.
+     */
+    const std::vector<Block *> &getPostOrder();
+    
+    /*! \brief Returns the blocks reachable from the entry block, in reverse post-order
+     *
+     * Every block comes before all of its successors, except along back edges. This is the
+     * usual order for forward dataflow problems.
+     */
+    const std::vector<Block *> &getReversePostOrder();
+    
+    /*! \brief Brings the edges of every block up to date
+     *
+     * This is done on demand by Block::getSuccessors and friends, so it rarely needs to be called.
+     */
+    void updateCFG();
+    
+    /*! \brief Splits blocks so that none has code after a conditional branch
+     *
+     * A block may go on after a conditional branch, so a value at the end of the block is not
+     * always the value on each of its edges. Passes that reason about whole blocks call this first.
+     * The code after each branch moves to a new block placed right after, which the old block
+     * falls into. Phi nodes are updated for the new edges.
+     *
+     * @return True if any block was split
+     */
+    bool splitAtBranches();
+    
+    /*! \brief Sets the materializer that will build the body of this function
+     *
+     * This turns the function into a stub. Anything that touches the blocks or registers of a stub
+     * builds its body first.
+     */
+    void setMaterializer(Materializer *materializer) { this->materializer = materializer; }
+    
+    /*! \brief Returns false if the function is a stub whose body has not been built yet
+     *
+     */
+    bool isMaterialized() { return materializer == nullptr; }
+    
+    /*! \brief Builds the body of the function if it is a stub
+     *
+     */
+    void materialize();
+    
+    /*! \brief Runs the hardware transformation on this function alone
+     *
+     * Functions can be transformed from several threads at once. See Module::transform.
+     *
+     * @return False if the registers could not be allocated; the error is printed
+     */
+    bool transform();
     
     /*! \brief Returns the number of arguments for the function
      *
@@ -474,18 +920,51 @@ public:
     
     void print();
 private:
+    friend class Block;
+    
+    void registerBlock(Block *block);
+    void requireBody() { if (materializer) materialize(); }
+    void invalidateSuccessors(Block *block);
+    void computeSuccessors(Block *block);
+    
+    Module *mod = nullptr;
+    Materializer *materializer = nullptr;
     Type *dataType;
-    std::string name = "";
+    Symbol name;
     Linkage linkage = Linkage::Local;
-    std::vector<Block *> blocks;
+    IList<Block> blocks;
+    std::unordered_map<Symbol, Block *> blockTable;
+    std::vector<Block *> blockIDTable;
     std::vector<Type *> args;
     std::vector<Reg *> varRegs;
     int blockID = 1;
+    int regCount = 0;
+    
+    // The blocks whose successors are out of date, the blocks with a branch to a label that
+    // didn't name a block when their edges were computed, and the cached block orders
+    std::vector<Block *> dirtyBlocks;
+    std::vector<Block *> unresolvedBlocks;
+    std::vector<Block *> postOrder;
+    std::vector<Block *> reversePostOrder;
+    bool ordersValid = false;
 };
 
 /*! \brief Represents a module (compilation unit) in LLIR
  *
  * A module is the base element of an LLIR project. A module corresponds to a single compilation unit.
+ *
+ * The module owns an arena, which holds every function, block, instruction, operand, and type created for
+ * it. All of these are released in one go when the module is destroyed. Types are obtained through the
+ * module's type context.
+ *
+ * Functions of one module may be built from several threads at once, as long as each function is built
+ * by a single thread (usually through its own IRBuilder). The rules are:
+ *   - Each thread allocates from its own arena, which getArena returns, so allocation needs no locking.
+ *   - Interning names, looking up types, and the add and lookup-by-name calls are thread-safe.
+ *   - An operand must not be used by functions that are being built on different threads, since
+ *     its use-list is not locked. Constants should be created per use, as the IRBuilder does.
+ *   - Everything else (iterating the functions, removing functions, transform, code generation, and
+ *     materializing stubs) must wait until the building threads are done.
  */
 class Module {
 public:
@@ -498,22 +977,63 @@ public:
     
     /*! \brief Adds a function to the module
      *
+     * This is thread-safe. The order of functions added from different threads depends on timing.
      */
     void addFunction(Function *func);
     
+    /*! \brief Removes a function from the module
+     *
+     * The function itself is not destroyed.
+     *
+     * @param func The function to remove. It must be part of this module.
+     */
+    void removeFunction(Function *func);
+    
     /*! \brief Adds a global string constant to the module
      *
      * In most cases, this would correspond the .data section on Linux.
      *
+     * This is thread-safe.
+     *
      * @param ptr The pointer to add
      */
     void addStringPtr(StringPtr *ptr);
     
+    /*! \brief Returns a fresh name for a string constant
+     *
+     * The names are unique within the module, even across builders and threads.
+     */
+    Symbol createStringName();
+    
     /*! \brief Returns the name of the module
      *
      */
     std::string getName();
     
+    /*! \brief Returns the arena that owns all IR objects of this module
+     *
+     * Every thread gets its own arena, so the result must not be handed to another thread. All of the
+     * arenas belong to the module and are released along with it.
+     */
+    Arena *getArena();
+    
+    /*! \brief Returns the context that owns all types of this module
+     *
+     */
+    TypeContext *getTypeContext() { return typeContext; }
+    
+    /*! \brief Returns the interned symbol for a string
+     *
+     * Function, block, label, and string constant names are all interned in the module, so they
+     * can be compared and hashed by pointer.
+     */
+    Symbol intern(std::string str) { return symbols->intern(str); }
+    
+    /*! \brief Returns the string table of the module
+     *
+     */
+    StringInterner *getSymbolTable() { return symbols; }
+    
     /*! \brief Returns the number of functions in the module
      *
      */
@@ -538,20 +1058,63 @@ public:
      *
      */
     Function *getFunctionByName(std::string fname);
+    Function *getFunctionByName(Symbol fname);
+    
+    /*! \brief Searches for and returns a string constant based on a given name
+     *
+     */
+    StringPtr *getStringByName(std::string name);
+    StringPtr *getStringByName(Symbol name);
+    
+    /*! \brief Sets the materializer for the stub functions of this module
+     *
+     * The module takes ownership of the materializer, and any previous one is destroyed.
+     */
+    void setMaterializer(Materializer *materializer);
+    
+    /*! \brief Builds the body of every stub function in the module
+     *
+     */
+    void materializeAll();
     
     /*! \brief Hardware transformation
      *
      * This runs the transform layer. The transform layer is in charge of converting virtual registers
      * to real-world hardware elements. This MUST be called before using a hardware translation
      * layer.
+     *
+     * The functions are transformed in parallel (see parallelFor). The output is the same no matter
+     * how many threads are used.
+     *
+     * @return False if any function could not be transformed
      */
-    void transform();
+    bool transform();
     
     void print();
 private:
+    // The arena of the thread that created the module, and those of any other threads that built
+    // parts of it. The serial number tells the per-thread arena caches apart.
+    Arena *arena;
+    std::thread::id owner;
+    uint64_t serial;
+    std::mutex arenaLock;
+    std::unordered_map<std::thread::id, Arena *> threadArenas;
+    
+    TypeContext *typeContext;
+    StringInterner *symbols;
+    Materializer *materializer = nullptr;
     std::string name = "";
+    std::atomic<int> stringCount;
+    
+    // Guards the function and string lists and their lookup tables. Lookups only read, and code
+    // generation does one for every call from several threads, so they share it.
+    std::shared_timed_mutex tableLock;
     std::vector<Function *> functions;
     std::vector<StringPtr *> strings;
+    
+    // Name lookup tables. If two entries share a name, the first one added wins.
+    std::unordered_map<Symbol, Function *> functionTable;
+    std::unordered_map<Symbol, StringPtr *> stringTable;
 };
 
 } // end namespace LLIR
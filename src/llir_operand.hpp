@@ -5,8 +5,18 @@
 //
 #pragma once
 
+#include <cstdint>
+#include <string>
+
+#include "ilist.hpp"
+#include "symbol.hpp"
+
 namespace LLIR {
 
+// Forward declarations
+class Instruction;
+class Operand;
+
 // Represents operand types
 enum class OpType {
     None,
@@ -22,11 +32,67 @@ enum class OpType {
     PReg         // Pointer register
 };
 
+/*! \brief A single use of an operand by an instruction
+ *
+ * Every operand slot of an instruction is a Use. A use links the instruction (the user) to the
+ * operand it reads, and is itself linked into the use-list of that operand. Changing the operand
+ * of a use keeps both sides in sync.
+ */
+class Use : public IListNode<Use> {
+public:
+    Use() {}
+    Use(const Use &) = delete;
+    Use &operator=(const Use &) = delete;
+    
+    /*! \brief Attaches the use to its instruction
+     *
+     * IMPORTANT: You should not use this function directly. It is managed by the instruction.
+     *
+     * @param user The instruction that owns this use
+     * @param operandNo The operand slot of the use within the instruction
+     */
+    void init(Instruction *user, int operandNo) {
+        this->user = user;
+        this->operandNo = operandNo;
+    }
+    
+    /*! \brief Returns the operand being used
+     *
+     */
+    Operand *get() { return val; }
+    
+    /*! \brief Changes the operand being used
+     *
+     * This moves the use from the use-list of the old operand to the use-list of the new one.
+     *
+     * @param v The new operand. This may be nullptr to clear the use.
+     */
+    inline void set(Operand *v);
+    
+    /*! \brief Returns the instruction that owns the use
+     *
+     */
+    Instruction *getUser() { return user; }
+    
+    /*! \brief Returns the operand slot of the use within its instruction
+     *
+     */
+    int getOperandNo() { return operandNo; }
+private:
+    Operand *val = nullptr;
+    Instruction *user = nullptr;
+    int operandNo = 0;
+};
+
 /*! \brief The base for LLIR operands
  *
  * This is the base class for all LLIR operands. This class generally should not be constructed directly;
  * instead, use the derived versions. However, in cases where any type of LLIR operand is acceptable,
  * this class should be used as a parameter/return type.
+ *
+ * Every operand keeps a list of the instructions that use it. An operand object represents a single value,
+ * so a virtual register should be shared by the instruction that defines it and all the instructions that
+ * read it.
  */
 class Operand {
 public:
@@ -45,11 +111,48 @@ public:
      */
     OpType getType() { return type; }
     
+    /*! \brief Returns the list of uses of this operand
+     *
+     */
+    IList<Use> &getUses() { return uses; }
+    
+    /*! \brief Returns true if any instruction uses this operand
+     *
+     */
+    bool hasUses() { return !uses.empty(); }
+    
+    /*! \brief Returns the number of uses of this operand
+     *
+     */
+    int getUseCount() { return uses.size(); }
+    
+    /*! \brief Replaces every use of this operand with another operand
+     *
+     * This runs in time proportional to the number of uses. Afterwards, this operand has no uses.
+     *
+     * @param v The replacement operand
+     */
+    void replaceAllUsesWith(Operand *v) {
+        if (v == this) return;
+        while (!uses.empty()) {
+            uses.front()->set(v);
+        }
+    }
+    
     virtual void print() {}
 protected:
+    friend class Use;
+    
     OpType type = OpType::None;
+    IList<Use> uses;
 };
 
+void Use::set(Operand *v) {
+    if (val) val->uses.remove(this);
+    val = v;
+    if (val) val->uses.push_back(this);
+}
+
 /*! \brief An LLIR immediate value
  *
  * Represents an LLIR immediate operand. This can be of any byte length.
@@ -73,17 +176,24 @@ private:
  * This represents a virtual register in LLIR. You should always use virtual registers for
  * assignments. A virtual register can hold values and represent memory locations, depending
  * on the situation.
+ *
+ * Registers are identified by a dense numeric ID that is unique within their function, so
+ * passes can keep per-register data in flat arrays indexed by the ID. Use Function::createReg
+ * to get a new register. The name is optional, and only used for printing.
  */
 class Reg : public Operand {
 public:
-    explicit Reg(std::string name) : Operand(OpType::Reg) {
+    explicit Reg(int id, std::string name = "") : Operand(OpType::Reg) {
+        this->id = id;
         this->name = name;
     }
     
+    int getID() { return id; }
     std::string getName() { return name; }
     
     void print();
 private:
+    int id = 0;
     std::string name = "";
 };
 
@@ -94,15 +204,15 @@ private:
  */
 class Label : public Operand {
 public:
-    explicit Label(std::string name) : Operand(OpType::Label) {
+    explicit Label(Symbol name) : Operand(OpType::Label) {
         this->name = name;
     }
     
-    std::string getName() { return name; }
+    Symbol getName() { return name; }
     
     void print();
 private:
-    std::string name = "";
+    Symbol name;
 };
 
 /*! \brief An LLIR global string pointer
@@ -113,18 +223,18 @@ private:
  */
 class StringPtr : public Operand {
 public:
-    explicit StringPtr(std::string name, std::string val) : Operand(OpType::String) {
+    explicit StringPtr(Symbol name, Symbol val) : Operand(OpType::String) {
         this->name = name;
         this->val = val;
     }
     
-    std::string getName() { return name; }
-    std::string getValue() { return val; }
+    Symbol getName() { return name; }
+    Symbol getValue() { return val; }
     
     void print();
 private:
-    std::string name = "";
-    std::string val = "";
+    Symbol name;
+    Symbol val;
 };
 
 //
@@ -133,17 +243,18 @@ private:
 //
 
 // Represents a memory location
+// The ID is the ID of the virtual register it replaced
 class Mem : public Operand {
 public:
-    explicit Mem(std::string name) : Operand(OpType::Mem) {
-        this->name = name;
+    explicit Mem(int id) : Operand(OpType::Mem) {
+        this->id = id;
     }
     
-    std::string getName() { return name; }
+    int getID() { return id; }
     
     void print();
 private:
-    std::string name = "";
+    int id = 0;
 };
 
 // Represents a hardware register
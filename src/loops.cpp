@@ -0,0 +1,152 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <algorithm>
+
+#include <loops.hpp>
+
+namespace LLIR {
+
+char LoopInfo::ID = 0;
+
+//
+// Loops
+//
+
+// The innermost loop of the block either is this loop, is nested in it, or is unrelated
+bool Loop::contains(Block *block) {
+    Loop *loop = info->getLoopFor(block);
+    while (loop && loop->depth > depth) loop = loop->parent;
+    return loop == this;
+}
+
+bool Loop::contains(Loop *loop) {
+    while (loop && loop->depth > depth) loop = loop->parent;
+    return loop == this;
+}
+
+Block *Loop::getPreheader() {
+    Block *preheader = nullptr;
+    for (Block *pred : header->getPredecessors()) {
+        if (contains(pred)) continue;
+        if (preheader) return nullptr;
+        preheader = pred;
+    }
+
+    if (preheader == nullptr || preheader->getSuccessors().size() != 1) return nullptr;
+    return preheader;
+}
+
+//
+// Loop info
+//
+
+// Dominators come before the blocks they dominate in reverse post-order, so walking it backwards
+// reaches the header of an inner loop before the header of any loop around it
+LoopInfo::LoopInfo(Function *func, AnalysisManager &am) {
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    loopOf.assign(func->getMaxBlockID() + 1, nullptr);
+
+    const std::vector<Block *> &order = domTree->getBlocks();
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Block *header = *it;
+        std::vector<Block *> worklist;
+        for (Block *pred : header->getPredecessors()) {
+            if (domTree->dominates(header, pred)) worklist.push_back(pred);
+        }
+        if (worklist.empty()) continue;
+
+        Loop *loop = new Loop(this, header);
+        loops.emplace_back(loop);
+        discover(loop, worklist, domTree);
+    }
+
+    // Going through the loops backwards visits their headers in reverse post-order, and each
+    // loop before the ones nested in it
+    for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+        Loop *loop = it->get();
+        if (loop->parent) {
+            loop->depth = loop->parent->depth + 1;
+            loop->parent->subLoops.push_back(loop);
+        } else {
+            topLevelLoops.push_back(loop);
+        }
+    }
+
+    for (Block *block : order) {
+        for (Loop *loop = loopOf[block->getID()]; loop; loop = loop->parent) loop->blocks.push_back(block);
+    }
+
+    for (auto &loop : loops) finish(loop.get());
+}
+
+// Walks backwards from the latches to the header. A block that already belongs to an inner loop
+// stands for that whole loop: the outermost loop around it becomes a sub-loop of this one, and the
+// walk goes on from the predecessors of its header.
+void LoopInfo::discover(Loop *loop, std::vector<Block *> &worklist, DominatorTree *domTree) {
+    while (!worklist.empty()) {
+        Block *block = worklist.back();
+        worklist.pop_back();
+
+        Loop *inner = loopOf[block->getID()];
+        if (inner == nullptr) {
+            loopOf[block->getID()] = loop;
+            if (block == loop->header) continue;
+        } else {
+            while (inner->parent) inner = inner->parent;
+            if (inner == loop) continue;
+
+            inner->parent = loop;
+            block = inner->header;
+        }
+
+        for (Block *pred : block->getPredecessors()) {
+            if (domTree->isReachable(pred)) worklist.push_back(pred);
+        }
+    }
+}
+
+void LoopInfo::finish(Loop *loop) {
+    for (Block *pred : loop->header->getPredecessors()) {
+        if (loop->contains(pred)) loop->latches.push_back(pred);
+    }
+
+    for (Block *block : loop->blocks) {
+        bool exiting = false;
+        for (Block *succ : block->getSuccessors()) {
+            if (loop->contains(succ)) continue;
+            exiting = true;
+            if (std::find(loop->exitBlocks.begin(), loop->exitBlocks.end(), succ) == loop->exitBlocks.end()) {
+                loop->exitBlocks.push_back(succ);
+            }
+        }
+        if (exiting) loop->exitingBlocks.push_back(block);
+    }
+}
+
+Loop *LoopInfo::getLoopFor(Block *block) {
+    int id = block->getID();
+    if (id <= 0 || id >= (int)loopOf.size()) return nullptr;
+    return loopOf[id];
+}
+
+int LoopInfo::getLoopDepth(Block *block) {
+    Loop *loop = getLoopFor(block);
+    return loop ? loop->depth : 0;
+}
+
+bool LoopInfo::isLoopHeader(Block *block) {
+    Loop *loop = getLoopFor(block);
+    return loop && loop->header == block;
+}
+
+std::vector<Loop *> LoopInfo::getLoopsInnermostFirst() {
+    std::vector<Loop *> list;
+    for (auto &loop : loops) list.push_back(loop.get());
+    return list;
+}
+
+} // end namespace LLIR
+
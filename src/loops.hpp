@@ -0,0 +1,153 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "llir.hpp"
+#include "pass.hpp"
+#include "dominators.hpp"
+
+namespace LLIR {
+
+class LoopInfo;
+
+/*! \brief A natural loop
+ *
+ * A natural loop has a single entry, its header, which dominates every block of the loop. The
+ * loop is made of the header and every block that can reach one of the back edges into the header
+ * without going through the header.
+ *
+ * Loops nest: a loop contains the blocks of all of its sub-loops.
+ */
+class Loop {
+public:
+    /*! \brief Returns the header, the only block control enters the loop through
+     *
+     */
+    Block *getHeader() { return header; }
+
+    /*! \brief Returns the loop this one is nested in, or nullptr for an outermost loop
+     *
+     */
+    Loop *getParent() { return parent; }
+
+    /*! \brief Returns the loops directly nested in this one, in reverse post-order of their headers
+     *
+     */
+    const std::vector<Loop *> &getSubLoops() { return subLoops; }
+
+    /*! \brief Returns every block of the loop, sub-loops included, in reverse post-order
+     *
+     * The header is always first.
+     */
+    const std::vector<Block *> &getBlocks() { return blocks; }
+
+    /*! \brief Returns how deeply the loop is nested, 1 for an outermost loop
+     *
+     */
+    int getDepth() { return depth; }
+
+    /*! \brief Returns true if a block is part of the loop or one of its sub-loops
+     *
+     */
+    bool contains(Block *block);
+
+    /*! \brief Returns true if a loop is this one or nested inside it
+     *
+     */
+    bool contains(Loop *loop);
+
+    /*! \brief Returns the blocks of the loop with a back edge to the header
+     *
+     */
+    const std::vector<Block *> &getLatches() { return latches; }
+
+    /*! \brief Returns the blocks of the loop with a successor outside of it
+     *
+     */
+    const std::vector<Block *> &getExitingBlocks() { return exitingBlocks; }
+
+    /*! \brief Returns the blocks outside the loop that control can go to from inside it
+     *
+     */
+    const std::vector<Block *> &getExitBlocks() { return exitBlocks; }
+
+    /*! \brief Returns the preheader of the loop, or nullptr if it doesn't have one
+     *
+     * The preheader is the only predecessor of the header from outside the loop, and the header
+     * must be its only successor. Code hoisted out of the loop goes there.
+     */
+    Block *getPreheader();
+private:
+    friend class LoopInfo;
+
+    Loop(LoopInfo *info, Block *header) {
+        this->info = info;
+        this->header = header;
+    }
+
+    LoopInfo *info;
+    Block *header;
+    Loop *parent = nullptr;
+    int depth = 1;
+    std::vector<Loop *> subLoops;
+    std::vector<Block *> blocks;
+    std::vector<Block *> latches;
+    std::vector<Block *> exitingBlocks;
+    std::vector<Block *> exitBlocks;
+};
+
+/*! \brief Finds the natural loops of a function and how they nest
+ *
+ * Loops are found from the back edges of the function: the edges whose target dominates their
+ * source. Back edges into the same header make up a single loop. Cycles without such a header
+ * (irreducible control flow) and unreachable blocks are not part of any loop.
+ *
+ * The analysis is computed from the DominatorTree, so invalidating that invalidates this too.
+ */
+class LoopInfo : public FunctionAnalysis {
+public:
+    static char ID;
+
+    LoopInfo(Function *func, AnalysisManager &am);
+
+    /*! \brief Returns the innermost loop that contains a block, or nullptr if it isn't in a loop
+     *
+     */
+    Loop *getLoopFor(Block *block);
+
+    /*! \brief Returns how many loops contain a block
+     *
+     */
+    int getLoopDepth(Block *block);
+
+    /*! \brief Returns true if a block is the header of a loop
+     *
+     */
+    bool isLoopHeader(Block *block);
+
+    /*! \brief Returns the loops that aren't nested in another loop, in reverse post-order of their headers
+     *
+     */
+    const std::vector<Loop *> &getTopLevelLoops() { return topLevelLoops; }
+
+    /*! \brief Returns every loop, each one after the loops nested in it
+     *
+     */
+    std::vector<Loop *> getLoopsInnermostFirst();
+private:
+    void discover(Loop *loop, std::vector<Block *> &worklist, DominatorTree *domTree);
+    void finish(Loop *loop);
+
+    std::vector<std::unique_ptr<Loop>> loops;
+    std::vector<Loop *> topLevelLoops;
+    std::vector<Loop *> loopOf;
+};
+
+} // end namespace LLIR
+
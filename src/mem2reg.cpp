@@ -0,0 +1,312 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+
+#include <mem2reg.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+
+namespace LLIR {
+
+// The promotion follows the usual steps: find the variables that can be promoted, place the phi
+// nodes, then walk the dominator tree, replacing each load by the value last stored on the way down.
+//
+// Everything that is kept per block is in tables indexed by block ID. The tables that are redone for
+// each variable are stamped with the number of the variable instead of being cleared.
+namespace {
+
+class Promoter {
+public:
+    explicit Promoter(Function *func, DominatorTree *domTree) {
+        this->func = func;
+        this->domTree = domTree;
+        this->arena = func->getModule()->getArena();
+    }
+
+    bool run();
+private:
+    bool isPromotable(Instruction *alloca);
+    int getVar(Operand *ptr);
+    void scan();
+    void placePhis(int var);
+    void rename();
+    void visit(Block *block);
+    void cleanUp();
+
+    Function *func;
+    DominatorTree *domTree;
+    Arena *arena;
+    Operand *undef = nullptr;
+
+    // The promoted allocas, and the variable number of each alloca by register ID
+    std::vector<Instruction *> allocas;
+    std::vector<int> varOf;
+
+    // The blocks that store to each variable, and those that load it before storing to it
+    std::vector<std::vector<Block *>> defBlocks;
+    std::vector<std::vector<Block *>> useBlocks;
+
+    // Which variable each block was last found live into, storing to, or given a phi node for
+    std::vector<int> liveStamp;
+    std::vector<int> defStamp;
+    std::vector<int> phiStamp;
+
+    // The phi nodes of each block, with the variable they stand for
+    std::vector<std::vector<std::pair<PhiNode *, int>>> phis;
+
+    // The current value of each variable during renaming, and the values it replaced
+    std::vector<Operand *> current;
+    std::vector<std::pair<int, Operand *>> undo;
+};
+
+bool Promoter::run() {
+    int regCount = func->getRegCount();
+    varOf.assign(regCount, -1);
+
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            if (instr->getType() != InstrType::Alloca || !isPromotable(instr)) continue;
+            varOf[static_cast<Reg *>(instr->getDest())->getID()] = allocas.size();
+            allocas.push_back(instr);
+        }
+    }
+    if (allocas.empty()) return false;
+
+    undef = arena->create<Imm>(0);
+    scan();
+
+    int blockCount = func->getMaxBlockID() + 1;
+    phis.assign(blockCount, std::vector<std::pair<PhiNode *, int>>());
+    liveStamp.assign(blockCount, -1);
+    defStamp.assign(blockCount, -1);
+    phiStamp.assign(blockCount, -1);
+    for (size_t var = 0; var<allocas.size(); var++) placePhis(var);
+
+    rename();
+    cleanUp();
+    return true;
+}
+
+// Loads and stores of another type would change the size of the value
+bool Promoter::isPromotable(Instruction *alloca) {
+    Type *type = alloca->getDataType();
+    if (type->getType() == DataType::Struct) return false;
+
+    Operand *ptr = alloca->getDest();
+    for (Use *use : ptr->getUses()) {
+        Instruction *user = use->getUser();
+        if (user->getType() == InstrType::Load && use->getOperandNo() == 0) {
+        } else if (user->getType() == InstrType::Store && use->getOperandNo() == 1) {
+        } else {
+            return false;
+        }
+
+        Type *accessType = user->getDataType();
+        if (accessType != type && (accessType->getType() != DataType::Ptr || type->getType() != DataType::Ptr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the variable an address operand stands for, or -1 if it is not a promoted alloca
+int Promoter::getVar(Operand *ptr) {
+    if (ptr == nullptr || ptr->getType() != OpType::Reg) return -1;
+    int id = static_cast<Reg *>(ptr)->getID();
+    if (id >= (int)varOf.size()) return -1;
+    return varOf[id];
+}
+
+// A load is upward-exposed if nothing in its block stored to the variable before it. The last
+// block to store and the last block to load are kept so that each block is listed once.
+void Promoter::scan() {
+    defBlocks.assign(allocas.size(), std::vector<Block *>());
+    useBlocks.assign(allocas.size(), std::vector<Block *>());
+    std::vector<int> lastDef(allocas.size(), -1);
+    std::vector<int> lastUse(allocas.size(), -1);
+
+    for (Block *block : *func) {
+        int id = block->getID();
+        for (Instruction *instr : *block) {
+            if (instr->getType() == InstrType::Load) {
+                int var = getVar(instr->getOperand1());
+                if (var < 0 || lastDef[var] == id || lastUse[var] == id) continue;
+                lastUse[var] = id;
+                useBlocks[var].push_back(block);
+            } else if (instr->getType() == InstrType::Store) {
+                int var = getVar(instr->getOperand2());
+                if (var < 0 || lastDef[var] == id) continue;
+                lastDef[var] = id;
+                defBlocks[var].push_back(block);
+            }
+        }
+    }
+}
+
+// The variable is live into a block if some path from there loads it before storing to it. A phi
+// node is only needed where the variable is live, so the frontier blocks where it is dead are skipped.
+void Promoter::placePhis(int var) {
+    for (Block *block : defBlocks[var]) defStamp[block->getID()] = var;
+
+    std::vector<Block *> worklist;
+    for (Block *block : useBlocks[var]) {
+        liveStamp[block->getID()] = var;
+        worklist.push_back(block);
+    }
+    while (!worklist.empty()) {
+        Block *block = worklist.back();
+        worklist.pop_back();
+        for (Block *pred : block->getPredecessors()) {
+            int id = pred->getID();
+            if (liveStamp[id] == var || defStamp[id] == var) continue;
+            liveStamp[id] = var;
+            worklist.push_back(pred);
+        }
+    }
+
+    for (Block *block : defBlocks[var]) {
+        if (domTree->isReachable(block)) worklist.push_back(block);
+    }
+
+    Type *type = allocas[var]->getDataType();
+    while (!worklist.empty()) {
+        Block *block = worklist.back();
+        worklist.pop_back();
+        for (Block *frontier : domTree->getFrontier(block)) {
+            int id = frontier->getID();
+            if (phiStamp[id] == var || liveStamp[id] != var) continue;
+            phiStamp[id] = var;
+
+            PhiNode *phi = arena->create<PhiNode>();
+            phi->setDataType(type);
+            phi->setDest(func->createReg());
+            if (frontier->getFirst()) frontier->insertBefore(frontier->getFirst(), phi);
+            else frontier->addInstruction(phi);
+            phis[id].push_back({ phi, var });
+
+            if (defStamp[id] != var) worklist.push_back(frontier);
+        }
+    }
+}
+
+// The walk is iterative, since the dominator tree of a long function can be very deep. Each
+// block logs the values it replaces, and they are put back once its subtree is done.
+void Promoter::rename() {
+    current.assign(allocas.size(), undef);
+
+    struct Frame {
+        Block *block;
+        size_t child;
+        size_t mark;
+    };
+    std::vector<Frame> stack;
+
+    Block *entry = func->getEntryBlock();
+    stack.push_back({ entry, 0, undo.size() });
+    visit(entry);
+
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        const std::vector<Block *> &children = domTree->getChildren(frame.block);
+        if (frame.child < children.size()) {
+            Block *child = children[frame.child++];
+            stack.push_back({ child, 0, undo.size() });
+            visit(child);
+            continue;
+        }
+
+        while (undo.size() > frame.mark) {
+            current[undo.back().first] = undo.back().second;
+            undo.pop_back();
+        }
+        stack.pop_back();
+    }
+}
+
+void Promoter::visit(Block *block) {
+    auto set = [this](int var, Operand *value) {
+        undo.push_back({ var, current[var] });
+        current[var] = value;
+    };
+
+    for (auto &entry : phis[block->getID()]) set(entry.second, entry.first->getDest());
+
+    Instruction *next = nullptr;
+    for (Instruction *instr = block->getFirst(); instr; instr = next) {
+        next = instr->getNext();
+        if (instr->getType() == InstrType::Load) {
+            int var = getVar(instr->getOperand1());
+            if (var < 0) continue;
+            instr->getDest()->replaceAllUsesWith(current[var]);
+            instr->eraseFromParent();
+        } else if (instr->getType() == InstrType::Store) {
+            int var = getVar(instr->getOperand2());
+            if (var < 0) continue;
+            set(var, instr->getOperand1());
+            instr->eraseFromParent();
+        }
+    }
+
+    for (Block *succ : block->getSuccessors()) {
+        for (auto &entry : phis[succ->getID()]) {
+            entry.first->addIncoming(current[entry.second], arena->create<Label>(block->getName()));
+        }
+    }
+}
+
+// The walk only reaches the blocks reachable from the entry. The others never run, so their loads
+// read 0, and the phi nodes get 0 from them, to keep one incoming value per predecessor.
+void Promoter::cleanUp() {
+    for (Block *block : *func) {
+        if (domTree->isReachable(block)) continue;
+
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            if (instr->getType() == InstrType::Load && getVar(instr->getOperand1()) >= 0) {
+                instr->getDest()->replaceAllUsesWith(undef);
+                instr->eraseFromParent();
+            } else if (instr->getType() == InstrType::Store && getVar(instr->getOperand2()) >= 0) {
+                instr->eraseFromParent();
+            }
+        }
+    }
+
+    for (Block *block : *func) {
+        for (auto &entry : phis[block->getID()]) {
+            PhiNode *phi = entry.first;
+            for (Block *pred : block->getPredecessors()) {
+                if (phi->getIncomingIndex(pred->getName()) >= 0) continue;
+                phi->addIncoming(undef, arena->create<Label>(pred->getName()));
+            }
+        }
+    }
+
+    for (Instruction *alloca : allocas) alloca->eraseFromParent();
+}
+
+} // end namespace
+
+// Renaming gives each edge the value at the end of its block, so blocks are first split after
+// their conditional branches. Apart from that, only instructions change, never the control flow.
+PreservedAnalyses Mem2RegPass::run(Function *func, AnalysisManager &am) {
+    bool split = func->splitAtBranches();
+    if (split) am.invalidate(func, PreservedAnalyses::none());
+
+    DominatorTree *domTree = am.getResult<DominatorTree>(func);
+    bool promoted = Promoter(func, domTree).run();
+    if (split) return PreservedAnalyses::none();
+    if (!promoted) return PreservedAnalyses::all();
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    preserved.preserve<PostDominatorTree>();
+    preserved.preserve<LoopInfo>();
+    return preserved;
+}
+
+} // end namespace LLIR
+
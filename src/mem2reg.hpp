@@ -0,0 +1,35 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief Promotes local variables to virtual registers
+ *
+ * The frontends keep every local variable in an alloca, and read and write it through loads and
+ * stores. Each of those is a trip to the stack. This pass turns the variables into plain values in
+ * SSA form, with phi nodes where control flow merges different values.
+ *
+ * An alloca is promoted when it holds a scalar (not a structure) and its address is only used to
+ * load or store a value of its own type. The phi nodes go on the iterated dominance frontier of the
+ * stores, but only in blocks where the variable is live, so no dead phi node is created. A variable
+ * read before it is written reads 0.
+ *
+ * Blocks with code after a conditional branch are split first (see Function::splitAtBranches).
+ *
+ * The hardware transformation turns the phi nodes back into copies.
+ */
+class Mem2RegPass : public FunctionPass {
+public:
+    std::string getName() { return "mem2reg"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+};
+
+} // end namespace LLIR
+
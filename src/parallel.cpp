@@ -0,0 +1,220 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <parallel.hpp>
+
+namespace LLIR {
+
+namespace {
+
+//
+// One call to parallelFor. Every worker has a queue of its own; it takes tasks from
+// the front, and other workers steal from the back.
+//
+struct Batch {
+    explicit Batch(int workers) : queues(workers), locks(workers) {}
+    
+    const std::function<void(int)> *task = nullptr;
+    std::vector<std::deque<int>> queues;
+    std::vector<std::mutex> locks;
+};
+
+//
+// The pool keeps its threads between calls. The thread that calls run is worker 0,
+// so a pool of n workers only starts n - 1 threads.
+//
+class ThreadPool {
+public:
+    explicit ThreadPool(int size);
+    ~ThreadPool();
+    
+    void run(Batch &batch);
+    int getSize() { return size; }
+private:
+    void workerLoop(int id);
+    void work(Batch &batch, int id);
+    bool take(Batch &batch, int queue, bool front, int &index);
+    
+    int size;
+    std::vector<std::thread> threads;
+    
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    Batch *current = nullptr;
+    unsigned generation = 0;
+    int active = 0;
+    bool stopping = false;
+};
+
+ThreadPool::ThreadPool(int size) {
+    this->size = size;
+    for (int i = 1; i<size; i++) {
+        threads.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) thread.join();
+}
+
+void ThreadPool::run(Batch &batch) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = &batch;
+        active = threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+    
+    work(batch, 0);
+    
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]() { return active == 0; });
+    current = nullptr;
+}
+
+void ThreadPool::workerLoop(int id) {
+    unsigned seen = 0;
+    for (;;) {
+        Batch *batch = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            batch = current;
+        }
+        
+        work(*batch, id);
+        
+        std::lock_guard<std::mutex> guard(lock);
+        if (--active == 0) done.notify_one();
+    }
+}
+
+// No tasks are added once a batch starts, so a worker that finds every queue empty is done
+void ThreadPool::work(Batch &batch, int id) {
+    int index;
+    for (;;) {
+        if (take(batch, id, true, index)) {
+            (*batch.task)(index);
+            continue;
+        }
+        
+        bool stolen = false;
+        for (int i = 1; i<size && !stolen; i++) {
+            stolen = take(batch, (id + i) % size, false, index);
+        }
+        if (!stolen) return;
+        (*batch.task)(index);
+    }
+}
+
+bool ThreadPool::take(Batch &batch, int queue, bool front, int &index) {
+    std::lock_guard<std::mutex> guard(batch.locks[queue]);
+    std::deque<int> &tasks = batch.queues[queue];
+    if (tasks.empty()) return false;
+    
+    if (front) {
+        index = tasks.front();
+        tasks.pop_front();
+    } else {
+        index = tasks.back();
+        tasks.pop_back();
+    }
+    return true;
+}
+
+std::atomic<int> threadCount(0);
+
+// Only one batch runs on the pool at a time. Anyone who finds it busy runs serially instead.
+std::mutex poolLock;
+std::unique_ptr<ThreadPool> pool;
+
+void runSerially(const std::vector<int> &order, const std::function<void(int)> &task) {
+    for (int index : order) task(index);
+}
+
+// The tasks are dealt out to the queues in order, like cards, so every worker starts
+// with its share of the largest ones
+void run(const std::vector<int> &order, const std::function<void(int)> &task) {
+    int workers = std::min<int>(getThreadCount(), order.size());
+    if (workers <= 1) {
+        runSerially(order, task);
+        return;
+    }
+    
+    std::unique_lock<std::mutex> guard(poolLock, std::try_to_lock);
+    if (!guard.owns_lock()) {
+        runSerially(order, task);
+        return;
+    }
+    
+    if (!pool || pool->getSize() != getThreadCount()) {
+        pool.reset();
+        pool.reset(new ThreadPool(getThreadCount()));
+    }
+    
+    Batch batch(pool->getSize());
+    batch.task = &task;
+    for (size_t i = 0; i<order.size(); i++) {
+        batch.queues[i % pool->getSize()].push_back(order[i]);
+    }
+    pool->run(batch);
+}
+
+} // end namespace
+
+void parallelFor(int count, const std::function<void(int)> &task) {
+    std::vector<int> order(count);
+    for (int i = 0; i<count; i++) order[i] = i;
+    run(order, task);
+}
+
+// Ties keep their original order, so the schedule only depends on the costs
+void parallelFor(int count, const std::function<void(int)> &task, const std::function<size_t(int)> &cost) {
+    std::vector<size_t> costs(count);
+    std::vector<int> order(count);
+    for (int i = 0; i<count; i++) {
+        costs[i] = cost(i);
+        order[i] = i;
+    }
+    
+    std::stable_sort(order.begin(), order.end(), [&costs](int a, int b) {
+        return costs[a] > costs[b];
+    });
+    run(order, task);
+}
+
+int getThreadCount() {
+    int count = threadCount;
+    if (count > 0) return count;
+    
+    count = std::thread::hardware_concurrency();
+    if (count < 1) count = 1;
+    return count;
+}
+
+void setThreadCount(int count) {
+    threadCount = count;
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,47 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace LLIR {
+
+/*! \brief Runs a task for every index in [0, count) on a pool of threads
+ *
+ * The tasks are spread over the threads of a shared work-stealing pool. Each thread works through
+ * its own queue, and once that is empty it steals from the others, so uneven tasks still keep every
+ * thread busy. The calling thread takes part in the work, and the call returns once every task is
+ * done. If there is only one task, or only one thread to run on, everything runs on the calling
+ * thread. The same happens for a call made while the pool is busy, such as one from inside a task.
+ *
+ * The tasks must not depend on each other, since they run in no particular order.
+ */
+void parallelFor(int count, const std::function<void(int)> &task);
+
+/*! \brief Runs a task for every index, starting with the most expensive ones
+ *
+ * This is the same as the plain version, except that the tasks are handed out in order of their
+ * cost, largest first. A large task that starts last would otherwise keep the other threads waiting.
+ *
+ * @param cost Returns an estimate of the cost of a task, in any unit
+ */
+void parallelFor(int count, const std::function<void(int)> &task, const std::function<size_t(int)> &cost);
+
+/*! \brief Returns the number of threads parallelFor uses
+ *
+ * This defaults to the number of hardware threads.
+ */
+int getThreadCount();
+
+/*! \brief Sets the number of threads parallelFor uses
+ *
+ * One makes everything run serially on the calling thread. Zero or less goes back to the default.
+ */
+void setThreadCount(int count);
+
+} // end namespace LLIR
+
@@ -0,0 +1,258 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+
+#include <pass.hpp>
+#include <parallel.hpp>
+#include <mem2reg.hpp>
+#include <sccp.hpp>
+#include <dce.hpp>
+#include <gvn.hpp>
+#include <licm.hpp>
+
+namespace LLIR {
+
+//
+// Preserved analyses
+//
+PreservedAnalyses PreservedAnalyses::all() {
+    PreservedAnalyses preserved;
+    preserved.allPreserved = true;
+    return preserved;
+}
+
+PreservedAnalyses PreservedAnalyses::none() {
+    return PreservedAnalyses();
+}
+
+bool PreservedAnalyses::isPreserved(AnalysisKey key) const {
+    return allPreserved || keys.find(key) != keys.end();
+}
+
+void PreservedAnalyses::intersect(const PreservedAnalyses &other) {
+    if (other.allPreserved) return;
+    if (allPreserved) {
+        *this = other;
+        return;
+    }
+
+    for (auto it = keys.begin(); it != keys.end();) {
+        if (other.keys.find(*it) == other.keys.end()) it = keys.erase(it);
+        else ++it;
+    }
+}
+
+//
+// Analysis manager
+//
+AnalysisManager::~AnalysisManager() {
+    clear();
+}
+
+AnalysisManager::FunctionCache &AnalysisManager::getCache(Function *func) {
+    std::lock_guard<std::mutex> guard(lock);
+    return cache[func];
+}
+
+// If an analysis is being computed right now, it was computed from this one
+void AnalysisManager::recordUse(FunctionCache &entries, AnalysisKey key) {
+    if (entries.computing.empty()) return;
+
+    std::vector<AnalysisKey> &dependents = entries.entries[key].dependents;
+    for (AnalysisKey dependent : dependents) {
+        if (dependent == entries.computing.back()) return;
+    }
+    dependents.push_back(entries.computing.back());
+}
+
+void AnalysisManager::invalidate(Function *func, const PreservedAnalyses &preserved) {
+    if (preserved.areAllPreserved()) return;
+
+    auto &entries = getCache(func).entries;
+
+    std::vector<AnalysisKey> worklist;
+    for (auto &entry : entries) {
+        if (!preserved.isPreserved(entry.first)) worklist.push_back(entry.first);
+    }
+
+    while (!worklist.empty()) {
+        AnalysisKey key = worklist.back();
+        worklist.pop_back();
+
+        auto entry = entries.find(key);
+        if (entry == entries.end()) continue;
+
+        for (AnalysisKey dependent : entry->second.dependents) worklist.push_back(dependent);
+        delete entry->second.result;
+        entries.erase(entry);
+    }
+}
+
+void AnalysisManager::clear(Function *func) {
+    auto funcEntry = cache.find(func);
+    if (funcEntry == cache.end()) return;
+
+    for (auto &entry : funcEntry->second.entries) delete entry.second.result;
+    cache.erase(funcEntry);
+}
+
+void AnalysisManager::clear() {
+    for (auto &funcEntry : cache) {
+        for (auto &entry : funcEntry.second.entries) delete entry.second.result;
+    }
+    cache.clear();
+}
+
+//
+// Pass manager
+//
+PassManager::~PassManager() {
+    for (Entry &entry : passes) delete entry.pass;
+}
+
+void PassManager::addPass(Pass *pass) {
+    passes.push_back({ pass, 0 });
+}
+
+bool PassManager::addPass(std::string name) {
+    Pass *pass = PassRegistry::createPass(name);
+    if (pass == nullptr) return false;
+    addPass(pass);
+    return true;
+}
+
+// The bodies are needed by every pass, so stubs are materialized up front
+void PassManager::run(Module *mod) {
+    mod->materializeAll();
+
+    for (size_t i = 0; i<passes.size();) {
+        if (passes[i].pass->getKind() == Pass::Kind::Function) {
+            size_t end = i;
+            while (end < passes.size() && passes[end].pass->getKind() == Pass::Kind::Function) ++end;
+            runFunctionPasses(mod, i, end);
+            i = end;
+            continue;
+        }
+
+        ModulePass *pass = static_cast<ModulePass *>(passes[i].pass);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PreservedAnalyses preserved = pass->run(mod, analyses);
+        if (timing) {
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            passes[i].time += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        // The module pass may have removed functions, so nothing of theirs can be kept
+        if (!preserved.areAllPreserved()) analyses.clear();
+        ++i;
+    }
+}
+
+// Functions without a body are declarations, so there is nothing for the passes to do
+void PassManager::runFunctionPasses(Module *mod, size_t start, size_t end) {
+    parallelFor(mod->getFunctionCount(), [this, mod, start, end](int i) {
+        Function *func = mod->getFunction(i);
+        if (func->getLinkage() == Linkage::Extern || func->getBlockCount() == 0) return;
+
+        for (size_t p = start; p<end; p++) {
+            PreservedAnalyses preserved = runPass(passes[p], func);
+            analyses.invalidate(func, preserved);
+        }
+    }, [mod](int i) {
+        return (size_t)mod->getFunction(i)->getInstrCount();
+    });
+}
+
+PreservedAnalyses PassManager::runPass(Entry &entry, Function *func) {
+    FunctionPass *pass = static_cast<FunctionPass *>(entry.pass);
+    if (!timing) return pass->run(func, analyses);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PreservedAnalyses preserved = pass->run(func, analyses);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(timingLock);
+    entry.time += std::chrono::duration<double, std::milli>(end - start).count();
+    return preserved;
+}
+
+void PassManager::printTimings(std::ostream &out) {
+    double total = 0;
+    for (Entry &entry : passes) total += entry.time;
+
+    out << std::setw(24) << std::left << "pass" << std::right << std::setw(12) << "ms";
+    out << std::setw(10) << "%" << std::endl;
+    for (Entry &entry : passes) {
+        out << std::setw(24) << std::left << entry.pass->getName() << std::right;
+        out << std::setw(12) << std::fixed << std::setprecision(3) << entry.time;
+        out << std::setw(10) << std::setprecision(1) << (total > 0 ? entry.time * 100 / total : 0) << std::endl;
+    }
+    out << std::setw(24) << std::left << "total" << std::right;
+    out << std::setw(12) << std::setprecision(3) << total << std::endl;
+    out.unsetf(std::ios::fixed);
+}
+
+void PassManager::printStatistics(std::ostream &out) {
+    for (Entry &entry : passes) entry.pass->printStatistics(out);
+}
+
+//
+// Pass registry
+//
+static std::map<std::string, std::function<Pass *()>> &getRegistry() {
+    static std::map<std::string, std::function<Pass *()>> registry = {
+        { "dce", []() -> Pass * { return new DCEPass; } },
+        { "gvn", []() -> Pass * { return new GVNPass; } },
+        { "licm", []() -> Pass * { return new LICMPass; } },
+        { "mem2reg", []() -> Pass * { return new Mem2RegPass; } },
+        { "sccp", []() -> Pass * { return new SCCPPass; } },
+        { "transform", []() -> Pass * { return new TransformPass; } }
+    };
+    return registry;
+}
+
+void PassRegistry::registerPass(std::string name, std::function<Pass *()> create) {
+    getRegistry()[name] = create;
+}
+
+Pass *PassRegistry::createPass(std::string name) {
+    auto it = getRegistry().find(name);
+    if (it == getRegistry().end()) return nullptr;
+    return it->second();
+}
+
+std::vector<std::string> PassRegistry::getPassNames() {
+    std::vector<std::string> names;
+    for (auto &entry : getRegistry()) names.push_back(entry.first);
+    return names;
+}
+
+//
+// Standard pipelines
+//
+// Level 0 runs nothing. Level 1 promotes the variables, then runs each optimization once. Level 2
+// runs another round afterwards: the code LICM hoists can be numbered again against the code
+// outside the loop, and what the first round left behind can fold to constants.
+void buildPipeline(PassManager &pm, int level) {
+    if (level <= 0) return;
+    
+    pm.addPass(new Mem2RegPass);
+    pm.addPass(new SCCPPass);
+    pm.addPass(new GVNPass);
+    pm.addPass(new LICMPass);
+    pm.addPass(new DCEPass);
+    if (level == 1) return;
+    
+    pm.addPass(new SCCPPass);
+    pm.addPass(new GVNPass);
+    pm.addPass(new DCEPass);
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,354 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "llir.hpp"
+
+namespace LLIR {
+
+class AnalysisManager;
+
+/*! \brief Identifies a kind of analysis
+ *
+ * Every analysis declares a static member named ID. The address of that member is its key.
+ */
+typedef const void *AnalysisKey;
+
+/*! \brief The base of all function analyses
+ *
+ * An analysis computes facts about a single function. It is computed by its constructor, which
+ * must have the form:
+ *
+ *     MyAnalysis(Function *func, AnalysisManager &am);
+ *
+ * and it must declare a key as a static member:
+ *
+ *     static char ID;
+ *
+ * Analyses are never created directly. Passes ask the AnalysisManager for them, which computes each
+ * one on first use and caches the result until a pass invalidates it.
+ */
+class FunctionAnalysis {
+public:
+    virtual ~FunctionAnalysis() {}
+};
+
+/*! \brief The set of analyses a pass leaves valid
+ *
+ * Every pass returns one of these. Any cached analysis not in the set is thrown away once the pass
+ * is done with a function.
+ */
+class PreservedAnalyses {
+public:
+    /*! \brief Returns a set saying that the pass changed nothing
+     *
+     */
+    static PreservedAnalyses all();
+
+    /*! \brief Returns a set saying that no analysis is valid anymore
+     *
+     */
+    static PreservedAnalyses none();
+
+    /*! \brief Marks an analysis as still valid
+     *
+     */
+    template <class T>
+    PreservedAnalyses &preserve() {
+        keys.insert(&T::ID);
+        return *this;
+    }
+
+    /*! \brief Returns true if an analysis is still valid
+     *
+     */
+    bool isPreserved(AnalysisKey key) const;
+
+    template <class T>
+    bool isPreserved() const { return isPreserved(&T::ID); }
+
+    /*! \brief Returns true if the pass changed nothing
+     *
+     */
+    bool areAllPreserved() const { return allPreserved; }
+
+    /*! \brief Keeps only what both sets preserve
+     *
+     */
+    void intersect(const PreservedAnalyses &other);
+private:
+    bool allPreserved = false;
+    std::unordered_set<AnalysisKey> keys;
+};
+
+/*! \brief Computes and caches function analyses
+ *
+ * The manager keeps at most one result of each analysis for each function. If an analysis asks for
+ * another one while it is being computed, the manager remembers that, so invalidating the second
+ * one also invalidates the first.
+ *
+ * Different functions can be analyzed from different threads at once, but each function may only be
+ * used by one thread at a time. The clear calls must not overlap with anything else.
+ */
+class AnalysisManager {
+public:
+    ~AnalysisManager();
+
+    /*! \brief Returns an analysis of a function, computing it if it isn't cached
+     *
+     */
+    template <class T>
+    T *getResult(Function *func) {
+        FunctionCache &entries = getCache(func);
+        FunctionAnalysis *result = entries.entries[&T::ID].result;
+        if (result == nullptr) {
+            entries.computing.push_back(&T::ID);
+            result = new T(func, *this);
+            entries.computing.pop_back();
+            entries.entries[&T::ID].result = result;
+        }
+
+        recordUse(entries, &T::ID);
+        return static_cast<T *>(result);
+    }
+
+    /*! \brief Returns an analysis of a function, or nullptr if it isn't cached
+     *
+     */
+    template <class T>
+    T *getCachedResult(Function *func) {
+        FunctionCache &entries = getCache(func);
+        auto entry = entries.entries.find(&T::ID);
+        if (entry == entries.entries.end()) return nullptr;
+        return static_cast<T *>(entry->second.result);
+    }
+
+    /*! \brief Throws away the analyses of a function that a pass didn't preserve
+     *
+     * Analyses that were computed from one that is thrown away go with it.
+     */
+    void invalidate(Function *func, const PreservedAnalyses &preserved);
+
+    /*! \brief Throws away every cached analysis of a function
+     *
+     */
+    void clear(Function *func);
+
+    /*! \brief Throws away every cached analysis
+     *
+     */
+    void clear();
+private:
+    struct Entry {
+        FunctionAnalysis *result = nullptr;
+        std::vector<AnalysisKey> dependents;
+    };
+
+    // Everything cached for one function, along with the analyses being computed for it
+    struct FunctionCache {
+        std::unordered_map<AnalysisKey, Entry> entries;
+        std::vector<AnalysisKey> computing;
+    };
+
+    FunctionCache &getCache(Function *func);
+    void recordUse(FunctionCache &entries, AnalysisKey key);
+
+    // Guards the outer map only. Its nodes never move, so a function's cache can be used
+    // without the lock once it has been found.
+    std::mutex lock;
+    std::unordered_map<Function *, FunctionCache> cache;
+};
+
+/*! \brief The base of all passes
+ *
+ */
+class Pass {
+public:
+    enum class Kind {
+        Function,
+        Module
+    };
+
+    virtual ~Pass() {}
+
+    /*! \brief Returns the name the pass is registered under
+     *
+     */
+    virtual std::string getName() = 0;
+
+    /*! \brief Prints what the pass did, summed over every run
+     *
+     * Passes without anything to report print nothing.
+     */
+    virtual void printStatistics(std::ostream &out) {}
+
+    Kind getKind() { return kind; }
+protected:
+    explicit Pass(Kind kind) {
+        this->kind = kind;
+    }
+private:
+    Kind kind;
+};
+
+/*! \brief A pass that works on one function at a time
+ *
+ * A function pass may only change the function it is given. It is never run on functions
+ * without a body.
+ *
+ * The pass manager runs a function pass on several functions at once, so run must not keep any
+ * state between calls. Statistics are the only exception, and they must be atomic.
+ */
+class FunctionPass : public Pass {
+public:
+    FunctionPass() : Pass(Kind::Function) {}
+
+    /*! \brief Runs the pass on a function
+     *
+     * @return The analyses that are still valid for the function
+     */
+    virtual PreservedAnalyses run(Function *func, AnalysisManager &am) = 0;
+};
+
+/*! \brief A pass that works on a whole module
+ *
+ */
+class ModulePass : public Pass {
+public:
+    ModulePass() : Pass(Kind::Module) {}
+
+    /*! \brief Runs the pass on a module
+     *
+     * @return The analyses that are still valid for every function of the module
+     */
+    virtual PreservedAnalyses run(Module *mod, AnalysisManager &am) = 0;
+};
+
+/*! \brief Runs a sequence of passes over a module
+ *
+ * The manager owns its passes and its analysis manager. Consecutive function passes are grouped,
+ * and each function goes through the whole group as a single task. The tasks run in parallel (see
+ * parallelFor), largest function first. Module passes act as barriers: each one starts only after
+ * every function is through the group before it.
+ *
+ * Since the functions of a group don't affect each other, the result does not depend on the number
+ * of threads.
+ */
+class PassManager {
+public:
+    ~PassManager();
+
+    /*! \brief Adds a pass to the end of the pipeline
+     *
+     * The manager takes ownership of the pass.
+     */
+    void addPass(Pass *pass);
+
+    /*! \brief Adds a registered pass by name
+     *
+     * @return False if there is no pass with that name
+     */
+    bool addPass(std::string name);
+
+    /*! \brief Runs every pass over a module
+     *
+     */
+    void run(Module *mod);
+
+    AnalysisManager *getAnalysisManager() { return &analyses; }
+
+    /*! \brief Turns on the timing of each pass
+     *
+     */
+    void setTiming(bool timing) { this->timing = timing; }
+
+    /*! \brief Prints how long each pass took, summed over every run
+     *
+     * The time of a function pass is summed over every function, so with several threads it can
+     * be more than the time that actually went by.
+     */
+    void printTimings(std::ostream &out);
+
+    /*! \brief Prints the statistics of every pass that has any
+     *
+     */
+    void printStatistics(std::ostream &out);
+private:
+    struct Entry {
+        Pass *pass;
+        double time;
+    };
+
+    void runFunctionPasses(Module *mod, size_t start, size_t end);
+    PreservedAnalyses runPass(Entry &entry, Function *func);
+
+    std::vector<Entry> passes;
+    AnalysisManager analyses;
+    bool timing = false;
+    std::mutex timingLock;
+};
+
+/*! \brief The global table of passes by name
+ *
+ */
+class PassRegistry {
+public:
+    /*! \brief Registers a pass
+     *
+     * @param name The name the pass is looked up by
+     * @param create Creates a new instance of the pass
+     */
+    static void registerPass(std::string name, std::function<Pass *()> create);
+
+    /*! \brief Creates a registered pass, or returns nullptr if there is none with that name
+     *
+     */
+    static Pass *createPass(std::string name);
+
+    /*! \brief Returns the names of every registered pass, in alphabetical order
+     *
+     */
+    static std::vector<std::string> getPassNames();
+};
+
+/*! \brief Fills a pass manager with the standard pipeline for an optimization level
+ *
+ * The pipeline only optimizes; it does not run the hardware transformation. Level 2 runs the
+ * same passes as level 1, followed by a second round of SCCP, GVN and DCE.
+ *
+ * @param level 0 for no optimization, up to 2 for the most
+ */
+void buildPipeline(PassManager &pm, int level);
+
+/*! \brief The hardware transformation as a function pass
+ *
+ * This is the same as Function::transform. A function that can't be transformed is left as it
+ * is, and the pass remembers it; check hasFailed before generating any code.
+ */
+class TransformPass : public FunctionPass {
+public:
+    std::string getName() { return "transform"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+    
+    /*! \brief Returns true if any function could not be transformed
+     *
+     */
+    bool hasFailed() { return failed; }
+private:
+    std::atomic<bool> failed{false};
+};
+
+} // end namespace LLIR
+
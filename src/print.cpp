@@ -61,7 +61,8 @@ void Function::print() {
     }
     std::cout << ")";
     
-    if (blocks.size() == 0) {
+    requireBody();
+    if (blocks.empty()) {
         std::cout << ";";
     } else {
         std::cout << " {" << std::endl;
@@ -119,20 +120,23 @@ void Instruction::print() {
         case InstrType::GEP: std::cout << "getelementptr "; break;
         case InstrType::StructStore: std::cout << "store.struct "; break;
         case InstrType::Store: std::cout << "store "; break;
+        
+        case InstrType::Phi: std::cout << "phi "; break;
+        case InstrType::Copy: std::cout << "copy "; break;
     }
     dataType->print();
     std::cout << " ";
     
-    if (src1) {
-        src1->print();
+    if (srcs[0].get()) {
+        srcs[0].get()->print();
     }
-    if (src2) {
+    if (srcs[1].get()) {
         std::cout << ", ";
-        src2->print();
+        srcs[1].get()->print();
     }
-    if (src3) {
+    if (srcs[2].get()) {
         std::cout << ", ";
-        src3->print();
+        srcs[2].get()->print();
     }
     std::cout << ";" << std::endl;
 }
@@ -149,21 +153,37 @@ void FunctionCall::print() {
     }
     
     std::cout << name << "(";
-    for (int i = 0; i<args.size(); i++) {
-        args.at(i)->print();
-        if (i + 1 < args.size()) {
+    for (int i = 0; i<argCount; i++) {
+        args[i].get()->print();
+        if (i + 1 < argCount) {
             std::cout << ", ";
         }
     }
     std::cout << ");" << std::endl;
 }
 
+void PhiNode::print() {
+    dest->print();
+    std::cout << " = phi ";
+    dataType->print();
+    
+    for (int i = 0; i<getIncomingCount(); i++) {
+        std::cout << (i == 0 ? " [" : ", [");
+        getIncomingValue(i)->print();
+        std::cout << ", ";
+        getIncomingLabel(i)->print();
+        std::cout << "]";
+    }
+    std::cout << ";" << std::endl;
+}
+
 void Imm::print() {
     std::cout << imm;
 }
 
 void Reg::print() {
-    std::cout << "%" << name;
+    if (name.empty()) std::cout << "%" << id;
+    else std::cout << "%" << name;
 }
 
 void Label::print() {
@@ -175,7 +195,7 @@ void StringPtr::print() {
 }
 
 void Mem::print() {
-    std::cout << "[" << name << "]";
+    std::cout << "[" << id << "]";
 }
 
 void HReg::print() {
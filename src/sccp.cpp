@@ -0,0 +1,475 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+#include <sccp.hpp>
+#include <dominators.hpp>
+#include <loops.hpp>
+
+namespace LLIR {
+
+// The solver keeps a lattice value for each register: unknown while nothing reaches its definition,
+// a constant, or overdefined once it can hold two different values. Blocks start out unreachable,
+// and only the edges that can be taken with the values known so far are followed.
+//
+// Values are kept sign-extended from the width of their type, the way the backend computes them.
+namespace {
+
+enum class State {
+    Unknown,
+    Constant,
+    Overdefined
+};
+
+struct Value {
+    State state = State::Unknown;
+    int64_t value = 0;
+};
+
+Value makeConstant(int64_t value) {
+    Value v;
+    v.state = State::Constant;
+    v.value = value;
+    return v;
+}
+
+Value makeOverdefined() {
+    Value v;
+    v.state = State::Overdefined;
+    return v;
+}
+
+Value meet(Value a, Value b) {
+    if (a.state == State::Unknown) return b;
+    if (b.state == State::Unknown) return a;
+    if (a.state == State::Constant && b.state == State::Constant && a.value == b.value) return a;
+    return makeOverdefined();
+}
+
+// Returns the width in bits of an integer type, or 0 if the type is not folded
+int getWidth(Type *type) {
+    switch (type->getType()) {
+        case DataType::I8: return 8;
+        case DataType::I16: return 16;
+        case DataType::I32: return 32;
+        case DataType::I64: return 64;
+        default: {}
+    }
+    return 0;
+}
+
+int64_t truncate(int64_t value, int width) {
+    if (width >= 64) return value;
+    uint64_t sign = 1ULL << (width - 1);
+    uint64_t bits = (uint64_t)value & ((sign << 1) - 1);
+    return (int64_t)(bits ^ sign) - (int64_t)sign;
+}
+
+uint64_t toUnsigned(int64_t value, int width) {
+    if (width >= 64) return value;
+    return (uint64_t)value & ((1ULL << width) - 1);
+}
+
+bool isFoldable(InstrType type) {
+    switch (type) {
+        case InstrType::Add:
+        case InstrType::Sub:
+        case InstrType::SMul:
+        case InstrType::UMul:
+        case InstrType::SDiv:
+        case InstrType::UDiv:
+        case InstrType::SRem:
+        case InstrType::URem:
+        case InstrType::And:
+        case InstrType::Or:
+        case InstrType::Xor:
+        case InstrType::Not: return true;
+
+        default: {}
+    }
+    return false;
+}
+
+// Division by zero and the one overflowing signed division trap at runtime, so they are left alone
+Value fold(InstrType type, int width, int64_t a, int64_t b) {
+    uint64_t ua = toUnsigned(a, width);
+    uint64_t ub = toUnsigned(b, width);
+    bool trap = (b == 0) || (a == truncate(INT64_MIN, width) && b == -1);
+    int64_t result = 0;
+
+    switch (type) {
+        case InstrType::Add: result = (int64_t)((uint64_t)a + (uint64_t)b); break;
+        case InstrType::Sub: result = (int64_t)((uint64_t)a - (uint64_t)b); break;
+        case InstrType::SMul:
+        case InstrType::UMul: result = (int64_t)((uint64_t)a * (uint64_t)b); break;
+        case InstrType::And: result = a & b; break;
+        case InstrType::Or: result = a | b; break;
+        case InstrType::Xor: result = a ^ b; break;
+        case InstrType::Not: result = ~a; break;
+
+        case InstrType::SDiv:
+        case InstrType::SRem: {
+            if (trap) return makeOverdefined();
+            result = (type == InstrType::SDiv) ? a / b : a % b;
+        } break;
+
+        case InstrType::UDiv:
+        case InstrType::URem: {
+            if (ub == 0) return makeOverdefined();
+            result = (int64_t)((type == InstrType::UDiv) ? ua / ub : ua % ub);
+        } break;
+
+        default: return makeOverdefined();
+    }
+
+    return makeConstant(truncate(result, width));
+}
+
+// The backend compares with signed condition codes
+bool compare(InstrType type, int64_t a, int64_t b) {
+    switch (type) {
+        case InstrType::Beq: return a == b;
+        case InstrType::Bne: return a != b;
+        case InstrType::Bgt: return a > b;
+        case InstrType::Blt: return a < b;
+        case InstrType::Bge: return a >= b;
+        case InstrType::Ble: return a <= b;
+        default: {}
+    }
+    return true;
+}
+
+enum class Outcome {
+    Unknown,
+    Taken,
+    NotTaken,
+    Either
+};
+
+class Solver {
+public:
+    explicit Solver(Function *func) {
+        this->func = func;
+    }
+
+    void solve();
+    Value getValue(Operand *op);
+    Outcome getOutcome(Instruction *instr);
+    bool isExecutable(Block *block) { return executable[block->getID()]; }
+private:
+    void markEdge(Block *from, Block *to);
+    bool isFeasible(Block *from, Block *to);
+    void visitEdges(Block *block);
+    void visitInstr(Instruction *instr);
+    void update(Reg *reg, Value value);
+
+    Function *func;
+    std::vector<Value> values;
+    std::vector<bool> executable;
+
+    // The successors each block was found to reach so far
+    std::vector<std::vector<Block *>> feasible;
+
+    // Branches on values that never became known are taken to go either way
+    std::unordered_set<Instruction *> forced;
+
+    std::vector<Instruction *> instrWork;
+    std::vector<Block *> blockWork;
+};
+
+// When the worklists run dry, a branch may still be waiting on a value that no executed code
+// defines. Such a value is undefined, so the branch is let go both ways, and solving resumes.
+void Solver::solve() {
+    values.assign(func->getRegCount(), Value());
+    executable.assign(func->getMaxBlockID() + 1, false);
+    feasible.assign(func->getMaxBlockID() + 1, std::vector<Block *>());
+
+    Block *entry = func->getEntryBlock();
+    executable[entry->getID()] = true;
+    for (Instruction *instr : *entry) instrWork.push_back(instr);
+    blockWork.push_back(entry);
+
+    while (true) {
+        while (!instrWork.empty() || !blockWork.empty()) {
+            while (!instrWork.empty()) {
+                Instruction *instr = instrWork.back();
+                instrWork.pop_back();
+                visitInstr(instr);
+            }
+            if (!blockWork.empty()) {
+                Block *block = blockWork.back();
+                blockWork.pop_back();
+                visitEdges(block);
+            }
+        }
+
+        for (Block *block : *func) {
+            if (!isExecutable(block)) continue;
+            for (Instruction *instr : *block) {
+                if (!instr->isBranch() || getOutcome(instr) != Outcome::Unknown) continue;
+                forced.insert(instr);
+                blockWork.push_back(block);
+            }
+        }
+        if (blockWork.empty()) break;
+    }
+}
+
+Value Solver::getValue(Operand *op) {
+    if (op == nullptr) return makeOverdefined();
+    if (op->getType() == OpType::Imm) return makeConstant(static_cast<Imm *>(op)->getValue());
+    if (op->getType() != OpType::Reg) return makeOverdefined();
+
+    int id = static_cast<Reg *>(op)->getID();
+    if (id >= (int)values.size()) return makeOverdefined();
+    return values[id];
+}
+
+Outcome Solver::getOutcome(Instruction *instr) {
+    if (instr->getType() == InstrType::Br) return Outcome::Taken;
+    if (forced.count(instr)) return Outcome::Either;
+
+    int width = getWidth(instr->getDataType());
+    Value a = getValue(instr->getOperand1());
+    Value b = getValue(instr->getOperand2());
+    if (width == 0 || a.state == State::Overdefined || b.state == State::Overdefined) return Outcome::Either;
+    if (a.state == State::Unknown || b.state == State::Unknown) return Outcome::Unknown;
+
+    bool taken = compare(instr->getType(), truncate(a.value, width), truncate(b.value, width));
+    return taken ? Outcome::Taken : Outcome::NotTaken;
+}
+
+// The first time a block is reached, all of it is evaluated. After that, only its phi nodes can
+// change because of a new edge.
+void Solver::markEdge(Block *from, Block *to) {
+    if (isFeasible(from, to)) return;
+    feasible[from->getID()].push_back(to);
+
+    if (!isExecutable(to)) {
+        executable[to->getID()] = true;
+        for (Instruction *instr : *to) instrWork.push_back(instr);
+        blockWork.push_back(to);
+        return;
+    }
+
+    for (Instruction *instr : *to) {
+        if (instr->getType() == InstrType::Phi) instrWork.push_back(instr);
+    }
+}
+
+bool Solver::isFeasible(Block *from, Block *to) {
+    const std::vector<Block *> &succs = feasible[from->getID()];
+    return std::find(succs.begin(), succs.end(), to) != succs.end();
+}
+
+// This follows the branches the same way the CFG does, but stops at the first branch that is
+// always taken, skips the ones that never are, and waits on those with an unknown outcome.
+void Solver::visitEdges(Block *block) {
+    for (Instruction *instr : *block) {
+        if (instr->getType() == InstrType::Ret || instr->getType() == InstrType::RetVoid) return;
+        if (!instr->isBranch()) continue;
+
+        Outcome outcome = getOutcome(instr);
+        if (outcome == Outcome::Unknown) return;
+        if (outcome == Outcome::NotTaken) continue;
+
+        Label *label = instr->getBranchLabel();
+        Block *target = label ? func->getBlockByName(label->getName()) : nullptr;
+        if (target) markEdge(block, target);
+        if (outcome == Outcome::Taken) return;
+    }
+
+    if (block->getNext()) markEdge(block, block->getNext());
+}
+
+void Solver::visitInstr(Instruction *instr) {
+    Block *block = instr->getParent();
+    if (!isExecutable(block)) return;
+
+    if (instr->isBranch()) {
+        blockWork.push_back(block);
+        return;
+    }
+
+    Operand *dest = instr->getDest();
+    if (dest == nullptr || dest->getType() != OpType::Reg) return;
+    Reg *reg = static_cast<Reg *>(dest);
+
+    if (instr->getType() == InstrType::Phi) {
+        PhiNode *phi = static_cast<PhiNode *>(instr);
+        Value value;
+        for (int i = 0; i<phi->getIncomingCount(); i++) {
+            Block *pred = func->getBlockByName(phi->getIncomingLabel(i)->getName());
+            if (pred == nullptr || !isExecutable(pred) || !isFeasible(pred, block)) continue;
+            value = meet(value, getValue(phi->getIncomingValue(i)));
+        }
+        update(reg, value);
+        return;
+    }
+
+    int width = getWidth(instr->getDataType());
+    if (!isFoldable(instr->getType()) || width == 0) {
+        update(reg, makeOverdefined());
+        return;
+    }
+
+    Value a = getValue(instr->getOperand1());
+    Value b = (instr->getType() == InstrType::Not) ? makeConstant(0) : getValue(instr->getOperand2());
+    if (a.state == State::Overdefined || b.state == State::Overdefined) {
+        update(reg, makeOverdefined());
+    } else if (a.state == State::Constant && b.state == State::Constant) {
+        update(reg, fold(instr->getType(), width, truncate(a.value, width), truncate(b.value, width)));
+    }
+}
+
+// A value only ever moves down the lattice
+void Solver::update(Reg *reg, Value value) {
+    Value &old = values[reg->getID()];
+    Value next = meet(old, value);
+    if (next.state == old.state && next.value == old.value) return;
+    old = next;
+
+    for (Use *use : reg->getUses()) {
+        Instruction *user = use->getUser();
+        if (user->getParent() && isExecutable(user->getParent())) instrWork.push_back(user);
+    }
+}
+
+class Rewriter {
+public:
+    explicit Rewriter(Function *func, Solver &solver) : solver(solver) {
+        this->func = func;
+        this->arena = func->getModule()->getArena();
+    }
+
+    size_t replaceConstants();
+    size_t foldBranches();
+    size_t removeBlocks();
+private:
+    Function *func;
+    Solver &solver;
+    Arena *arena;
+};
+
+// Only instructions without side effects are replaced. Everything else is overdefined anyway.
+size_t Rewriter::replaceConstants() {
+    size_t count = 0;
+    for (Block *block : *func) {
+        if (!solver.isExecutable(block)) continue;
+
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            if (instr->getType() != InstrType::Phi && !isFoldable(instr->getType())) continue;
+
+            Value value = solver.getValue(instr->getDest());
+            if (value.state != State::Constant) continue;
+            instr->getDest()->replaceAllUsesWith(arena->create<Imm>(value.value));
+            instr->eraseFromParent();
+            ++count;
+        }
+    }
+    return count;
+}
+
+// A branch that is always taken becomes a jump, and the code after it can never run
+size_t Rewriter::foldBranches() {
+    size_t count = 0;
+    for (Block *block : *func) {
+        if (!solver.isExecutable(block)) continue;
+
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr; instr = next) {
+            next = instr->getNext();
+            if (!instr->isBranch() || instr->getType() == InstrType::Br) continue;
+
+            Outcome outcome = solver.getOutcome(instr);
+            if (outcome == Outcome::NotTaken) {
+                instr->eraseFromParent();
+                ++count;
+            } else if (outcome == Outcome::Taken) {
+                Instruction *br = arena->create<Instruction>(InstrType::Br);
+                br->setOperand1(arena->create<Label>(instr->getBranchLabel()->getName()));
+                block->insertBefore(instr, br);
+
+                for (Instruction *dead = instr; dead; dead = next) {
+                    next = dead->getNext();
+                    dead->eraseFromParent();
+                }
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+// The dead blocks may still use each other's values, so every reference is dropped before any
+// block goes. The phi nodes then lose the values from the edges that are gone.
+size_t Rewriter::removeBlocks() {
+    std::vector<Block *> dead;
+    for (Block *block : *func) {
+        if (!solver.isExecutable(block)) dead.push_back(block);
+    }
+
+    for (Block *block : dead) {
+        for (Instruction *instr : *block) instr->dropAllReferences();
+    }
+    for (Block *block : dead) func->removeBlock(block);
+
+    for (Block *block : *func) {
+        const std::vector<Block *> &preds = block->getPredecessors();
+        for (Instruction *instr : *block) {
+            if (instr->getType() != InstrType::Phi) continue;
+
+            PhiNode *phi = static_cast<PhiNode *>(instr);
+            for (int i = phi->getIncomingCount() - 1; i >= 0; i--) {
+                Block *pred = func->getBlockByName(phi->getIncomingLabel(i)->getName());
+                if (pred && std::find(preds.begin(), preds.end(), pred) != preds.end()) continue;
+                phi->removeIncoming(i);
+            }
+        }
+    }
+
+    return dead.size();
+}
+
+} // end namespace
+
+PreservedAnalyses SCCPPass::run(Function *func, AnalysisManager &am) {
+    if (func->getEntryBlock() == nullptr) return PreservedAnalyses::all();
+
+    Solver solver(func);
+    solver.solve();
+
+    Rewriter rewriter(func, solver);
+    size_t constants = rewriter.replaceConstants();
+    size_t branches = rewriter.foldBranches();
+    size_t blocks = rewriter.removeBlocks();
+
+    replaced += constants;
+    folded += branches;
+    deletedBlocks += blocks;
+
+    if (branches > 0 || blocks > 0) return PreservedAnalyses::none();
+    if (constants == 0) return PreservedAnalyses::all();
+
+    PreservedAnalyses preserved = PreservedAnalyses::none();
+    preserved.preserve<DominatorTree>();
+    preserved.preserve<PostDominatorTree>();
+    preserved.preserve<LoopInfo>();
+    return preserved;
+}
+
+void SCCPPass::printStatistics(std::ostream &out) {
+    out << getName() << ": " << replaced << " constants replaced, " << folded << " branches folded and ";
+    out << deletedBlocks << " blocks deleted" << std::endl;
+}
+
+} // end namespace LLIR
+
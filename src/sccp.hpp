@@ -0,0 +1,40 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <atomic>
+
+#include "llir.hpp"
+#include "pass.hpp"
+
+namespace LLIR {
+
+/*! \brief Sparse conditional constant propagation
+ *
+ * Finds the registers that always hold the same integer, and the branches that always go the
+ * same way. The values and the reachable blocks are solved together, so a constant that is only
+ * overwritten on a path that never runs is still a constant, and a branch on such a constant
+ * makes its other side unreachable.
+ *
+ * Afterwards, the uses of each constant are replaced by an immediate, branches with a known
+ * outcome become plain jumps or are removed, and the blocks that can never run are deleted. The
+ * pass works on SSA form, so it should run after mem2reg. Values that flow through memory are
+ * not tracked.
+ */
+class SCCPPass : public FunctionPass {
+public:
+    std::string getName() { return "sccp"; }
+    PreservedAnalyses run(Function *func, AnalysisManager &am);
+
+    void printStatistics(std::ostream &out);
+private:
+    std::atomic<size_t> replaced{0};
+    std::atomic<size_t> folded{0};
+    std::atomic<size_t> deletedBlocks{0};
+};
+
+} // end namespace LLIR
+
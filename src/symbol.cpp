@@ -0,0 +1,48 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <symbol.hpp>
+
+namespace LLIR {
+
+const std::string Symbol::emptyString = "";
+
+// The empty string is always the default symbol, so it never needs a table entry
+Symbol StringInterner::intern(const std::string &str) {
+    if (str.empty()) return Symbol();
+
+    Shard &shard = getShard(str);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.strings.insert(str).first;
+    return Symbol(&(*it));
+}
+
+Symbol StringInterner::find(const std::string &str) {
+    if (str.empty()) return Symbol();
+    
+    Shard &shard = getShard(str);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.strings.find(str);
+    if (it == shard.strings.end()) return Symbol();
+    return Symbol(&(*it));
+}
+
+size_t StringInterner::size() {
+    size_t count = 0;
+    for (Shard &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        count += shard.strings.size();
+    }
+    return count;
+}
+
+// The set hashes with the low bits, so the shard is picked with the high ones
+StringInterner::Shard &StringInterner::getShard(const std::string &str) {
+    size_t hash = std::hash<std::string>()(str);
+    return shards[(hash >> (sizeof(size_t) * 8 - 4)) % SHARD_COUNT];
+}
+
+} // end namespace LLIR
+
@@ -0,0 +1,105 @@
+//
+// Copyright 2022 Patrick Flynn
+// This file is part of the LLIR framework.
+// LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace LLIR {
+
+/*! \brief An interned string
+ *
+ * A symbol is a handle to a string stored in a StringInterner. Every distinct string is stored
+ * exactly once, so two symbols from the same interner are equal if and only if they point to the
+ * same string. Copying, comparing, and hashing a symbol are all single pointer operations.
+ *
+ * The default symbol is the empty string.
+ */
+class Symbol {
+public:
+    Symbol() {}
+
+    /*! \brief Returns the string the symbol refers to
+     *
+     */
+    const std::string &str() const { return s ? *s : emptyString; }
+
+    bool empty() const { return s == nullptr; }
+
+    bool operator==(const Symbol &other) const { return s == other.s; }
+    bool operator!=(const Symbol &other) const { return s != other.s; }
+
+    // This orders by address, not alphabetically
+    bool operator<(const Symbol &other) const { return s < other.s; }
+
+    size_t hash() const { return std::hash<const std::string *>()(s); }
+private:
+    friend class StringInterner;
+
+    explicit Symbol(const std::string *s) {
+        this->s = s;
+    }
+
+    static const std::string emptyString;
+    const std::string *s = nullptr;
+};
+
+inline std::ostream &operator<<(std::ostream &out, const Symbol &sym) {
+    return out << sym.str();
+}
+
+/*! \brief A table of interned strings
+ *
+ * Each module has its own interner. The strings live as long as the interner.
+ *
+ * The interner is safe to use from several threads at once. The table is split into shards by
+ * hash, each with its own lock, so threads interning different strings rarely wait on each other.
+ */
+class StringInterner {
+public:
+    /*! \brief Returns the symbol for a string, adding it to the table if needed
+     *
+     */
+    Symbol intern(const std::string &str);
+
+    /*! \brief Returns the symbol for a string, or the empty symbol if it was never interned
+     *
+     * Unlike intern, this never adds to the table.
+     */
+    Symbol find(const std::string &str);
+
+    /*! \brief Returns the number of distinct strings in the table
+     *
+     */
+    size_t size();
+private:
+    static const int SHARD_COUNT = 16;
+    
+    // Set nodes are never moved, so pointers to the elements stay valid
+    struct Shard {
+        std::mutex lock;
+        std::unordered_set<std::string> strings;
+    };
+    
+    Shard &getShard(const std::string &str);
+    
+    Shard shards[SHARD_COUNT];
+};
+
+} // end namespace LLIR
+
+namespace std {
+
+template <>
+struct hash<LLIR::Symbol> {
+    size_t operator()(const LLIR::Symbol &sym) const { return sym.hash(); }
+};
+
+} // end namespace std
+
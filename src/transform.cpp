@@ -3,170 +3,626 @@
 // This file is part of the LLIR framework.
 // LLIR is licensed under the BSD-3 license. See the COPYING file for more information.
 //
-#include <map>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <iostream>
+#include <atomic>
 
 #include <llir.hpp>
+#include <parallel.hpp>
+#include <pass.hpp>
+#include <liveness.hpp>
 
 namespace LLIR {
 
-// The maps
-std::vector<std::string> memList;
-std::map<std::string, int> regMap;
-std::map<std::string, int> argMap;
-std::map<std::string, int> ptrMap;
-int regCount = 0;
-int argCount = 0;
-int ptrCount = 0;
+// By default, all operands in LLIR are virtual registers, which are naturally not
+// suitable to hardware transformation
+//
+// This pass translates all virtual registers to hardware registers and memory operands
+// as appropriate.
+//
+// The algorithm is very simple. Basically, we look for "allocas", and assign memory operands to
+// the destination. Whenever an instruction defines a virtual register, we pick the hardware
+// operand for it and replace all of its uses through the use-list.
+//
+// Hardware registers are handed out by a linear scan over the live ranges of the virtual
+// registers: a register is reused as soon as the value it held is no longer needed. When every
+// register that may hold a value is taken, the value that is needed furthest away goes to a stack
+// slot instead.
+//
+// Code in SSA form (see Mem2RegPass) is taken out of it first. Each phi node becomes a copy at the
+// end of every predecessor, after splitting the edges where such a copy would run on other paths too.
+//
+// Functions are independent of each other, so the functions of a module are transformed in
+// parallel. The result is the same as transforming them one after the other.
+//
+namespace {
+
+// The hardware registers handed out, numbered as in the register map of the code generator. Calls
+// keep BX, R12, and R13, and clobber the others. Division takes AX and DX.
+enum HardReg {
+    AX = 0,
+    BX = 1,
+    CX = 2,
+    DX = 3,
+    R12 = 4,
+    R13 = 5,
+    HardRegCount = 6
+};
+
+const int AllRegs = (1 << HardRegCount) - 1;
+const int CalleeSaved = (1 << BX) | (1 << R12) | (1 << R13);
+const int DivisionRegs = (1 << AX) | (1 << DX);
+
+// Function arguments are in the argument registers at first, and the third and fourth of those are
+// DX and CX. The others are never handed out.
+int getArgHardReg(int pos) {
+    if (pos == 2) return DX;
+    if (pos == 3) return CX;
+    return -1;
+}
 
-Operand *checkOperand(Operand *input) {
-    if (input->getType() != OpType::Reg) {
-        return input;
+// What became of one attempt at handing out the registers
+enum class Allocation {
+    Done,
+    Retry,
+    Failed
+};
+
+// One pending copy of a phi node
+struct PhiCopy {
+    Reg *dest;
+    Operand *src;
+    Type *type;
+};
+
+// The state of the transform for a single function. Nothing is shared between functions,
+// so any number of these can run at once.
+class FunctionTransform {
+public:
+    explicit FunctionTransform(Function *func, Arena *arena) {
+        this->func = func;
+        this->arena = arena;
     }
     
-    Reg *reg = static_cast<Reg *>(input);
-    if (std::find(memList.begin(), memList.end(), reg->getName()) != memList.end()) {
-        Mem *mem = new Mem(reg->getName());
-        return mem;
-    }
+    bool run();
+private:
+    void destroySSA();
+    bool needsSplit(Block *pred);
+    Block *splitEdge(Block *pred, Block *succ);
+    void insertCopies(std::vector<PhiCopy> &copies, Block *block, Instruction *pos);
+    void copyArgs();
+    Allocation allocate();
+    bool rematerialize(const std::vector<Reg *> &ptrs);
+    Instruction *createSlot();
+    bool needsHReg(Instruction *instr);
+    Operand *assign(Instruction *instr);
     
-    if (argMap.find(reg->getName()) != argMap.end()) {
-        AReg *reg2 = new AReg(argMap[reg->getName()]);
-        return reg2;
-    }
+    Function *func;
+    Arena *arena;
+    std::vector<int> hregs;
+    std::vector<int> slots;
+    int splitCount = 0;
+};
+
+// The liveness has to be computed before anything is replaced, while the operands are
+// still virtual registers
+//
+// Returns false if the registers could not be handed out
+bool FunctionTransform::run() {
+    destroySSA();
+    copyArgs();
     
-    if (ptrMap.find(reg->getName()) != ptrMap.end()) {
-        PReg *reg2 = new PReg(ptrMap[reg->getName()]);
-        return reg2;
+    Allocation result;
+    while ((result = allocate()) == Allocation::Retry) {}
+    if (result == Allocation::Failed) {
+        std::cerr << "Error: Out of registers for the pointers in function " << func->getName() << std::endl;
+        return false;
     }
     
-    if (regMap.find(reg->getName()) != regMap.end()) {
-        HReg *reg2 = new HReg(regMap[reg->getName()]);
-        return reg2;
+    // Assign argument registers
+    for (int i = 0; i<func->getArgCount(); i++) {
+        Reg *reg = func->getArg(i);
+        reg->replaceAllUsesWith(arena->create<AReg>(i));
     }
     
-    return input;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            Operand *hw = assign(instr);
+            if (hw) {
+                Operand *dest = instr->getDest();
+                instr->setDest(hw);
+                dest->replaceAllUsesWith(hw);
+            }
+        }
+    }
+    return true;
 }
 
-// By default, all operands in LLIR are virtual registers, which are naturally not
-// suitable to hardware transformation
 //
-// This pass translates all virtual registers to hardware registers and memory operands
-// as appropriate.
+// SSA destruction
 //
-// The algorithm is very simple. Basically, we look for "allocas", and assign memory operands to
-// the destination, and replace everywhere else.
-//
-void Module::transform() {
-    for (Function *func : functions) {
-        memList.clear();
-        regMap.clear();
-        regCount = 0;
-        argMap.clear();
-        argCount = 0;
-        ptrMap.clear();
-        ptrCount = 0;
-        
-        for (int i = 0; i<func->getBlockCount(); i++) {
-            Block *block = func->getBlock(i);
-            
-            // Assign argument registers
-            for (int j = 0; j<func->getArgCount(); j++) {
-                Reg *reg = func->getArg(j);
-                argMap[reg->getName()] = argCount;
-                ++argCount;
-            }
+
+// The copies for the phi nodes of a block go at the end of each predecessor. That is only safe if
+// control can't leave the predecessor any other way, or the copies would clobber values on the other
+// paths. Those edges are split first. A predecessor that branches on a condition is split even if
+// both ways lead to the block, since the copies would have to go before the comparison.
+void FunctionTransform::destroySSA() {
+    std::vector<Block *> phiBlocks;
+    for (Block *block : *func) {
+        Instruction *first = block->getFirst();
+        if (first && first->getType() == InstrType::Phi) phiBlocks.push_back(block);
+    }
+    
+    for (Block *block : phiBlocks) {
+        std::vector<Block *> preds = block->getPredecessors();
+        for (Block *pred : preds) {
+            Block *from = pred;
+            if (preds.size() > 1 && needsSplit(pred)) from = splitEdge(pred, block);
             
-            // Now, take care of the rest of the instructions
-            for (int j = 0; j<block->getInstrCount(); j++) {
-                Instruction *instr = block->getInstruction(j);
-                switch (instr->getType()) {
-                    case InstrType::Alloca: {
-                        Reg *reg = static_cast<Reg *>(instr->getDest());
-                        memList.push_back(reg->getName());
-                        
-                        Mem *mem = new Mem(reg->getName());
-                        instr->setDest(mem);
-                        continue;
-                    }
-                    
-                    // In order to keep from too many registers being used, we should always
-                    // go back to earlier registers once we hit a store instruction
-                    case InstrType::StructStore:
-                    case InstrType::Store: {
-                        regCount = 0;
-                    } break;
-                    
-                    case InstrType::GEP: {
-                        Reg *reg = static_cast<Reg *>(instr->getDest());
-                        ptrMap[reg->getName()] = ptrCount;
-                        ++ptrCount;
-                        
-                        PReg *reg2 = new PReg(ptrCount - 1);
-                        instr->setDest(reg2);
-                    } break;
-                    
-                    case InstrType::Load:
-                    case InstrType::StructLoad:
-                    case InstrType::Add:
-                    case InstrType::Sub:
-                    case InstrType::SMul:
-                    case InstrType::UMul:
-                    case InstrType::SDiv:
-                    case InstrType::UDiv:
-                    case InstrType::And:
-                    case InstrType::Or:
-                    case InstrType::Xor: {
-                        Reg *reg = static_cast<Reg *>(instr->getDest());
-                        regMap[reg->getName()] = regCount;
-                        ++regCount;
-                        
-                        HReg *reg2 = new HReg(regCount - 1);
-                        instr->setDest(reg2);
-                    } break;
-                    
-                    case InstrType::Call: {
-                        regCount = 0;
-                    
-                        FunctionCall *fc = static_cast<FunctionCall *>(instr);
-                        std::vector<Operand *> args;
-                        for (Operand *arg : fc->getArgs()) {
-                            Operand *op = checkOperand(arg);
-                            args.push_back(op);
-                        }
-                        fc->setArgs(args);
-                        
-                        if (instr->getDest()) {
-                            Reg *reg = static_cast<Reg *>(instr->getDest());
-                            regMap[reg->getName()] = regCount;
-                            ++regCount;
-                            
-                            HReg *reg2 = new HReg(regCount - 1);
-                            instr->setDest(reg2);
-                        }
-                    } break;
+            std::vector<PhiCopy> copies;
+            Instruction *pos = nullptr;
+            for (Instruction *instr : *block) {
+                if (instr->getType() != InstrType::Phi) {
+                    pos = instr;
+                    break;
                 }
                 
-                // Otherwise, check and switch the operands
-                if (instr->getOperand1()) {
-                    Operand *op = checkOperand(instr->getOperand1());
-                    instr->setOperand1(op);
+                PhiNode *phi = static_cast<PhiNode *>(instr);
+                int index = phi->getIncomingIndex(from->getName());
+                if (index < 0) continue;
+                copies.push_back({ static_cast<Reg *>(phi->getDest()), phi->getIncomingValue(index), phi->getDataType() });
+            }
+            
+            // With a single predecessor, the copies can go at the start of the block itself
+            if (preds.size() == 1) {
+                insertCopies(copies, block, pos);
+                continue;
+            }
+            
+            pos = nullptr;
+            for (Instruction *instr : *from) {
+                if (instr->isBranch() || instr->isTerminator()) {
+                    pos = instr;
+                    break;
                 }
+            }
+            insertCopies(copies, from, pos);
+        }
+        
+        Instruction *next = nullptr;
+        for (Instruction *instr = block->getFirst(); instr && instr->getType() == InstrType::Phi; instr = next) {
+            next = instr->getNext();
+            instr->eraseFromParent();
+        }
+    }
+}
+
+bool FunctionTransform::needsSplit(Block *pred) {
+    if (pred->getSuccessors().size() > 1) return true;
+    for (Instruction *instr : *pred) {
+        if (instr->isBranch() && instr->getType() != InstrType::Br) return true;
+    }
+    return false;
+}
+
+// The new block goes between the two if the edge is a fall-through, since control has to reach it
+// the same way. Otherwise it goes at the end of the function and jumps to the successor. The last
+// block is given a return first if it doesn't have one, so it can't fall into the new block.
+Block *FunctionTransform::splitEdge(Block *pred, Block *succ) {
+    std::string name;
+    do {
+        name = "split" + std::to_string(splitCount++);
+    } while (func->getBlockByName(name));
+    
+    Block *split = Block::Create(func, name);
+    Instruction *last = pred->getLast();
+    bool fallsThrough = pred->getNext() == succ && (last == nullptr || !last->isTerminator());
+    
+    for (Instruction *instr : *pred) {
+        if (!instr->isBranch() || instr->getBranchLabel()->getName() != succ->getName()) continue;
+        int slot = instr->getType() == InstrType::Br ? 0 : 2;
+        instr->setOperand(slot, arena->create<Label>(split->getName()));
+    }
+    
+    if (fallsThrough) {
+        func->addBlockAfter(pred, split);
+    } else {
+        Block *end = func->getLastBlock();
+        if (end->getLast() == nullptr || !end->getLast()->isTerminator()) {
+            Instruction *ret = arena->create<Instruction>(InstrType::Ret);
+            ret->setDataType(TypeContext::getVoidType());
+            end->addInstruction(ret);
+        }
+        
+        func->addBlockAfter(end, split);
+        Instruction *br = arena->create<Instruction>(InstrType::Br);
+        br->setDataType(TypeContext::getVoidType());
+        br->setOperand1(arena->create<Label>(succ->getName()));
+        split->addInstruction(br);
+    }
+    
+    for (Instruction *instr : *succ) {
+        if (instr->getType() != InstrType::Phi) break;
+        PhiNode *phi = static_cast<PhiNode *>(instr);
+        int index = phi->getIncomingIndex(pred->getName());
+        if (index >= 0) phi->setIncomingLabel(index, arena->create<Label>(split->getName()));
+    }
+    
+    return split;
+}
+
+// The copies of a block happen at once, so one may read what another writes. A copy is safe to do
+// once nothing still pending reads its destination. If none is safe, the rest form cycles, and one
+// destination is saved to a new register to break its cycle.
+void FunctionTransform::insertCopies(std::vector<PhiCopy> &copies, Block *block, Instruction *pos) {
+    auto emit = [&](Reg *dest, Operand *src, Type *type) {
+        Instruction *copy = arena->create<Instruction>(InstrType::Copy);
+        copy->setDataType(type);
+        copy->setDest(dest);
+        copy->setOperand1(src);
+        if (pos) block->insertBefore(pos, copy);
+        else block->addInstruction(copy);
+    };
+    
+    copies.erase(std::remove_if(copies.begin(), copies.end(), [](PhiCopy &copy) {
+        return copy.dest == copy.src;
+    }), copies.end());
+    
+    while (!copies.empty()) {
+        auto safe = std::find_if(copies.begin(), copies.end(), [&](PhiCopy &copy) {
+            for (PhiCopy &other : copies) {
+                if (other.src == copy.dest) return false;
+            }
+            return true;
+        });
+        
+        if (safe != copies.end()) {
+            emit(safe->dest, safe->src, safe->type);
+            copies.erase(safe);
+            continue;
+        }
+        
+        Reg *saved = func->createReg();
+        Reg *dest = copies[0].dest;
+        emit(saved, dest, copies[0].type);
+        for (PhiCopy &copy : copies) {
+            if (copy.src == dest) copy.src = saved;
+        }
+    }
+}
+
+//
+// Register allocation
+//
+
+// An argument can stay in its argument register as long as nothing can clobber it, which is the
+// case when it is only stored to memory at the start of the function. Any other argument is copied
+// to a virtual register of its own on entry.
+void FunctionTransform::copyArgs() {
+    Block *entry = func->getEntryBlock();
+    if (entry == nullptr) return;
+    
+    for (int i = 0; i<func->getArgCount(); i++) {
+        Reg *arg = func->getArg(i);
+        bool direct = true;
+        for (Use *use : arg->getUses()) {
+            Instruction *user = use->getUser();
+            if (user->getParent() != entry || user->getType() != InstrType::Store || use->getOperandNo() != 0) {
+                direct = false;
+            }
+        }
+        
+        bool called = false;
+        for (Instruction *instr : *entry) {
+            if (!direct) break;
+            if (instr->getType() == InstrType::Call) called = true;
+            Liveness::forEachUse(instr, [&](Reg *reg) {
+                if (reg == arg && called) direct = false;
+            });
+        }
+        if (direct) continue;
+        
+        Reg *copyReg = func->createReg();
+        arg->replaceAllUsesWith(copyReg);
+        
+        Instruction *copy = arena->create<Instruction>(InstrType::Copy);
+        copy->setDataType(func->getArgType(i));
+        copy->setDest(copyReg);
+        copy->setOperand1(arg);
+        if (entry->getFirst()) entry->insertBefore(entry->getFirst(), copy);
+        else entry->addInstruction(copy);
+    }
+}
+
+// Works through the ranges in order of their start. A register is free again once the range it
+// held has ended. A range ending at an instruction still counts there, so an instruction never
+// writes to the register of one of its own operands.
+//
+// Some values can't go in every register:
+//   - A value live across a call must be in a register the call keeps.
+//   - A value live across a division, or divided by, must stay out of AX and DX.
+//   - The arguments of a call with more than two of them must stay out of DX and CX, which are
+//     written while the arguments are set up.
+//   - Nothing else can use DX or CX while the arguments of the function are still in them.
+//
+// Pointers from getelementptr must be in a register, so they can only take the register of a value
+// that can be spilled. If there is none, the pointers left without a register are computed again
+// right where they are used, and the allocation starts over.
+Allocation FunctionTransform::allocate() {
+    AnalysisManager am;
+    Liveness *liveness = am.getResult<Liveness>(func);
+    int regCount = func->getRegCount();
+    hregs.assign(regCount, -1);
+    slots.assign(regCount, -1);
+    
+    std::vector<Reg *> regs;
+    std::vector<int> allowed(regCount, AllRegs);
+    std::vector<bool> spillable(regCount, true);
+    std::vector<int> calls;
+    std::vector<int> divisions;
+    
+    int pos = 0;
+    for (Block *block : *func) {
+        for (Instruction *instr : *block) {
+            switch (instr->getType()) {
+                case InstrType::Call: {
+                    calls.push_back(pos);
+                    if (instr->getOperandCount() <= 2) break;
+                    Liveness::forEachUse(instr, [&](Reg *reg) {
+                        allowed[reg->getID()] &= ~((1 << CX) | (1 << DX));
+                    });
+                } break;
                 
-                if (instr->getOperand2()) {
-                    Operand *op = checkOperand(instr->getOperand2());
-                    instr->setOperand2(op);
-                }
+                case InstrType::SDiv:
+                case InstrType::UDiv:
+                case InstrType::SRem:
+                case InstrType::URem: {
+                    divisions.push_back(pos);
+                    Operand *divisor = instr->getOperand2();
+                    if (divisor && divisor->getType() == OpType::Reg) {
+                        allowed[static_cast<Reg *>(divisor)->getID()] &= ~DivisionRegs;
+                    }
+                } break;
                 
-                if (instr->getOperand3()) {
-                    Operand *op = checkOperand(instr->getOperand3());
-                    instr->setOperand3(op);
-                }
+                default: {}
+            }
+            
+            Reg *def = Liveness::getDef(instr);
+            bool isPtr = instr->getType() == InstrType::GEP;
+            if (def && (needsHReg(instr) || isPtr) && hregs[def->getID()] == -1) {
+                hregs[def->getID()] = 0;
+                spillable[def->getID()] = !isPtr;
+                regs.push_back(def);
             }
+            ++pos;
         }
     }
+    
+    // Some position strictly inside the range
+    auto crosses = [](const std::vector<int> &positions, const LiveRange &range) {
+        auto it = std::upper_bound(positions.begin(), positions.end(), range.start);
+        return it != positions.end() && *it < range.end;
+    };
+    
+    for (Reg *reg : regs) {
+        const LiveRange &range = liveness->getRange(reg);
+        int &mask = allowed[reg->getID()];
+        if (crosses(calls, range)) mask &= CalleeSaved;
+        if (crosses(divisions, range)) mask &= ~DivisionRegs;
+        
+        for (int i = 0; i<func->getArgCount(); i++) {
+            int hreg = getArgHardReg(i);
+            if (hreg >= 0 && range.overlaps(liveness->getRange(func->getArg(i)))) mask &= ~(1 << hreg);
+        }
+    }
+    
+    std::stable_sort(regs.begin(), regs.end(), [liveness](Reg *a, Reg *b) {
+        return liveness->getRange(a).start < liveness->getRange(b).start;
+    });
+    
+    // The caller-saved registers come first, so the others are left for values live across calls
+    static const int order[] = { AX, CX, DX, BX, R12, R13 };
+    std::vector<bool> spilled(regCount, false);
+    std::vector<Reg *> active;
+    std::vector<Reg *> stuck;
+    
+    for (Reg *reg : regs) {
+        const LiveRange &range = liveness->getRange(reg);
+        int id = reg->getID();
+        
+        active.erase(std::remove_if(active.begin(), active.end(), [&](Reg *other) {
+            return liveness->getRange(other).end < range.start;
+        }), active.end());
+        
+        int used = 0;
+        for (Reg *other : active) used |= 1 << hregs[other->getID()];
+        
+        int hreg = -1;
+        for (int candidate : order) {
+            if ((allowed[id] & ~used) & (1 << candidate)) {
+                hreg = candidate;
+                break;
+            }
+        }
+        
+        if (hreg >= 0) {
+            hregs[id] = hreg;
+            active.push_back(reg);
+            continue;
+        }
+        
+        // Spill whichever of this value and those holding a usable register is needed furthest away
+        auto victim = active.end();
+        for (auto it = active.begin(); it != active.end(); ++it) {
+            int other = (*it)->getID();
+            if (!spillable[other] || !(allowed[id] & (1 << hregs[other]))) continue;
+            if (victim == active.end() || liveness->getRange(*it).end > liveness->getRange(*victim).end) victim = it;
+        }
+        
+        if (spillable[id] && (victim == active.end() || liveness->getRange(*victim).end <= range.end)) {
+            spilled[id] = true;
+        } else if (victim != active.end()) {
+            hregs[id] = hregs[(*victim)->getID()];
+            spilled[(*victim)->getID()] = true;
+            *victim = reg;
+        } else {
+            stuck.push_back(reg);
+        }
+    }
+    
+    if (!stuck.empty()) return rematerialize(stuck) ? Allocation::Retry : Allocation::Failed;
+    
+    for (Reg *reg : regs) {
+        if (spilled[reg->getID()]) slots[reg->getID()] = static_cast<Reg *>(createSlot()->getDest())->getID();
+    }
+    return Allocation::Done;
+}
+
+// Each use gets its own copy of the pointer, computed just before it, so the pointer is only live
+// for one instruction. Using a pointer as an operand reads the memory it points to, and only the
+// address of a load or a store needs the pointer itself. Anywhere else, the value is loaded right
+// after the copy, and the use takes the loaded value, which can be spilled like any other.
+//
+// Returns false if nothing could be changed: every pointer was already only live for one
+// instruction, which needs it as an address.
+bool FunctionTransform::rematerialize(const std::vector<Reg *> &ptrs) {
+    bool changed = false;
+    for (Reg *ptr : ptrs) {
+        std::vector<Use *> uses;
+        for (Use *use : ptr->getUses()) uses.push_back(use);
+        
+        Instruction *def = nullptr;
+        for (Block *block : *func) {
+            for (Instruction *instr : *block) {
+                if (instr->getDest() == ptr) def = instr;
+            }
+        }
+        
+        Type *elementType = def->getDataType();
+        if (elementType->getType() == DataType::Ptr) elementType = static_cast<PointerType *>(elementType)->getBaseType();
+        
+        auto isAddress = [elementType](Use *use) {
+            InstrType type = use->getUser()->getType();
+            if (type == InstrType::Load && use->getOperandNo() == 0) return true;
+            if (type == InstrType::Store && use->getOperandNo() == 1) return true;
+            return elementType->getType() == DataType::Struct;
+        };
+        
+        if (uses.size() == 1 && def->getNext() == uses[0]->getUser() && isAddress(uses[0])) continue;
+        
+        for (Use *use : uses) {
+            Instruction *user = use->getUser();
+            Instruction *copy = arena->create<Instruction>(InstrType::GEP);
+            copy->setDataType(def->getDataType());
+            copy->setDest(func->createReg());
+            copy->setOperand1(def->getOperand1());
+            copy->setOperand2(def->getOperand2());
+            user->getParent()->insertBefore(user, copy);
+            
+            if (isAddress(use)) {
+                use->set(copy->getDest());
+                continue;
+            }
+            
+            Instruction *load = arena->create<Instruction>(InstrType::Load);
+            load->setDataType(elementType);
+            load->setDest(func->createReg());
+            load->setOperand1(copy->getDest());
+            user->getParent()->insertBefore(user, load);
+            use->set(load->getDest());
+        }
+        def->eraseFromParent();
+        changed = true;
+    }
+    return changed;
+}
+
+// Stack slots are allocas, so the code generator lays them out like the others. They are large
+// enough for any value.
+Instruction *FunctionTransform::createSlot() {
+    Instruction *slot = arena->create<Instruction>(InstrType::Alloca);
+    slot->setDataType(TypeContext::getI64Type());
+    slot->setDest(func->createReg());
+    
+    Block *entry = func->getEntryBlock();
+    if (entry->getFirst()) entry->insertBefore(entry->getFirst(), slot);
+    else entry->addInstruction(slot);
+    return slot;
+}
+
+bool FunctionTransform::needsHReg(Instruction *instr) {
+    switch (instr->getType()) {
+        case InstrType::Load:
+        case InstrType::StructLoad:
+        case InstrType::Add:
+        case InstrType::Sub:
+        case InstrType::SMul:
+        case InstrType::UMul:
+        case InstrType::SDiv:
+        case InstrType::UDiv:
+        case InstrType::SRem:
+        case InstrType::URem:
+        case InstrType::And:
+        case InstrType::Or:
+        case InstrType::Xor:
+        case InstrType::Call:
+        case InstrType::Copy: return true;
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Returns the hardware operand for the destination of an instruction, or nullptr to leave it alone
+Operand *FunctionTransform::assign(Instruction *instr) {
+    switch (instr->getType()) {
+        case InstrType::Alloca: {
+            Reg *reg = static_cast<Reg *>(instr->getDest());
+            return arena->create<Mem>(reg->getID());
+        }
+        
+        case InstrType::GEP: {
+            Reg *reg = static_cast<Reg *>(instr->getDest());
+            return arena->create<PReg>(hregs[reg->getID()]);
+        }
+        
+        default: {}
+    }
+    
+    Reg *def = Liveness::getDef(instr);
+    if (def == nullptr || !needsHReg(instr)) return nullptr;
+    if (slots[def->getID()] >= 0) return arena->create<Mem>(slots[def->getID()]);
+    return arena->create<HReg>(hregs[def->getID()]);
+}
+
+} // end namespace
+
+// The argument registers are replaced through their uses, so the body has to exist first
+bool Function::transform() {
+    materialize();
+    return FunctionTransform(this, mod->getArena()).run();
+}
+
+PreservedAnalyses TransformPass::run(Function *func, AnalysisManager &am) {
+    if (!func->transform()) failed = true;
+    return PreservedAnalyses::none();
+}
+
+// Stubs are materialized up front, since the materializer can only be used from one thread.
+// Each function is then transformed on its own, using the arena of the thread it runs on.
+// The largest functions go first.
+bool Module::transform() {
+    materializeAll();
+    std::atomic<bool> ok(true);
+    parallelFor(functions.size(), [this, &ok](int i) {
+        if (!functions[i]->transform()) ok = false;
+    }, [this](int i) {
+        return (size_t)functions[i]->getInstrCount();
+    });
+    return ok;
 }
 
 } // end LLIR
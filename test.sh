@@ -38,10 +38,167 @@ function run_test() {
     done
 }
 
+#
+# Writes each test to bitcode and compiles it back from the bitcode. The module read
+# back must print exactly like the original, and the program must still pass.
+#
+function run_bitcode_test() {
+    for entry in $1
+    do
+    	name=`basename $entry .li`
+    	echo "$name (bitcode)"
+    	
+    	$OCC $entry --llir --emit-bc -o $name.lbc > llir1.txt
+    	$OCC $name.lbc --llir -o $name > llir2.txt
+    	
+    	diff llir1.txt llir2.txt
+    	if [[ $? != 0 ]] ; then
+    	    rm $name.lbc llir1.txt llir2.txt
+    	    clean_up $name
+    	    echo "Fail"
+    	    echo ""
+    	    exit 1
+    	fi
+    	rm $name.lbc llir1.txt llir2.txt
+    	
+    	./$name 1>> output.txt
+    	
+    	diff ./output.txt $OUTPUT/$name.txt
+    	if [[ $? == 0 ]] ; then
+    	    echo "Pass"
+    	    echo ""
+    	else
+    	    clean_up $name
+    	    echo "Fail"
+    	    echo ""
+    	    exit 1
+    	fi
+    	
+    	clean_up $name
+    	
+    	test_count=$((test_count+1))
+    done
+}
+
+#
+# Checks that the optimizations actually did something. Each file holds what --stats prints for
+# the test of the same name, compiled with the given options. The linker's warnings are left out.
+#
+function run_stats_test() {
+    for entry in $1
+    do
+    	name=`basename $entry .txt`
+    	echo "$name (stats)"
+    	
+    	$OCC test/$name.li $2 --stats -o $name 2> stats.txt > /dev/null
+    	grep -v "^ld: " stats.txt | diff - $entry
+    	if [[ $? == 0 ]] ; then
+    	    echo "Pass"
+    	    echo ""
+    	else
+    	    rm ./$name /tmp/$name.o /tmp/$name.s stats.txt
+    	    echo "Fail"
+    	    echo ""
+    	    exit 1
+    	fi
+    	
+    	rm ./$name /tmp/$name.o /tmp/$name.s stats.txt
+    	
+    	test_count=$((test_count+1))
+    done
+}
+
 echo "Running all tests..."
 echo ""
 
+# Builds one module from many threads and checks it against a serial build
+echo "parallel build"
+build/bench/bench_parallel_build > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
+# Checks the dominator trees and frontiers against the textbook solution
+echo "dominators"
+build/bench/bench_dominators 10000 > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
+# Checks the live sets and ranges against a naive solution
+echo "liveness"
+build/bench/bench_liveness 2 1000 > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
+# Checks forward problems of the dataflow solver against the dominator tree and a plain search
+echo "dataflow"
+build/bench/bench_dataflow 1000 > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
+# Checks the loops, their nesting, latches, exits and preheaders against a plain solution
+echo "loops"
+build/bench/bench_loops 1000 > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
+# Checks that the pass manager caches analyses and invalidates them with what was computed from them
+echo "pass manager"
+build/bench/bench_passes 100 > /dev/null
+if [[ $? == 0 ]] ; then
+    echo "Pass"
+    echo ""
+else
+    echo "Fail"
+    echo ""
+    exit 1
+fi
+test_count=$((test_count+1))
+
 run_test 'test/*.li'
+run_bitcode_test 'test/*.li'
+
+# The same programs through the optimization pipeline
+run_test 'test/*.li' '' -O1
+run_test 'test/*.li' '' -O2
+run_stats_test 'test/stats/*.txt' -O1
+
+# DCE on its own, since at -O1 SCCP removes unreachable blocks before it gets to them
+run_stats_test 'test/stats/dce/*.txt' '--passes mem2reg,dce'
 
 echo "$test_count tests passed successfully."
 echo "Done"